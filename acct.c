@@ -17,14 +17,18 @@
  */
 
 #include "acct.h"
+#include "cap.h"
 #include "decode.h"
 #include "conv.h"
 #include "daylog.h"
 #include "err.h"
+#include "flow.h"
+#include "hll.h"
 #include "hosts_db.h"
 #include "localip.h"
 #include "now.h"
 #include "opt.h"
+#include "sketch.h"
 
 #define __FAVOR_BSD
 #include <netinet/tcp.h>
@@ -133,10 +137,7 @@ acct_init_localnet(const char *spec)
    verbosef("   local network mask: %s", addr_to_str(&localmask));
 }
 
-static int addr_is_local(const struct addr * const a,
-                         const struct local_ips *local_ips) {
-   if (is_localip(a, local_ips))
-      return 1;
+static int addr_in_localnet(const struct addr * const a) {
    if (a->family == IPv4 && using_localnet4) {
       if (addr_inside(a, &localnet4, &localmask4))
          return 1;
@@ -147,17 +148,76 @@ static int addr_is_local(const struct addr * const a,
    return 0;
 }
 
+static int addr_is_local(const struct addr * const a,
+                         const struct local_ips *local_ips) {
+   return (is_localip(a, local_ips) || addr_in_localnet(a));
+}
+
+int acct_is_local(const struct addr * const a) {
+   return (cap_is_localip(a) || addr_in_localnet(a));
+}
+
+/* Fold an address into its --local-prefix or --remote-prefix. */
+static void fold_addr(struct addr *a, const int is_local) {
+   if (a->family == IPv4)
+      addr_prefix(a, is_local ? opt_local_prefix4 : opt_remote_prefix4);
+   else
+      addr_prefix(a, is_local ? opt_local_prefix6 : opt_remote_prefix6);
+}
+
+static uint64_t hash_addr(const struct addr * const a) {
+   if (a->family == IPv4)
+      return hll_hash(&(a->ip.v4), sizeof(a->ip.v4));
+   else
+      return hll_hash(&(a->ip.v6), sizeof(a->ip.v6));
+}
+
+/* Add traffic to the host, and to the sketch.  A host that hashtable_reduce()
+ * dropped starts again from its estimate in the sketch, instead of from zero.
+ * The --journal already has that much, so only what's new goes in it.
+ */
+static void host_add(struct bucket *h, const uint64_t in, const uint64_t out,
+                     const uint64_t pkts_in, const uint64_t pkts_out) {
+   struct sketch_count c;
+
+   if (sketch_enabled()) {
+      if ((h->total == 0) && (h->pkts_in == 0) && (h->pkts_out == 0)) {
+         sketch_estimate(&(h->u.host.addr), &c);
+         h->in = c.in;
+         h->out = c.out;
+         h->total = c.in + c.out;
+         h->pkts_in = c.pkts_in;
+         h->pkts_out = c.pkts_out;
+         host_journal_mark(h);
+      }
+      c.in = in;
+      c.out = out;
+      c.pkts_in = pkts_in;
+      c.pkts_out = pkts_out;
+      sketch_add(&(h->u.host.addr), &c);
+   }
+   h->in    += in;
+   h->out   += out;
+   h->total += in + out;
+   h->pkts_in  += pkts_in;
+   h->pkts_out += pkts_out;
+   if (opt_host_graphs != 0)
+      host_acct_graph(h, in, out);
+}
+
 /* Account for the given packet summary. */
 void acct_for(const struct pktsummary * const sm,
               const struct local_ips * const local_ips) {
    struct bucket *hs = NULL;  // Source host.
    struct bucket *hd = NULL;  // Dest host.
+   struct addr src, dst;      // Folded into prefixes.
    int dir_in, dir_out;
+   uint16_t vlan;
 
 #if 0 /* WANT_CHATTY? */
    printf("%15s > ", addr_to_str(&sm->src));
    printf("%15s ", addr_to_str(&sm->dst));
-   printf("len %4d proto %2d", sm->len, sm->proto);
+   printf("len %4llu proto %2d", (unsigned long long)sm->len, sm->proto);
 
    if (sm->proto == IPPROTO_TCP || sm->proto == IPPROTO_UDP)
       printf(" port %5d : %5d", sm->src_port, sm->dst_port);
@@ -174,21 +234,58 @@ void acct_for(const struct pktsummary * const sm,
 #endif
 
    /* Totals. */
-   acct_total_packets++;
+   acct_total_packets += sm->pkts;
    acct_total_bytes += sm->len;
 
+   /* Flows. */
+   if (opt_flows_max != 0)
+      flow_acct(sm);
+
+   /* VLANs. */
+   vlan = opt_want_vlans ? sm->vlan : 0;
+   if (vlan != 0)
+      graph_acct_vlan(vlan, sm->len, sm->pkts);
+
    /* Graphs. */
    dir_out = addr_is_local(&sm->src, local_ips);
    dir_in  = addr_is_local(&sm->dst, local_ips);
 
    /* Traffic staying within the network isn't counted. */
    if (dir_out && !dir_in) {
-      daylog_acct((uint64_t)sm->len, GRAPH_OUT);
-      graph_acct((uint64_t)sm->len, GRAPH_OUT);
+      daylog_acct((uint64_t)sm->len, sm->pkts, GRAPH_OUT);
+      graph_acct((uint64_t)sm->len, GRAPH_OUT, vlan, sm->ms);
    }
    if (dir_in && !dir_out) {
-      daylog_acct((uint64_t)sm->len, GRAPH_IN);
-      graph_acct((uint64_t)sm->len, GRAPH_IN);
+      daylog_acct((uint64_t)sm->len, sm->pkts, GRAPH_IN);
+      graph_acct((uint64_t)sm->len, GRAPH_IN, vlan, sm->ms);
+   }
+
+   /* Hosts and conversations are counted per prefix, which is the whole
+    * address unless --local-prefix or --remote-prefix say otherwise.
+    */
+   src = sm->src;
+   dst = sm->dst;
+   fold_addr(&src, dir_out);
+   fold_addr(&dst, dir_in);
+
+   /* Conversations.  The pair is ordered, so a packet from src to dst goes
+    * "out" if src is the lower address, and "in" otherwise.
+    */
+   if ((opt_pairs_max != 0) && (!opt_want_local_only || dir_in || dir_out)) {
+      struct bucket *p;
+
+      pairs_db_reduce();
+      if (addr_cmp(&src, &dst) <= 0) {
+         p = pair_get(&src, &dst);
+         p->out += sm->len;
+         p->pkts_out += sm->pkts;
+      } else {
+         p = pair_get(&dst, &src);
+         p->in += sm->len;
+         p->pkts_in += sm->pkts;
+      }
+      p->total += sm->len;
+      p->u.pair.last_seen_mono = now_mono();
    }
 
    if (opt_hosts_max == 0) return; /* skip per-host accounting */
@@ -196,18 +293,20 @@ void acct_for(const struct pktsummary * const sm,
    /* Hosts. */
    hosts_db_reduce();
    if (!opt_want_local_only || dir_out) {
-      hs = host_get(&(sm->src));
-      hs->out   += sm->len;
-      hs->total += sm->len;
+      hs = host_get(&src);
+      host_add(hs, 0, sm->len, 0, sm->pkts);
+      host_acct_rate(hs, sm->len, sm->pkts);
       memcpy(hs->u.host.mac_addr, sm->src_mac, sizeof(sm->src_mac));
       hs->u.host.last_seen_mono = now_mono();
+      hll_add(&(hs->u.host.peers), hash_addr(&dst));
    }
 
    if (!opt_want_local_only || dir_in) {
-      hd = host_get(&(sm->dst));
-      hd->in    += sm->len;
-      hd->total += sm->len;
+      hd = host_get(&dst);
+      host_add(hd, sm->len, 0, sm->pkts, 0);
+      host_acct_rate(hd, sm->len, sm->pkts);
       memcpy(hd->u.host.mac_addr, sm->dst_mac, sizeof(sm->dst_mac));
+      hll_add(&(hd->u.host.peers), hash_addr(&src));
       /*
        * Don't update recipient's last seen time, we don't know that
        * they received successfully.
@@ -220,17 +319,66 @@ void acct_for(const struct pktsummary * const sm,
          struct bucket *ps = host_get_ip_proto(hs, sm->proto);
          ps->out   += sm->len;
          ps->total += sm->len;
+         ps->pkts_out += sm->pkts;
       }
       if (hd) {
          struct bucket *pd = host_get_ip_proto(hd, sm->proto);
          pd->in    += sm->len;
          pd->total += sm->len;
+         pd->pkts_in += sm->pkts;
+      }
+   }
+
+   /* ICMP types, which are only ICMPv6 for IPv6. */
+   if (sm->has_icmp &&
+       (sm->proto == ((sm->src.family == IPv6) ? IPPROTO_ICMPV6
+                                               : IPPROTO_ICMP))) {
+      if (hs) {
+         struct bucket *is = host_get_icmp_type(hs, sm->icmp_type,
+                                                sm->icmp_code);
+         is->out   += sm->len;
+         is->total += sm->len;
+         is->pkts_out += sm->pkts;
+      }
+      if (hd) {
+         struct bucket *id = host_get_icmp_type(hd, sm->icmp_type,
+                                                sm->icmp_code);
+         id->in    += sm->len;
+         id->total += sm->len;
+         id->pkts_in += sm->pkts;
+      }
+   }
+
+   /* TCP flags.  Flow records have all the flags seen in the flow. */
+   if ((sm->proto == IPPROTO_TCP) && !sm->fragment) {
+      const uint8_t flags = sm->tcp_flags &
+         (TH_FIN|TH_SYN|TH_RST|TH_PUSH|TH_ACK|TH_URG);
+      if (hs) {
+         struct bucket *fs = host_get_tcp_flags(hs, flags);
+         fs->out   += sm->len;
+         fs->total += sm->len;
+         fs->pkts_out += sm->pkts;
       }
+      if (hd) {
+         struct bucket *fd = host_get_tcp_flags(hd, flags);
+         fd->in    += sm->len;
+         fd->total += sm->len;
+         fd->pkts_in += sm->pkts;
+      }
+   }
+
+   /* Distinct ports sent to, all of them, whatever --ports-max is. */
+   if (((sm->proto == IPPROTO_TCP) || (sm->proto == IPPROTO_UDP)) &&
+       !sm->fragment && hs) {
+      const uint32_t key = ((uint32_t)sm->proto << 16) | sm->dst_port;
+      hll_add(&(hs->u.host.ports), hll_hash(&key, sizeof(key)));
    }
 
    if (opt_ports_max == 0) return; /* skip ports accounting */
 
-   /* Ports. */
+   /* Ports.  Non-first fragments don't have any. */
+   if (sm->fragment)
+      return;
    switch (sm->proto) {
    case IPPROTO_TCP:
       // Local ports on host.
@@ -238,13 +386,15 @@ void acct_for(const struct pktsummary * const sm,
          struct bucket *ps = host_get_port_tcp(hs, sm->src_port);
          ps->out   += sm->len;
          ps->total += sm->len;
+         ps->pkts_out += sm->pkts;
       }
       if ((sm->dst_port <= opt_highest_port) && hd) {
          struct bucket *pd = host_get_port_tcp(hd, sm->dst_port);
          pd->in    += sm->len;
          pd->total += sm->len;
+         pd->pkts_in += sm->pkts;
          if (sm->tcp_flags == TH_SYN)
-            pd->u.port_tcp.syn++;
+            pd->u.port_tcp.syn += sm->pkts;
       }
 
       // Remote ports.
@@ -252,13 +402,15 @@ void acct_for(const struct pktsummary * const sm,
          struct bucket *pdr = host_get_port_tcp_remote(hd, sm->src_port);
          pdr->out   += sm->len;
          pdr->total += sm->len;
+         pdr->pkts_out += sm->pkts;
       }
       if ((sm->dst_port <= opt_highest_port) && hs) {
          struct bucket *psr = host_get_port_tcp_remote(hs, sm->dst_port);
          psr->in    += sm->len;
          psr->total += sm->len;
+         psr->pkts_in += sm->pkts;
          if (sm->tcp_flags == TH_SYN)
-            psr->u.port_tcp.syn++;
+            psr->u.port_tcp.syn += sm->pkts;
       }
       break;
 
@@ -268,11 +420,13 @@ void acct_for(const struct pktsummary * const sm,
          struct bucket *ps = host_get_port_udp(hs, sm->src_port);
          ps->out   += sm->len;
          ps->total += sm->len;
+         ps->pkts_out += sm->pkts;
       }
       if ((sm->dst_port <= opt_highest_port) && hd) {
          struct bucket *pd = host_get_port_udp(hd, sm->dst_port);
          pd->in    += sm->len;
          pd->total += sm->len;
+         pd->pkts_in += sm->pkts;
       }
 
       // Remote ports.
@@ -280,11 +434,13 @@ void acct_for(const struct pktsummary * const sm,
          struct bucket *pdr = host_get_port_udp_remote(hd, sm->src_port);
          pdr->out   += sm->len;
          pdr->total += sm->len;
+         pdr->pkts_out += sm->pkts;
       }
       if ((sm->dst_port <= opt_highest_port) && hs) {
          struct bucket *psr = host_get_port_udp_remote(hs, sm->dst_port);
          psr->in    += sm->len;
          psr->total += sm->len;
+         psr->pkts_in += sm->pkts;
       }
       break;
 
@@ -6,6 +6,7 @@
 
 #include <stdint.h>
 
+struct addr;
 struct pktsummary;
 struct local_ips;
 
@@ -15,4 +16,7 @@ void acct_init_localnet(const char *spec);
 void acct_for(const struct pktsummary * const sm,
               const struct local_ips * const local_ips);
 
+/* Inside the -l network, or one of the capture interfaces' addresses. */
+int acct_is_local(const struct addr * const a);
+
 /* vim:set ts=3 sw=3 tw=80 expandtab: */
@@ -26,6 +26,21 @@ int addr_equal(const struct addr * const a, const struct addr * const b)
    }
 }
 
+/* Total order on addresses: IPv4 before IPv6, then numerically.
+ * Returns <0, 0 or >0 like memcmp().
+ */
+int addr_cmp(const struct addr * const a, const struct addr * const b)
+{
+   if (a->family != b->family)
+      return (a->family < b->family) ? -1 : 1;
+   if (a->family == IPv4)
+      return memcmp(&(a->ip.v4), &(b->ip.v4), sizeof(a->ip.v4));
+   else {
+      assert(a->family == IPv6);
+      return memcmp(&(a->ip.v6), &(b->ip.v6), sizeof(a->ip.v6));
+   }
+}
+
 static char _addrstrbuf[INET6_ADDRSTRLEN];
 const char *addr_to_str(const struct addr * const a)
 {
@@ -40,6 +55,102 @@ const char *addr_to_str(const struct addr * const a)
    }
 }
 
+/* Writes v in decimal, returns the end. */
+static char *fmt_dec(char *p, unsigned int v)
+{
+   char tmp[10];
+   int n = 0;
+
+   do {
+      tmp[n++] = (char)('0' + v % 10);
+      v /= 10;
+   } while (v != 0);
+   while (n > 0)
+      *p++ = tmp[--n];
+   return (p);
+}
+
+/* Writes v in hex without leading zeroes, returns the end. */
+static char *fmt_hex16(char *p, const unsigned int v)
+{
+   static const char hex[] = "0123456789abcdef";
+   int shift = 12;
+
+   while ((shift > 0) && ((v >> shift) == 0))
+      shift -= 4;
+   for (; shift >= 0; shift -= 4)
+      *p++ = hex[(v >> shift) & 0xF];
+   return (p);
+}
+
+static char *fmt_v4(char *p, const uint8_t *b)
+{
+   int i;
+
+   for (i=0; i<4; i++) {
+      if (i != 0)
+         *p++ = '.';
+      p = fmt_dec(p, b[i]);
+   }
+   return (p);
+}
+
+/* Like inet_ntop(): the longest run of two or more zero words becomes "::",
+ * and IPv4-compatible and IPv4-mapped addresses end in a dotted quad.
+ */
+size_t addr_fmt(const struct addr * const a, char *out)
+{
+   const uint8_t *b;
+   unsigned int words[8];
+   int i, best = -1, best_len = 0, cur = -1, cur_len = 0;
+   char *p = out;
+
+   if (a->family == IPv4) {
+      p = fmt_v4(p, (const uint8_t *)&(a->ip.v4));
+      *p = '\0';
+      return (size_t)(p - out);
+   }
+   assert(a->family == IPv6);
+   b = a->ip.v6.s6_addr;
+   for (i=0; i<8; i++) {
+      words[i] = (unsigned int)(b[2*i] << 8 | b[2*i + 1]);
+      if (words[i] == 0) {
+         if (cur == -1) {
+            cur = i;
+            cur_len = 0;
+         }
+         cur_len++;
+         if (cur_len > best_len) {
+            best = cur;
+            best_len = cur_len;
+         }
+      } else
+         cur = -1;
+   }
+   if (best_len < 2)
+      best = -1;
+
+   for (i=0; i<8; i++) {
+      if ((best != -1) && (i >= best) && (i < best + best_len)) {
+         if (i == best)
+            *p++ = ':';
+         continue;
+      }
+      if (i != 0)
+         *p++ = ':';
+      if ((i == 6) && (best == 0) &&
+          ((best_len == 6) || ((best_len == 5) && (words[5] == 0xffff)))) {
+         p = fmt_v4(p, b + 12);
+         break;
+      }
+      p = fmt_hex16(p, words[i]);
+   }
+   if ((best != -1) && (best + best_len == 8))
+      *p++ = ':';
+   *p = '\0';
+   return (size_t)(p - out);
+}
+
 int str_to_addr(const char *s, struct addr *a)
 {
    struct addrinfo hints, *ai;
@@ -95,4 +206,24 @@ int addr_inside(const struct addr * const a,
    return (addr_equal(&masked, net));
 }
 
+void addr_prefix(struct addr *a, const unsigned int len)
+{
+   if (a->family == IPv4) {
+      assert(len <= 32);
+      if (len < 32)
+         a->ip.v4 &= htonl(len == 0 ? 0 : ~(uint32_t)0 << (32 - len));
+   } else {
+      size_t i;
+
+      assert(a->family == IPv6);
+      assert(len <= 128);
+      for (i = len / 8; i < sizeof(a->ip.v6.s6_addr); i++) {
+         if (i == len / 8)
+            a->ip.v6.s6_addr[i] &= (uint8_t)(0xff << (8 - len % 8));
+         else
+            a->ip.v6.s6_addr[i] = 0;
+      }
+   }
+}
+
 /* vim:set ts=3 sw=3 tw=78 et: */
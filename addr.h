@@ -23,11 +23,21 @@ struct addr {
 };
 
 int addr_equal(const struct addr * const a, const struct addr * const b);
+int addr_cmp(const struct addr * const a, const struct addr * const b);
 const char *addr_to_str(const struct addr * const a);
+
+/* Writes the same string as addr_to_str() into out, which must have room
+ * for INET6_ADDRSTRLEN bytes, without printf or inet_ntop.  Returns its
+ * length.
+ */
+size_t addr_fmt(const struct addr * const a, char *out);
 void addr_mask(struct addr *a, const struct addr * const mask);
 int addr_inside(const struct addr * const a,
    const struct addr * const net, const struct addr * const mask);
 
+/* Keep the first len bits of the address, and zero the rest. */
+void addr_prefix(struct addr *a, const unsigned int len);
+
 /* Returns 0 on success, gai_strerror() code otherwise. */
 int str_to_addr(const char *s, struct addr *a);
 
@@ -81,6 +81,57 @@ void test_inside(const char *a, const char *net, const char *mask, int expect)
       a, net, mask);
 }
 
+void test_cmp(const char *a, const char *b, int expect)
+{
+  struct addr aa, ab;
+  int ret;
+
+  str_to_addr(a, &aa);
+  str_to_addr(b, &ab);
+  ret = addr_cmp(&aa, &ab);
+  ret = (ret > 0) - (ret < 0);
+
+  printf("%s: cmp(%s, %s) = %d\n", (ret == expect) ? "PASS" : "FAIL",
+      a, b, ret);
+  if (ret != expect) {
+    retcode = 1;
+  }
+}
+
+void test_prefix(const char *a, unsigned int len, const char *expect)
+{
+  struct addr aa;
+  const char *out;
+
+  str_to_addr(a, &aa);
+  addr_prefix(&aa, len);
+  out = addr_to_str(&aa);
+
+  printf("%s: %s/%u -> %s\n", (strcmp(out, expect) == 0) ? "PASS" : "FAIL",
+      a, len, out);
+  if (strcmp(out, expect) != 0) {
+    retcode = 1;
+  }
+}
+
+/* addr_fmt() agrees with addr_to_str() and with what we expect. */
+void test_fmt(const char *a, const char *expect)
+{
+  struct addr aa;
+  char out[INET6_ADDRSTRLEN];
+  size_t len;
+  int ok;
+
+  str_to_addr(a, &aa);
+  len = addr_fmt(&aa, out);
+  ok = (strcmp(out, expect) == 0) && (len == strlen(expect)) &&
+       (strcmp(out, addr_to_str(&aa)) == 0);
+  printf("%s: fmt %s -> %s\n", ok ? "PASS" : "FAIL", a, out);
+  if (!ok) {
+    retcode = 1;
+  }
+}
+
 int main() {
   test("0.0.0.0", "0.0.0.0", 0);
   test("192.168.1.2", "192.168.1.2", 0);
@@ -108,6 +159,35 @@ int main() {
       "2001:0200::",
       "ffff:ffff::", 1);
 
+  test_cmp("10.0.0.1", "10.0.0.1", 0);
+  test_cmp("10.0.0.1", "10.0.0.2", -1);
+  test_cmp("10.0.1.0", "10.0.0.255", 1);
+  test_cmp("255.255.255.255", "::", -1);
+  test_cmp("::2", "::1", 1);
+
+  test_prefix("192.168.1.2", 32, "192.168.1.2");
+  test_prefix("192.168.1.2", 24, "192.168.1.0");
+  test_prefix("192.168.1.2", 23, "192.168.0.0");
+  test_prefix("192.168.1.2", 0, "0.0.0.0");
+  test_prefix("2001:db8:1:2:3:4:5:6", 128, "2001:db8:1:2:3:4:5:6");
+  test_prefix("2001:db8:1:2:3:4:5:6", 64, "2001:db8:1:2::");
+  test_prefix("2001:db8:1:2:3:4:5:6", 48, "2001:db8:1::");
+  test_prefix("2001:db8:ffff::1", 36, "2001:db8:f000::");
+  test_prefix("2001:db8::1", 0, "::");
+
+  test_fmt("0.0.0.0", "0.0.0.0");
+  test_fmt("10.200.3.45", "10.200.3.45");
+  test_fmt("255.255.255.255", "255.255.255.255");
+  test_fmt("::", "::");
+  test_fmt("::1", "::1");
+  test_fmt("1::", "1::");
+  test_fmt("2001:db8::ff00:42:8329", "2001:db8::ff00:42:8329");
+  test_fmt("2001:db8:0:1:1:1:1:1", "2001:db8:0:1:1:1:1:1");
+  test_fmt("2001:0:0:1:0:0:0:1", "2001:0:0:1::1");
+  test_fmt("2001:db8:0:0:1:0:0:1", "2001:db8::1:0:0:1");
+  test_fmt("fe80::abcd:ef01:2345:6789", "fe80::abcd:ef01:2345:6789");
+  test_fmt("::ffff:192.0.2.1", "::ffff:192.0.2.1");
+
   return retcode;
 }
 
@@ -20,6 +20,7 @@
 #include "now.h"
 #include "opt.h"
 #include "queue.h"
+#include "stats.h"
 #include "str.h"
 
 #include <sys/ioctl.h>
@@ -34,6 +35,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 char *title_interfaces = NULL; /* for html.c */
@@ -63,6 +65,7 @@ struct cap_iface {
    int fd;
    const struct linkhdr *linkhdr;
    struct local_ips local_ips;
+   unsigned int pkts_recv, pkts_drop; /* from the last pcap_stats() */
 };
 
 static STAILQ_HEAD(cli_ifnames_head, strnode) cli_ifnames =
@@ -271,6 +274,7 @@ void cap_start(const int promisc) {
       iface->fd = -1;
       iface->linkhdr = NULL;
       localip_init(&iface->local_ips);
+      iface->pkts_recv = iface->pkts_drop = 0;
       STAILQ_INSERT_TAIL(&cap_ifs, iface, entries);
       cap_start_one(iface, promisc);
 
@@ -350,11 +354,29 @@ static void cap_stats_update(void) {
          warnx("pcap_stats('%s'): %s", iface->name, pcap_geterr(iface->pcap));
          return;
       }
+      iface->pkts_recv = ps.ps_recv;
+      iface->pkts_drop = ps.ps_drop;
       cap_pkts_recv += ps.ps_recv;
       cap_pkts_drop += ps.ps_drop;
    }
 }
 
+/* Gets the counters of the nth interface.  Returns 0 if there isn't one. */
+int cap_iface_stats(const unsigned int n, const char **name,
+                    unsigned int *recv, unsigned int *drop) {
+   struct cap_iface *iface;
+   unsigned int i = 0;
+
+   STAILQ_FOREACH(iface, &cap_ifs, entries)
+      if (i++ == n) {
+         *name = iface->name;
+         *recv = iface->pkts_recv;
+         *drop = iface->pkts_drop;
+         return 1;
+      }
+   return 0;
+}
+
 /* Print hexdump of received packet to stdout, for debugging. */
 static void hexdump(const u_char *buf,
                     const uint32_t len,
@@ -379,6 +401,29 @@ static void hexdump(const u_char *buf,
    printf("\n");
 }
 
+/* Returns 1 if the packet should be accounted for, 0 if it's sampled out.
+ * Either every Nth packet is kept, or each one with probability 1/N.
+ */
+static int sample_packet(void) {
+   static unsigned int skipped = 0;
+   static uint64_t rng = 0;
+
+   if (opt_want_sample_random) {
+      if (rng == 0)
+         rng = ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid() ^
+               0x9E3779B97F4A7C15ULL;
+      /* xorshift64 */
+      rng ^= rng << 13;
+      rng ^= rng >> 7;
+      rng ^= rng << 17;
+      return (rng % opt_sample) == 0;
+   }
+   if (++skipped < opt_sample)
+      return 0;
+   skipped = 0;
+   return 1;
+}
+
 /* Callback function for pcap_dispatch() which chains to the decoder specified
  * in the linkhdr struct.
  */
@@ -387,12 +432,42 @@ static void callback(u_char *user,
                      const u_char *pdata) {
    const struct cap_iface * const iface = (struct cap_iface *)user;
    struct pktsummary sm;
+   struct timespec t;
+   int timed;
 
+   /* Skipped packets aren't decoded at all, that's the point of sampling. */
+   if (opt_sample > 1 && !sample_packet())
+      return;
    if (opt_want_hexdump)
       hexdump(pdata, pheader->caplen, iface->linkhdr);
    memset(&sm, 0, sizeof(sm));
-   if (iface->linkhdr->decoder(pheader, pdata, &sm))
-      acct_for(&sm, &iface->local_ips);
+   sm.pkts = 1;
+   sm.ms = (int64_t)pheader->ts.tv_sec * 1000 + pheader->ts.tv_usec / 1000;
+   timed = stats_sample();
+   if (timed)
+      timer_start(&t);
+   if (!decode_packet(iface->linkhdr, pheader, pdata, &sm))
+      return;
+   if (timed)
+      stats_time(STATS_DECODE, &t);
+   if (opt_sample > 1) {
+      /* Scale up so every counter downstream is an estimate of the total. */
+      sm.len *= opt_sample;
+      sm.pkts = opt_sample;
+   }
+   acct_for(&sm, &iface->local_ips);
+   if (timed)
+      stats_time(STATS_ACCT, &t);
+}
+
+/* Is it one of the addresses of the interfaces we're capturing on? */
+int cap_is_localip(const struct addr * const a) {
+   struct cap_iface *iface;
+
+   STAILQ_FOREACH(iface, &cap_ifs, entries)
+      if (is_localip(a, &iface->local_ips))
+         return 1;
+   return 0;
 }
 
 /* Process any packets currently in the capture buffer.
@@ -426,9 +501,10 @@ int cap_poll(fd_set *read_set _unused_on_linux_) {
                -1, /* count = entire buffer */
                callback,
                (u_char*)iface); /* user = struct to pass to callback */
-         timer_stop(&t,
-                    2 * CAP_TIMEOUT_MSEC * 1000000,
-                    "pcap_dispatch took too long");
+         stats_record(STATS_DISPATCH,
+                      timer_stop(&t,
+                                 2 * CAP_TIMEOUT_MSEC * 1000000,
+                                 "pcap_dispatch took too long"));
 
          if (ret < 0) {
             warnx("pcap_dispatch('%s'): %s",
@@ -19,6 +19,12 @@ int cap_poll(fd_set *read_set);
 void cap_stop(void);
 void cap_free_args(void);
 
+int cap_iface_stats(const unsigned int n, const char **name,
+                    unsigned int *recv, unsigned int *drop);
+
 void cap_from_file(const char *capfile);
 
+struct addr;
+int cap_is_localip(const struct addr * const a);
+
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -0,0 +1,772 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * collect.c: receive NetFlow v5, NetFlow v9 (RFC 3954), IPFIX (RFC 7011)
+ * and sFlow v5 from routers, and account for them as if the traffic had
+ * been captured.
+ *
+ * Each flow record or packet sample becomes one pktsummary whose byte and
+ * packet counts are scaled up by the sampling rate, if the exporter tells
+ * us what it is.  NetFlow v9 and IPFIX need templates, which are kept per
+ * exporter; data which arrives before its template is dropped.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#include "acct.h"
+#include "cdefs.h"
+#include "collect.h"
+#include "conv.h"
+#include "decode.h"
+#include "err.h"
+#include "localip.h"
+#include "opt.h"
+#include "queue.h"
+#include "str.h"
+#include "tree.h"
+
+#include <sys/socket.h>
+#include <assert.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pcap.h> /* for struct pcap_pkthdr and DLT_* */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COLLECT_MAX_EXPORTERS 256
+#define COLLECT_MAX_TEMPLATES 64 /* per exporter */
+#define COLLECT_MAX_FIELDS 64    /* per template */
+#define COLLECT_BURST 256        /* datagrams per poll */
+#define COLLECT_BUFSIZE 65536
+#define COLLECT_RCVBUF (4 * 1024 * 1024) /* socket receive buffer */
+
+/* Information element IDs, same as NetFlow v9 field types. */
+#define IE_OCTETS 1
+#define IE_PACKETS 2
+#define IE_PROTOCOL 4
+#define IE_TCP_FLAGS 6
+#define IE_SRC_PORT 7
+#define IE_SRC_IPV4 8
+#define IE_DST_PORT 11
+#define IE_DST_IPV4 12
+#define IE_SRC_IPV6 27
+#define IE_DST_IPV6 28
+#define IE_ICMP_TYPE_CODE 32
+#define IE_ICMP_TYPE_CODE_V6 139
+#define IE_VLAN_ID 58
+#define IE_DOT1Q_VLAN_ID 243
+#define IE_SAMPLING_INTERVAL 34
+#define IE_SAMPLER_RANDOM_INTERVAL 50
+#define IE_SAMPLING_PACKET_INTERVAL 305
+#define IE_IGNORE 0 /* enterprise-specific, or a v9 options scope */
+
+#define VARIABLE_LEN 65535 /* IPFIX variable-length field */
+
+struct template_field {
+   uint16_t id, len;
+};
+
+struct template {
+   LIST_ENTRY(template) entries;
+   uint16_t id, nfields;
+   size_t min_len; /* of a record */
+   struct template_field fields[COLLECT_MAX_FIELDS];
+};
+
+/* NetFlow v9 source ID or IPFIX observation domain on a given router. */
+struct exporter {
+   RB_ENTRY(exporter) ptree;
+   struct addr addr;
+   uint32_t domain;
+   int version;
+   uint32_t sampling; /* from an options record, or 0 if unknown */
+   unsigned int num_templates;
+   LIST_HEAD(template_list, template) templates;
+};
+
+static int
+exporter_cmp(struct exporter *a, struct exporter *b)
+{
+   if (a->version != b->version)
+      return (a->version < b->version) ? -1 : +1;
+   if (a->domain != b->domain)
+      return (a->domain < b->domain) ? -1 : +1;
+   return addr_cmp(&(a->addr), &(b->addr));
+}
+
+RB_HEAD(exporter_tree, exporter);
+RB_GENERATE_STATIC(exporter_tree, exporter, ptree, exporter_cmp)
+
+static struct exporter_tree exporters = RB_INITIALIZER(&exporters);
+static unsigned int num_exporters = 0;
+
+static int collect_fd = -1;
+static unsigned char *collect_buf = NULL;
+static struct local_ips collect_local_ips; /* always empty, -l still works */
+
+static uint64_t collect_stat_datagrams, collect_stat_records,
+   collect_stat_malformed, collect_stat_no_template;
+
+/* ---------------------------------------------------------------------------
+ * Big-endian readers.  Callers check lengths first.
+ */
+static uint16_t get16(const unsigned char *p) {
+   return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const unsigned char *p) {
+   return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+/* IPFIX allows counters to be sent in fewer bytes than their type. */
+static uint64_t getn(const unsigned char *p, const size_t len) {
+   uint64_t v = 0;
+   size_t i;
+
+   if (len > 8)
+      return 0;
+   for (i = 0; i < len; i++)
+      v = (v << 8) | p[i];
+   return v;
+}
+
+static void account(struct pktsummary *sm, const uint64_t sampling) {
+   if (sampling > 1) {
+      sm->len *= sampling;
+      sm->pkts *= sampling;
+   }
+   collect_stat_records++;
+   acct_for(sm, &collect_local_ips);
+}
+
+/* ---------------------------------------------------------------------------
+ * NetFlow v5: fixed format.
+ */
+#define V5_HDR_LEN 24
+#define V5_REC_LEN 48
+
+static void collect_v5(const unsigned char *data, const size_t len) {
+   uint16_t count, sampling, i;
+   const unsigned char *r;
+   struct pktsummary sm;
+
+   if (len < V5_HDR_LEN) {
+      collect_stat_malformed++;
+      return;
+   }
+   count = get16(data + 2);
+   sampling = get16(data + 22) & 0x3FFF; /* top two bits are the mode */
+   if (len < V5_HDR_LEN + (size_t)count * V5_REC_LEN) {
+      collect_stat_malformed++;
+      return;
+   }
+   for (i = 0; i < count; i++) {
+      r = data + V5_HDR_LEN + i * V5_REC_LEN;
+      memset(&sm, 0, sizeof(sm));
+      sm.src.family = sm.dst.family = IPv4;
+      memcpy(&(sm.src.ip.v4), r, 4);
+      memcpy(&(sm.dst.ip.v4), r + 4, 4);
+      sm.pkts = get32(r + 16);
+      sm.len = get32(r + 20);
+      sm.proto = r[38];
+      if ((sm.proto == IPPROTO_TCP) || (sm.proto == IPPROTO_UDP)) {
+         sm.src_port = get16(r + 32);
+         sm.dst_port = get16(r + 34);
+      }
+      if (sm.proto == IPPROTO_ICMP) {
+         /* By convention, the destination port is type << 8 | code. */
+         sm.has_icmp = 1;
+         sm.icmp_type = r[34];
+         sm.icmp_code = r[35];
+      }
+      sm.tcp_flags = r[37];
+      account(&sm, sampling);
+   }
+}
+
+/* ---------------------------------------------------------------------------
+ * NetFlow v9 and IPFIX: templates, then data described by them.
+ */
+static struct exporter *
+exporter_get(const struct addr * const a, const uint32_t domain,
+   const int version)
+{
+   struct exporter key, *e;
+
+   key.addr = *a;
+   key.domain = domain;
+   key.version = version;
+   if ((e = RB_FIND(exporter_tree, &exporters, &key)) != NULL)
+      return e;
+   if (num_exporters >= COLLECT_MAX_EXPORTERS)
+      return NULL;
+   e = xmalloc(sizeof(*e));
+   *e = key;
+   e->sampling = 0;
+   e->num_templates = 0;
+   LIST_INIT(&(e->templates));
+   RB_INSERT(exporter_tree, &exporters, e);
+   num_exporters++;
+   verbosef("collect: new exporter %s, %s domain %u", addr_to_str(a),
+      (version == 9) ? "NetFlow v9" : "IPFIX", (unsigned int)domain);
+   return e;
+}
+
+static struct template *
+template_find(struct exporter *e, const uint16_t id)
+{
+   struct template *t;
+
+   LIST_FOREACH(t, &(e->templates), entries)
+      if (t->id == id)
+         return t;
+   return NULL;
+}
+
+static void
+template_withdraw(struct exporter *e, const uint16_t id)
+{
+   struct template *t = template_find(e, id);
+
+   if (t != NULL) {
+      LIST_REMOVE(t, entries);
+      free(t);
+      e->num_templates--;
+   }
+}
+
+/* Parse one template record of nfields fields, the first nscope of which
+ * are options scope.  Returns bytes used, or 0 if malformed. */
+static size_t
+template_parse(struct exporter *e, const uint16_t id,
+   const unsigned int nfields, const unsigned int nscope,
+   const unsigned char *p, const size_t left)
+{
+   struct template *t, tmp;
+   size_t pos = 0;
+   unsigned int i;
+
+   if ((id < 256) || (nfields > COLLECT_MAX_FIELDS) || (nscope > nfields))
+      return 0;
+   memset(&tmp, 0, sizeof(tmp));
+   tmp.id = id;
+   tmp.nfields = (uint16_t)nfields;
+   for (i = 0; i < nfields; i++) {
+      uint16_t fid, flen;
+
+      if (pos + 4 > left)
+         return 0;
+      fid = get16(p + pos);
+      flen = get16(p + pos + 2);
+      pos += 4;
+      if ((e->version == 10) && (fid & 0x8000)) {
+         /* enterprise-specific: skip the enterprise number */
+         if (pos + 4 > left)
+            return 0;
+         pos += 4;
+         fid = IE_IGNORE;
+      }
+      if (i < nscope)
+         fid = IE_IGNORE;
+      if ((flen == VARIABLE_LEN) && (e->version == 9))
+         return 0;
+      tmp.fields[i].id = fid;
+      tmp.fields[i].len = flen;
+      tmp.min_len += (flen == VARIABLE_LEN) ? 1 : flen;
+   }
+   if (tmp.min_len == 0)
+      return 0;
+
+   if ((t = template_find(e, id)) == NULL) {
+      if (e->num_templates >= COLLECT_MAX_TEMPLATES)
+         return pos; /* well-formed, but no room */
+      t = xmalloc(sizeof(*t));
+      LIST_INSERT_HEAD(&(e->templates), t, entries);
+      e->num_templates++;
+   }
+   tmp.entries = t->entries;
+   *t = tmp;
+   return pos;
+}
+
+/* Template set (IPFIX set 2, v9 flowset 0) or options template set (IPFIX
+ * set 3, v9 flowset 1).  Returns 0 if malformed. */
+static int
+templates_parse(struct exporter *e, const int options,
+   const unsigned char *p, const size_t len)
+{
+   size_t pos = 0, used;
+
+   while (pos + 4 <= len) {
+      uint16_t id = get16(p + pos), nfields, nscope = 0;
+
+      if (!options) {
+         nfields = get16(p + pos + 2);
+         pos += 4;
+         if (nfields == 0) {
+            template_withdraw(e, id);
+            continue;
+         }
+      } else if (e->version == 9) {
+         /* scope and option lengths are in bytes */
+         if (pos + 6 > len)
+            return 0;
+         nscope = get16(p + pos + 2) / 4;
+         nfields = nscope + get16(p + pos + 4) / 4;
+         pos += 6;
+      } else {
+         if (pos + 6 > len)
+            break; /* padding */
+         nfields = get16(p + pos + 2);
+         nscope = get16(p + pos + 4);
+         pos += 6;
+         if (nfields == 0) {
+            template_withdraw(e, id);
+            continue;
+         }
+      }
+      used = template_parse(e, id, nfields, nscope, p + pos, len - pos);
+      if (used == 0)
+         return 0;
+      pos += used;
+   }
+   return 1;
+}
+
+/* Decode one data record.  Returns bytes used, or 0 if malformed. */
+static size_t
+record_parse(struct exporter *e, const struct template *t,
+   const unsigned char *p, const size_t left)
+{
+   struct pktsummary sm;
+   uint64_t sampling = 0;
+   size_t pos = 0, flen;
+   unsigned int i;
+
+   memset(&sm, 0, sizeof(sm));
+   sm.proto = IPPROTO_INVALID;
+   for (i = 0; i < t->nfields; i++) {
+      const unsigned char *v;
+
+      flen = t->fields[i].len;
+      if (flen == VARIABLE_LEN) {
+         if (pos + 1 > left)
+            return 0;
+         flen = p[pos++];
+         if (flen == 255) {
+            if (pos + 2 > left)
+               return 0;
+            flen = get16(p + pos);
+            pos += 2;
+         }
+      }
+      if (pos + flen > left)
+         return 0;
+      v = p + pos;
+      pos += flen;
+
+      switch (t->fields[i].id) {
+      case IE_OCTETS:    sm.len = getn(v, flen); break;
+      case IE_PACKETS:   sm.pkts = getn(v, flen); break;
+      case IE_PROTOCOL:  sm.proto = (uint8_t)getn(v, flen); break;
+      case IE_TCP_FLAGS: sm.tcp_flags = (uint8_t)getn(v, flen); break;
+      case IE_SRC_PORT:  sm.src_port = (uint16_t)getn(v, flen); break;
+      case IE_DST_PORT:  sm.dst_port = (uint16_t)getn(v, flen); break;
+      case IE_ICMP_TYPE_CODE:
+      case IE_ICMP_TYPE_CODE_V6:
+         if (flen == 2) {
+            sm.has_icmp = 1;
+            sm.icmp_type = v[0];
+            sm.icmp_code = v[1];
+         }
+         break;
+      case IE_VLAN_ID:
+      case IE_DOT1Q_VLAN_ID:
+         sm.vlan = (uint16_t)(getn(v, flen) & 0x0FFF);
+         break;
+      case IE_SRC_IPV4:
+         if (flen == 4) {
+            sm.src.family = IPv4;
+            memcpy(&(sm.src.ip.v4), v, 4);
+         }
+         break;
+      case IE_DST_IPV4:
+         if (flen == 4) {
+            sm.dst.family = IPv4;
+            memcpy(&(sm.dst.ip.v4), v, 4);
+         }
+         break;
+      case IE_SRC_IPV6:
+         if (flen == 16) {
+            sm.src.family = IPv6;
+            memcpy(&(sm.src.ip.v6), v, 16);
+         }
+         break;
+      case IE_DST_IPV6:
+         if (flen == 16) {
+            sm.dst.family = IPv6;
+            memcpy(&(sm.dst.ip.v6), v, 16);
+         }
+         break;
+      case IE_SAMPLING_INTERVAL:
+      case IE_SAMPLER_RANDOM_INTERVAL:
+      case IE_SAMPLING_PACKET_INTERVAL:
+         sampling = getn(v, flen);
+         break;
+      }
+   }
+
+   if (sampling != 0)
+      e->sampling = (uint32_t)sampling; /* options record, usually */
+   if ((sm.src.family != 0) && (sm.src.family == sm.dst.family) &&
+       (sm.pkts != 0)) {
+      if ((sm.proto != IPPROTO_TCP) && (sm.proto != IPPROTO_UDP))
+         sm.src_port = sm.dst_port = 0;
+      if (sm.proto != IPPROTO_TCP)
+         sm.tcp_flags = 0;
+      account(&sm, e->sampling);
+   }
+   return pos;
+}
+
+static void
+data_parse(struct exporter *e, const uint16_t id,
+   const unsigned char *p, const size_t len)
+{
+   const struct template *t = template_find(e, id);
+   size_t pos = 0, used;
+
+   if (t == NULL) {
+      collect_stat_no_template++;
+      return;
+   }
+   /* Anything shorter than a record is padding. */
+   while (len - pos >= t->min_len) {
+      used = record_parse(e, t, p + pos, len - pos);
+      if (used == 0) {
+         collect_stat_malformed++;
+         return;
+      }
+      pos += used;
+   }
+}
+
+static void
+collect_v9_ipfix(const struct addr * const from,
+   const unsigned char *data, const size_t len)
+{
+   const int version = get16(data);
+   const size_t hdr_len = (version == 9) ? 20 : 16;
+   struct exporter *e;
+   size_t pos, end = len;
+
+   if (len < hdr_len) {
+      collect_stat_malformed++;
+      return;
+   }
+   if (version == 10) {
+      end = get16(data + 2);
+      if ((end < hdr_len) || (end > len)) {
+         collect_stat_malformed++;
+         return;
+      }
+   }
+   e = exporter_get(from, get32(data + hdr_len - 4), version);
+   if (e == NULL)
+      return;
+
+   for (pos = hdr_len; pos + 4 <= end; ) {
+      uint16_t set_id = get16(data + pos), set_len = get16(data + pos + 2);
+      const unsigned char *body = data + pos + 4;
+      int ok = 1;
+
+      if ((set_len < 4) || (pos + set_len > end)) {
+         collect_stat_malformed++;
+         return;
+      }
+      if (set_id == ((version == 9) ? 0 : 2))
+         ok = templates_parse(e, 0, body, set_len - 4U);
+      else if (set_id == ((version == 9) ? 1 : 3))
+         ok = templates_parse(e, 1, body, set_len - 4U);
+      else if (set_id >= 256)
+         data_parse(e, set_id, body, set_len - 4U);
+      if (!ok)
+         collect_stat_malformed++;
+      pos += set_len;
+   }
+}
+
+/* ---------------------------------------------------------------------------
+ * sFlow v5: packet headers sampled by the switch, which we decode.
+ */
+#define SFLOW_FLOW_SAMPLE 1
+#define SFLOW_FLOW_SAMPLE_EXPANDED 3
+#define SFLOW_RAW_HEADER 1
+#define SFLOW_HEADER_ETHERNET 1
+#define SFLOW_HEADER_IPV4 11
+#define SFLOW_HEADER_IPV6 12
+
+static void
+sflow_raw_header(const unsigned char *p, const size_t len,
+   const uint32_t sampling)
+{
+   const struct linkhdr *lh;
+   struct pcap_pkthdr pheader;
+   struct pktsummary sm;
+   uint32_t proto, hlen;
+
+   if (len < 16)
+      return;
+   proto = get32(p);
+   hlen = get32(p + 12);
+   if (hlen > len - 16)
+      return;
+   if (proto == SFLOW_HEADER_ETHERNET)
+      lh = getlinkhdr(DLT_EN10MB);
+   else if ((proto == SFLOW_HEADER_IPV4) || (proto == SFLOW_HEADER_IPV6))
+      lh = getlinkhdr(DLT_RAW);
+   else
+      return;
+
+   memset(&pheader, 0, sizeof(pheader));
+   pheader.caplen = hlen;
+   pheader.len = get32(p + 4); /* frame length */
+   memset(&sm, 0, sizeof(sm));
+   sm.pkts = 1;
+   if (decode_packet(lh, &pheader, p + 16, &sm))
+      account(&sm, sampling);
+}
+
+/* Returns 0 if malformed. */
+static int
+sflow_sample(const unsigned char *p, const size_t len, const int expanded)
+{
+   size_t pos = expanded ? 12 : 8; /* sequence number, source ID */
+   uint32_t sampling, nrecs, i;
+
+   if (len < pos + 4 * (expanded ? 8 : 6))
+      return 0;
+   sampling = get32(p + pos);
+   pos += expanded ? 28 : 20; /* pool, drops, input, output */
+   nrecs = get32(p + pos);
+   pos += 4;
+   for (i = 0; i < nrecs; i++) {
+      uint32_t fmt, rlen;
+
+      if (pos + 8 > len)
+         return 0;
+      fmt = get32(p + pos);
+      rlen = get32(p + pos + 4);
+      pos += 8;
+      if (rlen > len - pos)
+         return 0;
+      if (fmt == SFLOW_RAW_HEADER)
+         sflow_raw_header(p + pos, rlen, sampling);
+      pos += rlen;
+   }
+   return 1;
+}
+
+static void collect_sflow(const unsigned char *data, const size_t len) {
+   size_t pos;
+   uint32_t nsamples, i;
+
+   if (len < 8)
+      goto malformed;
+   if (get32(data + 4) == 1)
+      pos = 8 + 4;
+   else if (get32(data + 4) == 2)
+      pos = 8 + 16;
+   else
+      goto malformed;
+   pos += 12; /* sub-agent ID, sequence number, uptime */
+   if (pos + 4 > len)
+      goto malformed;
+   nsamples = get32(data + pos);
+   pos += 4;
+   for (i = 0; i < nsamples; i++) {
+      uint32_t fmt, slen;
+
+      if (pos + 8 > len)
+         goto malformed;
+      fmt = get32(data + pos);
+      slen = get32(data + pos + 4);
+      pos += 8;
+      if (slen > len - pos)
+         goto malformed;
+      /* Enterprise zero only; counter samples are ignored. */
+      if ((fmt == SFLOW_FLOW_SAMPLE) || (fmt == SFLOW_FLOW_SAMPLE_EXPANDED))
+         if (!sflow_sample(data + pos, slen,
+                           fmt == SFLOW_FLOW_SAMPLE_EXPANDED))
+            goto malformed;
+      pos += slen;
+   }
+   return;
+malformed:
+   collect_stat_malformed++;
+}
+
+void
+collect_datagram(const struct addr * const exporter,
+   const unsigned char *data, const size_t len)
+{
+   collect_stat_datagrams++;
+   if (len < 4) {
+      collect_stat_malformed++;
+      return;
+   }
+   /* sFlow's version is 32 bits, the others are 16. */
+   if (get32(data) == 5)
+      collect_sflow(data, len);
+   else if (get16(data) == 5)
+      collect_v5(data, len);
+   else if ((get16(data) == 9) || (get16(data) == 10))
+      collect_v9_ipfix(exporter, data, len);
+   else
+      collect_stat_malformed++;
+}
+
+/* ---------------------------------------------------------------------------
+ * Socket.
+ */
+void collect_init(const char *spec) {
+   struct addrinfo hints, *ai, *res;
+   char *host, *port;
+   int ret, rcvbuf;
+
+   host = xstrdup(spec);
+   port = strrchr(host, ':');
+   if (port == NULL) {
+      port = host;
+      host = NULL;
+   } else {
+      *port++ = '\0';
+      if ((host[0] == '[') && (port - host >= 3) && (port[-2] == ']')) {
+         port[-2] = '\0';
+         memmove(host, host + 1, strlen(host + 1) + 1);
+      }
+   }
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_DGRAM;
+   hints.ai_flags = AI_PASSIVE;
+   if ((ret = getaddrinfo(host, port, &hints, &res)) != 0)
+      errx(1, "collect: can't resolve \"%s\": %s", spec, gai_strerror(ret));
+   for (ai = res; ai != NULL; ai = ai->ai_next) {
+      collect_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (collect_fd == -1)
+         continue;
+      if (bind(collect_fd, ai->ai_addr, ai->ai_addrlen) == 0)
+         break;
+      close(collect_fd);
+      collect_fd = -1;
+   }
+   freeaddrinfo(res);
+   if (collect_fd == -1)
+      err(1, "collect: can't bind to \"%s\"", spec);
+   free((host != NULL) ? host : port);
+   fd_set_nonblock(collect_fd);
+
+   /* Routers send in bursts.  Best effort: the kernel may cap this. */
+   rcvbuf = COLLECT_RCVBUF;
+   if (setsockopt(collect_fd, SOL_SOCKET, SO_RCVBUF,
+         &rcvbuf, sizeof(rcvbuf)) == -1)
+      warn("collect: can't set SO_RCVBUF");
+
+   collect_buf = xmalloc(COLLECT_BUFSIZE);
+   localip_init(&collect_local_ips);
+   verbosef("collect: listening for flows on \"%s\"", spec);
+
+   if (title_interfaces == NULL) {
+      /* No capture interfaces.  cap_stop() frees this. */
+      struct str *s = str_make();
+      size_t _;
+
+      str_appendf(s, "flows from %s", spec);
+      str_appendn(s, "", 1); /* NUL terminate */
+      str_extract(s, &_, &title_interfaces);
+   }
+}
+
+void collect_fd_set(fd_set *read_set, int *max_fd) {
+   if (collect_fd == -1)
+      return;
+   FD_SET(collect_fd, read_set);
+   *max_fd = MAX(*max_fd, collect_fd);
+}
+
+static void sockaddr_to_addr(const struct sockaddr_storage *ss,
+   struct addr *a)
+{
+   memset(a, 0, sizeof(*a));
+   if (ss->ss_family == AF_INET) {
+      a->family = IPv4;
+      a->ip.v4 = ((const struct sockaddr_in *)ss)->sin_addr.s_addr;
+   } else if (ss->ss_family == AF_INET6) {
+      const struct in6_addr *in6 =
+         &(((const struct sockaddr_in6 *)ss)->sin6_addr);
+
+      if (IN6_IS_ADDR_V4MAPPED(in6)) {
+         a->family = IPv4;
+         memcpy(&(a->ip.v4), in6->s6_addr + 12, 4);
+      } else {
+         a->family = IPv6;
+         a->ip.v6 = *in6;
+      }
+   }
+}
+
+void collect_poll(fd_set *read_set) {
+   struct sockaddr_storage from;
+   socklen_t fromlen;
+   struct addr exporter;
+   ssize_t len;
+   int i;
+
+   if ((collect_fd == -1) || !FD_ISSET(collect_fd, read_set))
+      return;
+   for (i = 0; i < COLLECT_BURST; i++) {
+      fromlen = sizeof(from);
+      len = recvfrom(collect_fd, collect_buf, COLLECT_BUFSIZE, 0,
+         (struct sockaddr *)&from, &fromlen);
+      if (len == -1) {
+         if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            warn("collect: recvfrom() failed");
+         return;
+      }
+      sockaddr_to_addr(&from, &exporter);
+      collect_datagram(&exporter, collect_buf, (size_t)len);
+   }
+}
+
+void collect_stop(void) {
+   struct exporter *e;
+   struct template *t;
+
+   if (collect_fd != -1) {
+      close(collect_fd);
+      collect_fd = -1;
+      free(collect_buf);
+      collect_buf = NULL;
+      localip_free(&collect_local_ips);
+   }
+
+   while ((e = RB_MIN(exporter_tree, &exporters)) != NULL) {
+      RB_REMOVE(exporter_tree, &exporters, e);
+      while ((t = LIST_FIRST(&(e->templates))) != NULL) {
+         LIST_REMOVE(t, entries);
+         free(t);
+      }
+      free(e);
+   }
+   num_exporters = 0;
+   verbosef("collect: %llu datagrams, %llu records, %llu malformed, "
+      "%llu without a template", (llu)collect_stat_datagrams,
+      (llu)collect_stat_records, (llu)collect_stat_malformed,
+      (llu)collect_stat_no_template);
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
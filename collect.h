@@ -0,0 +1,29 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * collect.h: receive NetFlow, IPFIX and sFlow from routers.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_COLLECT_H
+#define __DARKSTAT_COLLECT_H
+
+#include <sys/types.h> /* OpenBSD needs this before select */
+#include <sys/time.h> /* FreeBSD 4 needs this for struct timeval */
+#include <sys/select.h>
+
+struct addr;
+
+/* spec is "port", "addr:port" or "[v6addr]:port".  Call before chroot. */
+void collect_init(const char *spec);
+void collect_fd_set(fd_set *read_set, int *max_fd);
+void collect_poll(fd_set *read_set);
+void collect_stop(void);
+
+/* Decode one datagram and account for the flows or samples in it. */
+void collect_datagram(const struct addr * const exporter,
+   const unsigned char *data, const size_t len);
+
+#endif /* __DARKSTAT_COLLECT_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
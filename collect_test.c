@@ -0,0 +1,281 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * collect_test.c: tests for collect.c
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "acct.h"
+#include "collect.h"
+#include "decode.h"
+#include "localip.h"
+#include "str.h"
+#include "test_util.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* collect.o and decode.o need these, and they'd drag in the rest of
+ * darkstat. */
+int opt_want_pppoe = 0;
+int opt_want_decap = 0;
+int opt_len_from = 0;
+char *title_interfaces = NULL;
+
+void fd_set_nonblock(const int fd) { (void)fd; }
+void localip_init(struct local_ips *ips) { memset(ips, 0, sizeof(*ips)); }
+void localip_free(struct local_ips *ips) { (void)ips; }
+struct str *str_make(void) { return NULL; }
+void str_appendf(struct str *s, const char *format, ...) {
+  (void)s; (void)format;
+}
+void str_appendn(struct str *buf, const char *s, const size_t len) {
+  (void)buf; (void)s; (void)len;
+}
+void str_extract(struct str *buf, size_t *len, char **str) {
+  (void)buf; (void)len; (void)str;
+}
+
+/* Summaries passed to acct_for(), in order. */
+#define MAX_SEEN 16
+static struct pktsummary seen[MAX_SEEN];
+static int num_seen = 0;
+
+void acct_for(const struct pktsummary * const sm,
+              const struct local_ips * const local_ips) {
+  (void)local_ips;
+  if (num_seen < MAX_SEEN) seen[num_seen] = *sm;
+  num_seen++;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Datagram builder. */
+static unsigned char pkt[2048];
+static size_t pkt_len;
+
+static void put8(unsigned v) { pkt[pkt_len++] = (unsigned char)v; }
+static void put16(unsigned v) { put8(v >> 8); put8(v & 0xff); }
+static void put32(uint32_t v) { put16(v >> 16); put16(v & 0xffff); }
+static void put_ip(const char *s) {
+  inet_pton(AF_INET, s, pkt + pkt_len);
+  pkt_len += 4;
+}
+static void poke16(size_t at, unsigned v) {
+  pkt[at] = (unsigned char)(v >> 8);
+  pkt[at + 1] = (unsigned char)v;
+}
+
+static struct addr exporter;
+
+static void send_pkt(void) {
+  num_seen = 0;
+  collect_datagram(&exporter, pkt, pkt_len);
+}
+
+static int is_ip(const struct addr *a, const char *s) {
+  return strcmp(addr_to_str(a), s) == 0;
+}
+
+static void test_v5(void) {
+  pkt_len = 0;
+  put16(5); put16(2);                        /* version, count */
+  put32(0); put32(0); put32(0); put32(0);    /* uptime, secs, nsecs, seq */
+  put8(0); put8(0); put16(0x4000 | 10);      /* engine, 1 in 10 */
+  /* record 1: TCP */
+  put_ip("10.0.0.1"); put_ip("10.0.0.2"); put_ip("0.0.0.0");
+  put16(0); put16(0); put32(3); put32(1500); put32(0); put32(0);
+  put16(1234); put16(80); put8(0); put8(0x12); put8(6); put8(0);
+  put16(0); put16(0); put8(0); put8(0); put16(0);
+  /* record 2: ICMP, whose "ports" are type and code */
+  put_ip("10.0.0.3"); put_ip("10.0.0.4"); put_ip("0.0.0.0");
+  put16(0); put16(0); put32(1); put32(84); put32(0); put32(0);
+  put16(0); put16(0x0800); put8(0); put8(0); put8(1); put8(0);
+  put16(0); put16(0); put8(0); put8(0); put16(0);
+  send_pkt();
+
+  check(num_seen == 2, "v5: two records");
+  check(is_ip(&seen[0].src, "10.0.0.1") && is_ip(&seen[0].dst, "10.0.0.2"),
+      "v5: addresses");
+  check((seen[0].len == 15000) && (seen[0].pkts == 30),
+      "v5: scaled by sampling interval");
+  check((seen[0].proto == 6) && (seen[0].src_port == 1234) &&
+      (seen[0].dst_port == 80) && (seen[0].tcp_flags == 0x12),
+      "v5: proto, ports, flags");
+  check((seen[1].proto == 1) && (seen[1].dst_port == 0), "v5: ICMP");
+
+  pkt_len = 24 + 47; /* truncated */
+  poke16(2, 1);
+  send_pkt();
+  check(num_seen == 0, "v5: truncated record is dropped");
+}
+
+/* One IPv4 template: src, dst, proto, sport, dport, octets (reduced to 4
+ * bytes), packets. */
+static void put_template_v4(int ipfix) {
+  put16(ipfix ? 2 : 0); put16(4 + 4 + 7 * 4);
+  put16(300); put16(7);
+  put16(8); put16(4); put16(12); put16(4); put16(4); put16(1);
+  put16(7); put16(2); put16(11); put16(2); put16(1); put16(4);
+  put16(2); put16(8);
+}
+
+static void put_data_v4(void) {
+  put16(300); put16(4 + 2 * 25 + 2); /* two records plus padding */
+  put_ip("192.168.1.1"); put_ip("192.168.1.2"); put8(17);
+  put16(53); put16(5353); put32(1000); put32(0); put32(5);
+  put_ip("192.168.1.3"); put_ip("192.168.1.4"); put8(6);
+  put16(22); put16(50000); put32(2000); put32(0); put32(7);
+  put16(0);
+}
+
+static void test_v9(void) {
+  /* Data before the template is dropped. */
+  pkt_len = 0;
+  put16(9); put16(2); put32(0); put32(0); put32(1); put32(42);
+  put_data_v4();
+  send_pkt();
+  check(num_seen == 0, "v9: no template, no data");
+
+  /* Template, options template with sampling, options data, data. */
+  pkt_len = 0;
+  put16(9); put16(5); put32(0); put32(0); put32(2); put32(42);
+  put_template_v4(0);
+  put16(1); put16(4 + 6 + 12 + 2);          /* options template flowset */
+  put16(301); put16(4); put16(8);
+  put16(1); put16(4);                       /* scope: system */
+  put16(34); put16(4); put16(35); put16(1); /* sampling interval, algo */
+  put16(0);                                 /* padding */
+  put16(301); put16(4 + 9 + 3);
+  put32(0); put32(100); put8(1); put8(0); put16(0);
+  put_data_v4();
+  send_pkt();
+
+  check(num_seen == 2, "v9: template then two records");
+  check(is_ip(&seen[0].src, "192.168.1.1") &&
+      is_ip(&seen[0].dst, "192.168.1.2") && (seen[0].proto == 17) &&
+      (seen[0].src_port == 53) && (seen[0].dst_port == 5353),
+      "v9: first record fields");
+  check((seen[0].len == 100000) && (seen[0].pkts == 500),
+      "v9: reduced-size counter, scaled by options sampling");
+  check((seen[1].len == 200000) && (seen[1].pkts == 700),
+      "v9: second record");
+
+  /* The template is remembered for the next datagram. */
+  pkt_len = 0;
+  put16(9); put16(2); put32(0); put32(0); put32(3); put32(42);
+  put_data_v4();
+  send_pkt();
+  check(num_seen == 2, "v9: template is kept");
+
+  /* Another source ID on the same router has its own templates. */
+  pkt_len = 0;
+  put16(9); put16(2); put32(0); put32(0); put32(1); put32(43);
+  put_data_v4();
+  send_pkt();
+  check(num_seen == 0, "v9: templates are per source ID");
+}
+
+static void test_ipfix(void) {
+  size_t at;
+
+  pkt_len = 0;
+  put16(10); put16(0); put32(0); put32(0); put32(7);
+  put_template_v4(1);
+  /* IPv6 template with an enterprise field and a variable-length field */
+  put16(2); put16(4 + 4 + 4 * 4 + 4 + 4);
+  put16(310); put16(5);
+  put16(27); put16(16); put16(28); put16(16); put16(2); put16(4);
+  put16(0x8000 | 1); put16(2); put32(9999);  /* enterprise field */
+  put16(1); put16(65535);                    /* octets, variable length */
+  put_data_v4();
+  put16(310); put16(4 + 16 + 16 + 4 + 2 + 1 + 2 + 3);
+  inet_pton(AF_INET6, "2001:db8::1", pkt + pkt_len); pkt_len += 16;
+  inet_pton(AF_INET6, "2001:db8::2", pkt + pkt_len); pkt_len += 16;
+  put32(3); put16(0xbeef); put8(2); put16(9000);
+  put8(0); put16(0);                         /* padding */
+  poke16(2, (unsigned)pkt_len);
+  send_pkt();
+
+  check(num_seen == 3, "IPFIX: three records");
+  check((seen[0].len == 1000) && (seen[0].pkts == 5),
+      "IPFIX: unsampled, not scaled");
+  check(is_ip(&seen[2].src, "2001:db8::1") &&
+      is_ip(&seen[2].dst, "2001:db8::2") && (seen[2].pkts == 3) &&
+      (seen[2].len == 9000) && (seen[2].proto == IPPROTO_INVALID),
+      "IPFIX: IPv6 with enterprise and variable-length fields");
+
+  /* A set running past the end of the message is rejected. */
+  at = 16;
+  poke16(at + 2, 2000);
+  send_pkt();
+  check(num_seen == 0, "IPFIX: bad set length");
+}
+
+static void test_sflow(void) {
+  static const unsigned char frame[] = {
+    /* Ethernet */
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0x08, 0x00,
+    /* IPv4, total length 1000, UDP */
+    0x45, 0, 0x03, 0xe8, 0, 0, 0, 0, 64, 17, 0, 0,
+    172, 16, 0, 1, 172, 16, 0, 2,
+    /* UDP */
+    0x30, 0x39, 0x00, 0x35, 0x03, 0xd4, 0, 0
+  };
+  size_t sample_at;
+
+  pkt_len = 0;
+  put32(5); put32(1); put_ip("10.9.9.9");   /* version, agent */
+  put32(0); put32(1); put32(0); put32(2);   /* sub-agent, seq, uptime, n */
+  /* counter sample, ignored */
+  put32(2); put32(4); put32(0);
+  /* flow sample */
+  put32(1); sample_at = pkt_len; put32(0);
+  put32(1); put32(7); put32(256);           /* seq, source, rate */
+  put32(0); put32(0); put32(1); put32(2);   /* pool, drops, in, out */
+  put32(1);                                 /* one record */
+  put32(1); put32(16 + sizeof(frame) + 2);  /* raw header */
+  put32(1); put32(1014); put32(4); put32(sizeof(frame));
+  memcpy(pkt + pkt_len, frame, sizeof(frame));
+  pkt_len += sizeof(frame);
+  put16(0);                                 /* pad to 4 bytes */
+  pkt[sample_at + 3] = (unsigned char)(pkt_len - sample_at - 4);
+  send_pkt();
+
+  check(num_seen == 1, "sFlow: one sample");
+  check(is_ip(&seen[0].src, "172.16.0.1") &&
+      is_ip(&seen[0].dst, "172.16.0.2") && (seen[0].proto == 17) &&
+      (seen[0].src_port == 12345) && (seen[0].dst_port == 53),
+      "sFlow: decoded header");
+  check((seen[0].len == 1000 * 256) && (seen[0].pkts == 256),
+      "sFlow: scaled by sampling rate");
+
+  pkt_len -= 10; /* truncated */
+  send_pkt();
+  check(num_seen == 0, "sFlow: truncated sample is dropped");
+}
+
+int main(void) {
+  exporter.family = IPv4;
+  exporter.ip.v4 = htonl(0x7f000001);
+  test_v5();
+  test_v9();
+  test_ipfix();
+  test_sflow();
+  collect_stop();
+  return test_retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
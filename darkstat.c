@@ -10,18 +10,25 @@
 #include "acct.h"
 #include "cap.h"
 #include "cdefs.h"
+#include "collect.h"
 #include "config.h"
 #include "conv.h"
 #include "daylog.h"
 #include "db.h"
+#include "decode.h"
 #include "dns.h"
 #include "err.h"
+#include "flow.h"
+#include "graph_db.h"
 #include "hosts_db.h"
 #include "http.h"
+#include "ipfix.h"
 #include "localip.h"
 #include "ncache.h"
 #include "now.h"
 #include "pidfile.h"
+#include "sketch.h"
+#include "stats.h"
 #include "str.h"
 
 #include <assert.h>
@@ -51,6 +58,9 @@ static void sig_reset(int signum _unused_) {
 
 static void sig_export(int signum _unused_) { export_pending = 1; }
 
+static volatile int reopen_pending = 0;
+static void sig_reopen(int signum _unused_) { reopen_pending = 1; }
+
 /* --- Commandline parsing --- */
 static unsigned long parsenum(const char *str,
                               unsigned long max /* 0 for no max */) {
@@ -76,6 +86,9 @@ static void cb_interface(const char *arg) {
 
 static void cb_filter(const char *arg) { cap_add_filter(arg); }
 
+static const char *opt_collect = NULL;
+static void cb_collect(const char *arg) { opt_collect = arg; }
+
 static const char *opt_capfile = NULL;
 static void cb_capfile(const char *arg) { opt_capfile = arg; }
 
@@ -136,12 +149,37 @@ static void cb_user(const char *arg) { opt_privdrop_user = arg; }
 static const char *opt_daylog_fn = NULL;
 static void cb_daylog(const char *arg) { opt_daylog_fn = arg; }
 
+static const char *opt_hourlog_fn = NULL;
+static void cb_hourlog(const char *arg) { opt_hourlog_fn = arg; }
+
+static const char *opt_minutelog_fn = NULL;
+static void cb_minutelog(const char *arg) { opt_minutelog_fn = arg; }
+
 static const char *import_fn = NULL;
 static void cb_import(const char *arg) { import_fn = arg; }
 
 static const char *export_fn = NULL;
 static void cb_export(const char *arg) { export_fn = arg; }
 
+static const char *journal_file = NULL;
+static void cb_journal(const char *arg) { journal_file = arg; }
+
+static unsigned int journal_secs = 10;
+static void cb_journal_interval(const char *arg)
+{
+   journal_secs = parsenum(arg, 0);
+   if (journal_secs == 0)
+      errx(1, "--journal-interval must be at least 1");
+}
+
+static unsigned int compact_secs = 3600;
+static void cb_journal_compact(const char *arg)
+{
+   compact_secs = parsenum(arg, 0);
+   if (compact_secs == 0)
+      errx(1, "--journal-compact must be at least 1");
+}
+
 static const char *pid_fn = NULL;
 static void cb_pidfile(const char *arg) { pid_fn = arg; }
 
@@ -161,6 +199,87 @@ unsigned int opt_ports_keep = 30;
 static void cb_ports_keep(const char *arg)
 { opt_ports_keep = parsenum(arg, 65536); }
 
+unsigned int opt_pairs_max = 0;
+static void cb_pairs_max(const char *arg)
+{ opt_pairs_max = parsenum(arg, 0); }
+
+unsigned int opt_pairs_keep = 0;
+static void cb_pairs_keep(const char *arg)
+{ opt_pairs_keep = parsenum(arg, 0); }
+
+unsigned int opt_sketch_width = 0;
+static void cb_sketch_width(const char *arg)
+{ opt_sketch_width = parsenum(arg, 1 << 24); }
+
+unsigned int opt_host_graphs = 0;
+static void cb_host_graphs(const char *arg)
+{ opt_host_graphs = parsenum(arg, 0); }
+
+static void cb_graph_tiers(const char *arg) { graph_tiers(arg); }
+
+const char *opt_graph_store = NULL;
+static void cb_graph_store(const char *arg) { opt_graph_store = arg; }
+
+int opt_want_vlans = 0;
+static void cb_vlans(const char *arg _unused_)
+{ opt_want_vlans = 1; }
+
+/* Parses "v4len[,v6len]" for --local-prefix and --remote-prefix. */
+static void parse_prefix(const char *arg, unsigned int *len4,
+                         unsigned int *len6)
+{
+   const char *comma = strchr(arg, ',');
+
+   if (comma == NULL) {
+      *len4 = (unsigned int)parsenum(arg, 32);
+   } else {
+      char *v4 = xstrdup(arg);
+
+      v4[comma - arg] = '\0';
+      *len4 = (unsigned int)parsenum(v4, 32);
+      *len6 = (unsigned int)parsenum(comma + 1, 128);
+      free(v4);
+   }
+}
+
+unsigned int opt_local_prefix4 = 32, opt_local_prefix6 = 128;
+static void cb_local_prefix(const char *arg)
+{ parse_prefix(arg, &opt_local_prefix4, &opt_local_prefix6); }
+
+unsigned int opt_remote_prefix4 = 32, opt_remote_prefix6 = 128;
+static void cb_remote_prefix(const char *arg)
+{ parse_prefix(arg, &opt_remote_prefix4, &opt_remote_prefix6); }
+
+unsigned int opt_flows_max = 0;
+static void cb_flows_max(const char *arg)
+{ opt_flows_max = parsenum(arg, 0); }
+
+unsigned int opt_flow_idle = 15;
+static void cb_flow_idle(const char *arg)
+{ opt_flow_idle = parsenum(arg, 0); }
+
+unsigned int opt_flow_active = 1800;
+static void cb_flow_active(const char *arg)
+{ opt_flow_active = parsenum(arg, 0); }
+
+static const char *opt_flow_log = NULL;
+static void cb_flow_log(const char *arg) { opt_flow_log = arg; }
+
+unsigned int opt_flow_sample = 1;
+static void cb_flow_sample(const char *arg)
+{ opt_flow_sample = parsenum(arg, 0); }
+
+static const char *opt_flow_export = NULL;
+static void cb_flow_export(const char *arg) { opt_flow_export = arg; }
+
+static int opt_flow_export_version = 10;
+static void cb_flow_export_version(const char *arg)
+{
+   opt_flow_export_version = (int)parsenum(arg, 10);
+   if ((opt_flow_export_version != 9) && (opt_flow_export_version != 10))
+      errx(1, "--flow-export-version must be 9 (NetFlow) or 10 (IPFIX)");
+}
+
 unsigned int opt_highest_port = 65535;
 static void cb_highest_port(const char *arg)
 { opt_highest_port = parsenum(arg, 65535); }
@@ -169,6 +288,31 @@ int opt_wait_secs = -1;
 static void cb_wait_secs(const char *arg)
 { opt_wait_secs = (int)parsenum(arg, 0); }
 
+int opt_want_decap = 0;
+static void cb_decap(const char *arg _unused_)
+{ opt_want_decap = 1; }
+
+int opt_len_from = LEN_FROM_IP;
+static void cb_len_from(const char *arg)
+{
+   if (strcmp(arg, "ip") == 0)
+      opt_len_from = LEN_FROM_IP;
+   else if (strcmp(arg, "caplen") == 0)
+      opt_len_from = LEN_FROM_CAPLEN;
+   else if (strcmp(arg, "wire") == 0)
+      opt_len_from = LEN_FROM_WIRE;
+   else
+      errx(1, "--len-from must be ip, caplen or wire");
+}
+
+unsigned int opt_sample = 1;
+static void cb_sample(const char *arg)
+{ opt_sample = parsenum(arg, 0); }
+
+int opt_want_sample_random = 0;
+static void cb_sample_random(const char *arg _unused_)
+{ opt_want_sample_random = 1; }
+
 int opt_want_hexdump = 0;
 static void cb_hexdump(const char *arg _unused_)
 { opt_want_hexdump = 1; }
@@ -191,6 +335,7 @@ static struct cmdline_arg cmdline_args[] = {
    {"-i",             "interface",       cb_interface,   -1},
    {"-f",             "filter",          cb_filter,      -1},
    {"-r",             "capfile",         cb_capfile,      0},
+   {"--collect",      "[addr:]port",     cb_collect,      0},
    {"-p",             "port",            cb_port,         0},
    {"-b",             "bindaddr",        cb_bindaddr,    -1},
    {"-l",             "network/netmask", cb_local,        0},
@@ -198,6 +343,10 @@ static struct cmdline_arg cmdline_args[] = {
    {"--local-only",   NULL,              cb_local_only,   0},
    {"--snaplen",      "bytes",           cb_snaplen,      0},
    {"--pppoe",        NULL,              cb_pppoe,        0},
+   {"--decap",        NULL,              cb_decap,        0},
+   {"--len-from",     "ip|caplen|wire",  cb_len_from,     0},
+   {"--sample",       "rate",            cb_sample,       0},
+   {"--sample-random", NULL,             cb_sample_random, 0},
    {"--syslog",       NULL,              cb_syslog,       0},
    {"--verbose",      NULL,              cb_verbose,      0},
    {"--no-daemon",    NULL,              cb_no_daemon,    0},
@@ -208,13 +357,34 @@ static struct cmdline_arg cmdline_args[] = {
    {"--chroot",       "dir",             cb_chroot,       0},
    {"--user",         "username",        cb_user,         0},
    {"--daylog",       "filename",        cb_daylog,       0},
+   {"--hourlog",      "filename",        cb_hourlog,      0},
+   {"--minutelog",    "filename",        cb_minutelog,    0},
    {"--import",       "filename",        cb_import,       0},
    {"--export",       "filename",        cb_export,       0},
+   {"--journal",      "filename",        cb_journal,      0},
+   {"--journal-interval", "secs",        cb_journal_interval, 0},
+   {"--journal-compact", "secs",         cb_journal_compact, 0},
    {"--pidfile",      "filename",        cb_pidfile,      0},
    {"--hosts-max",    "count",           cb_hosts_max,    0},
    {"--hosts-keep",   "count",           cb_hosts_keep,   0},
    {"--ports-max",    "count",           cb_ports_max,    0},
    {"--ports-keep",   "count",           cb_ports_keep,   0},
+   {"--pairs-max",    "count",           cb_pairs_max,    0},
+   {"--pairs-keep",   "count",           cb_pairs_keep,   0},
+   {"--sketch-width", "cells",           cb_sketch_width, 0},
+   {"--host-graphs",  "count",           cb_host_graphs,  0},
+   {"--graph-tiers",  "width:bars,...",  cb_graph_tiers,  0},
+   {"--graph-store",  "filename",        cb_graph_store,  0},
+   {"--vlans",        NULL,              cb_vlans,        0},
+   {"--local-prefix", "v4len[,v6len]",   cb_local_prefix, 0},
+   {"--remote-prefix", "v4len[,v6len]",  cb_remote_prefix, 0},
+   {"--flows-max",    "count",           cb_flows_max,    0},
+   {"--flow-idle",    "secs",            cb_flow_idle,    0},
+   {"--flow-active",  "secs",            cb_flow_active,  0},
+   {"--flow-log",     "pattern",         cb_flow_log,     0},
+   {"--flow-sample",  "rate",            cb_flow_sample,  0},
+   {"--flow-export",  "host:port",       cb_flow_export,  0},
+   {"--flow-export-version", "version",  cb_flow_export_version, 0},
    {"--highest-port", "port",            cb_highest_port, 0},
    {"--wait",         "secs",            cb_wait_secs,    0},
    {"--hexdump",      NULL,              cb_hexdump,      0},
@@ -311,8 +481,12 @@ static void parse_cmdline(const int argc, char * const *argv) {
       opt_privdrop_user = PRIVDROP_USER;
 
    /* sanity check args */
-   if (!opt_iface_seen && opt_capfile == NULL)
-      errx(1, "must specify either interface (-i) or capture file (-r)");
+   if (!opt_iface_seen && opt_capfile == NULL && opt_collect == NULL)
+      errx(1, "must specify an interface (-i), capture file (-r) "
+              "or --collect");
+
+   if (opt_collect != NULL && opt_capfile != NULL)
+      errx(1, "can't specify both --collect and capture file (-r)");
 
    if (opt_iface_seen && opt_capfile != NULL)
       errx(1, "can't specify both interface (-i) and capture file (-r)");
@@ -333,6 +507,45 @@ static void parse_cmdline(const int argc, char * const *argv) {
    verbosef("max %u ports per host, cutting down to %u when exceeded",
       opt_ports_max, opt_ports_keep);
 
+   if (opt_pairs_max != 0) {
+      if (opt_pairs_keep >= opt_pairs_max) {
+         opt_pairs_keep = opt_pairs_max / 2;
+         warnx("reducing --pairs-keep to %u, to be under --pairs-max (%u)",
+            opt_pairs_keep, opt_pairs_max);
+      } else if (opt_pairs_keep == 0)
+         opt_pairs_keep = opt_pairs_max / 2;
+      verbosef("max %u host pairs, cutting down to %u when exceeded",
+         opt_pairs_max, opt_pairs_keep);
+   }
+
+   if (opt_sketch_width != 0)
+      verbosef("sketch of %u cells per row, using %llu bytes",
+         opt_sketch_width, (llu)SKETCH_DEPTH * opt_sketch_width *
+         sizeof(struct sketch_count));
+
+   if (opt_host_graphs != 0)
+      verbosef("graphs for up to %u hosts", opt_host_graphs);
+
+   if ((opt_flow_log != NULL) && (opt_flows_max == 0))
+      errx(1, "--flow-log needs --flows-max");
+   if ((opt_flow_export != NULL) && (opt_flows_max == 0))
+      errx(1, "--flow-export needs --flows-max");
+
+   if (opt_sample == 0)
+      opt_sample = 1;
+   if (opt_sample > 1)
+      verbosef("sampling %s1 in %u packets, counters are scaled up",
+         opt_want_sample_random ? "randomly " : "", opt_sample);
+   else if (opt_want_sample_random)
+      verbosef("--sample-random without --sample does nothing");
+
+   if ((opt_local_prefix4 != 32) || (opt_local_prefix6 != 128))
+      verbosef("folding local hosts into /%u and /%u prefixes",
+         opt_local_prefix4, opt_local_prefix6);
+   if ((opt_remote_prefix4 != 32) || (opt_remote_prefix6 != 128))
+      verbosef("folding remote hosts into /%u and /%u prefixes",
+         opt_remote_prefix4, opt_remote_prefix6);
+
    if (opt_want_hexdump && !opt_want_verbose) {
       opt_want_verbose = 1;
       verbosef("--hexdump implies --verbose");
@@ -351,8 +564,15 @@ static void run_from_capfile(void) {
    now_init();
    graph_init();
    hosts_db_init();
+   sketch_init(opt_sketch_width);
+   if (opt_flow_export != NULL)
+      ipfix_init(opt_flow_export, opt_flow_export_version, opt_flow_sample);
+   if (opt_flows_max != 0) flow_init(opt_flow_log);
    cap_from_file(opt_capfile);
    if (export_fn != NULL) db_export(export_fn);
+   flow_free();
+   ipfix_free();
+   sketch_free();
    hosts_db_free();
    graph_free();
    verbosef("Total packets: %llu, bytes: %llu",
@@ -385,19 +605,28 @@ main(int argc, char **argv)
 
    /* do this first as it forks - minimize memory use */
    if (opt_want_dns) dns_init(opt_privdrop_user);
-   cap_start(opt_want_promisc); /* needs root */
+   if (opt_iface_seen)
+      cap_start(opt_want_promisc); /* needs root */
+   if (opt_collect != NULL)
+      collect_init(opt_collect); /* might need root for the port */
    http_init_base(opt_base);
    http_listen(opt_bindport);
    ncache_init(); /* must do before chroot() */
+   if (opt_flow_export != NULL)
+      ipfix_init(opt_flow_export, opt_flow_export_version, opt_flow_sample);
 
    privdrop(opt_chroot_dir, opt_privdrop_user);
 
    /* Don't need root privs for these: */
    now_init();
-   if (opt_daylog_fn != NULL) daylog_init(opt_daylog_fn);
+   daylog_init(opt_daylog_fn, opt_hourlog_fn, opt_minutelog_fn);
    graph_init();
    hosts_db_init();
+   sketch_init(opt_sketch_width);
    if (import_fn != NULL) db_import(import_fn);
+   if (journal_file != NULL)
+      db_journal_init(journal_file, journal_secs, compact_secs);
+   if (opt_flows_max != 0) flow_init(opt_flow_log);
 
    if (signal(SIGTERM, sig_shutdown) == SIG_ERR)
       errx(1, "signal(SIGTERM) failed");
@@ -407,6 +636,8 @@ main(int argc, char **argv)
       errx(1, "signal(SIGUSR1) failed");
    if (signal(SIGUSR2, sig_export) == SIG_ERR)
       errx(1, "signal(SIGUSR2) failed");
+   if (signal(SIGHUP, sig_reopen) == SIG_ERR)
+      errx(1, "signal(SIGHUP) failed");
 
    verbosef("entering main loop");
    daemonize_finish();
@@ -417,12 +648,13 @@ main(int argc, char **argv)
       int use_timeout = 0;
       int cap_ret;
       struct timeval timeout;
-      struct timespec t;
+      struct timespec t, t_rotate;
       fd_set rs, ws;
 
       FD_ZERO(&rs);
       FD_ZERO(&ws);
       cap_fd_set(&rs, &max_fd, &timeout, &use_timeout);
+      collect_fd_set(&rs, &max_fd);
       http_fd_set(&rs, &ws, &max_fd, &timeout, &use_timeout);
 
       select_ret = select(max_fd+1, &rs, &ws, NULL,
@@ -449,15 +681,29 @@ main(int argc, char **argv)
          if (export_pending)
             continue; /* export before reset */
          hosts_db_reset();
+         sketch_reset();
          graph_reset();
+         db_journal_compact();
          reset_pending = 0;
       }
 
+      if (reopen_pending) {
+         daylog_reopen();
+         reopen_pending = 0;
+      }
+
+      timer_start(&t_rotate);
       graph_rotate();
+      daylog_rotate();
+      stats_time(STATS_ROTATE, &t_rotate);
+      db_journal_poll();
+      flow_expire();
       cap_ret = cap_poll(&rs);
+      collect_poll(&rs);
       dns_poll();
       http_poll(&rs, &ws);
-      timer_stop(&t, 1000000000, "event processing took longer than a second");
+      stats_record(STATS_LOOP, timer_stop(&t, 1000000000,
+         "event processing took longer than a second"));
 
       if (!cap_ret) {
          running = 0;
@@ -469,11 +715,16 @@ main(int argc, char **argv)
       cap_pkts_recv, cap_pkts_drop);
    http_stop();
    cap_stop();
+   collect_stop();
    dns_stop();
    if (export_fn != NULL) db_export(export_fn);
+   db_journal_free();
+   flow_free();
+   ipfix_free();
+   sketch_free();
    hosts_db_free();
    graph_free();
-   if (opt_daylog_fn != NULL) daylog_free();
+   daylog_free();
    ncache_free();
    if (pid_fn) pidfile_unlink();
    verbosef("shut down");
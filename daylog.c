@@ -1,7 +1,7 @@
 /* darkstat 3
  * copyright (c) 2007-2014 Emil Mikulic.
  *
- * daylog.c: daily usage log
+ * daylog.c: daily usage log, and hourly and per-minute logs
  *
  * You may use, modify and redistribute this file under the terms of the
  * GNU General Public License version 2. (see COPYING.GPL)
@@ -23,9 +23,19 @@
 #include <time.h>
 #include <unistd.h>
 
-static const char *daylog_fn = NULL;
-static time_t today_real, tomorrow_real;
-static uint64_t bytes_in, bytes_out, pkts_in, pkts_out;
+/* The daylog, and the optional hourly and per-minute logs.  Each keeps its
+ * file open, until SIGHUP tells us it's been rotated.
+ */
+enum { LOG_DAY, LOG_HOUR, LOG_MINUTE, NUM_LOGS };
+struct daylog {
+   const char *fn; /* NULL if disabled */
+   int fd;
+   time_t start_real, next_real;
+   uint64_t bytes_in, bytes_out, pkts_in, pkts_out;
+};
+static struct daylog logs[NUM_LOGS];
+static int enabled = 0;
+static time_t last_tick;
 
 #define DAYLOG_DATE_LEN 26 /* strlen("1900-01-01 00:00:00 +1234") + 1 */
 static char datebuf[DAYLOG_DATE_LEN];
@@ -39,106 +49,185 @@ static char *fmt_date(time_t when) {
     return datebuf;
 }
 
-/* Given some time today, find the first second of tomorrow. */
-static time_t tomorrow(time_t t_before) {
+/* Given some time in this period, find the first second of the next. */
+static time_t next_period(const int which, time_t t_before) {
    time_t t_after;
    struct tm tm, *lt;
 
+   if (which == LOG_MINUTE)
+      return t_before - (t_before % 60) + 60;
    lt = localtime(&t_before);
    memcpy(&tm, lt, sizeof(tm));
    tm.tm_sec = 0;
    tm.tm_min = 0;
-   tm.tm_hour = 0;
-   tm.tm_mday = lt->tm_mday + 1; /* tomorrow */
+   if (which == LOG_HOUR)
+      tm.tm_hour = lt->tm_hour + 1; /* next hour */
+   else {
+      tm.tm_hour = 0;
+      tm.tm_mday = lt->tm_mday + 1; /* tomorrow */
+   }
    t_after = mktime(&tm);
    assert(t_after > t_before);
    return t_after;
 }
 
+static void daylog_open(struct daylog *l) {
+   l->fd = open(l->fn, O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW, 0600);
+   if (l->fd == -1)
+      warn("daylog: couldn't open '%s' for append", l->fn);
+}
+
 /* Warns on error. */
-static void daylog_write(const char *format, ...) _printflike_(1, 2);
-static void daylog_write(const char *format, ...) {
-   int fd;
+static void daylog_write(struct daylog *l, const char *format, ...)
+   _printflike_(2, 3);
+static void daylog_write(struct daylog *l, const char *format, ...) {
    ssize_t wr;
    va_list va;
    struct str *buf;
 
-   assert(daylog_fn != NULL);
-   fd = open(daylog_fn, O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW, 0600);
-   if (fd == -1) {
-      warn("daylog_write: couldn't open '%s' for append", daylog_fn);
-      return;
-   }
+   if (l->fd == -1)
+      return; /* already warned */
 
    buf = str_make();
    va_start(va, format);
    str_vappendf(buf, format, va);
    va_end(va);
 
-   wr = str_write(buf, fd);
+   wr = str_write(buf, l->fd);
    if (wr == -1)
-      warn("daylog_write: couldn't write to '%s'", daylog_fn);
+      warn("daylog_write: couldn't write to '%s'", l->fn);
    else if (wr != (ssize_t)str_len(buf))
       warnx("daylog_write: truncated write to '%s': wrote %d of %d bytes",
-           daylog_fn,
+           l->fn,
            (int)wr,
            (int)str_len(buf));
-   close(fd);
    str_free(buf);
 }
 
-static void daylog_emit(void) {
-   daylog_write("%s|%qu|%qu|%qu|%qu|%qu\n",
-                fmt_date(today_real),
-                (qu)today_real,
-                (qu)bytes_in,
-                (qu)bytes_out,
-                (qu)pkts_in,
-                (qu)pkts_out);
+/* The daylog has its own format, the others are CSV. */
+static void daylog_emit(struct daylog *l) {
+   if (l == &logs[LOG_DAY])
+      daylog_write(l, "%s|%qu|%qu|%qu|%qu|%qu\n",
+                   fmt_date(l->start_real),
+                   (qu)l->start_real,
+                   (qu)l->bytes_in,
+                   (qu)l->bytes_out,
+                   (qu)l->pkts_in,
+                   (qu)l->pkts_out);
+   else
+      daylog_write(l, "%qu,%qu,%qu,%qu,%qu\n",
+                   (qu)l->start_real,
+                   (qu)l->bytes_in,
+                   (qu)l->bytes_out,
+                   (qu)l->pkts_in,
+                   (qu)l->pkts_out);
+}
+
+/* Comments, when logging starts and stops. */
+static void daylog_note(struct daylog *l, const char *what, const time_t t) {
+   daylog_write(l, "# logging %s at %s (%qu)\n", what, fmt_date(t), (qu)t);
+}
+
+static void daylog_start(const int which, const char *filename) {
+   struct daylog *l = &logs[which];
+
+   memset(l, 0, sizeof(*l));
+   l->fn = filename;
+   if (filename == NULL)
+      return;
+   enabled = 1;
+   l->start_real = now_real();
+   l->next_real = next_period(which, l->start_real);
+   verbosef("logging to '%s', next line at %llu",
+            filename, (llu)l->next_real);
+   daylog_open(l);
+   daylog_note(l, "started", l->start_real);
 }
 
-void daylog_init(const char *filename) {
-   daylog_fn = filename;
-   today_real = now_real();
-   tomorrow_real = tomorrow(today_real);
-   verbosef("today is %llu, tomorrow is %llu",
-            (llu)today_real,
-            (llu)tomorrow_real);
-   bytes_in = bytes_out = pkts_in = pkts_out = 0;
-
-   daylog_write("# logging started at %s (%qu)\n",
-                fmt_date(today_real), (qu)today_real);
+void daylog_init(const char *day_fn, const char *hour_fn,
+                 const char *minute_fn) {
+   daylog_start(LOG_DAY, day_fn);
+   daylog_start(LOG_HOUR, hour_fn);
+   daylog_start(LOG_MINUTE, minute_fn);
+   last_tick = now_real();
 }
 
 void daylog_free(void) {
-   today_real = now_real();
-   daylog_emit(); /* Emit what's currently accumulated before we exit. */
-   daylog_write("# logging stopped at %s (%qu)\n",
-                fmt_date(today_real), (qu)today_real);
+   const time_t t = now_real();
+   int i;
+
+   for (i=0; i<NUM_LOGS; i++) {
+      struct daylog *l = &logs[i];
+
+      if (l->fn == NULL)
+         continue;
+      daylog_emit(l); /* Emit what's currently accumulated before we exit. */
+      daylog_note(l, "stopped", t);
+      if (l->fd != -1)
+         close(l->fd);
+      l->fn = NULL;
+   }
+   enabled = 0;
 }
 
-void daylog_acct(uint64_t amount, enum graph_dir dir) {
-   if (daylog_fn == NULL)
-      return; /* daylogging disabled */
+void daylog_reopen(void) {
+   int i;
 
-   /* Check if we need to update the log. */
-   if (now_real() >= tomorrow_real) {
-      daylog_emit();
+   for (i=0; i<NUM_LOGS; i++) {
+      struct daylog *l = &logs[i];
 
-      today_real = now_real();
-      tomorrow_real = tomorrow(today_real);
-      bytes_in = bytes_out = pkts_in = pkts_out = 0;
-      verbosef("updated daylog, tomorrow = %llu", (llu)tomorrow_real);
+      if (l->fn == NULL)
+         continue;
+      if (l->fd != -1)
+         close(l->fd);
+      daylog_open(l);
    }
+   verbosef("reopened logs");
+}
+
+/* Called every time around the main loop, but only looks at the logs once
+ * a second.
+ */
+void daylog_rotate(void) {
+   const time_t t = now_real();
+   int i;
+
+   if (!enabled || t == last_tick)
+      return;
+   last_tick = t;
+   for (i=0; i<NUM_LOGS; i++) {
+      struct daylog *l = &logs[i];
+
+      if (l->fn == NULL || t < l->next_real)
+         continue;
+      daylog_emit(l);
+      l->start_real = l->next_real;
+      l->next_real = next_period(i, t);
+      l->bytes_in = l->bytes_out = l->pkts_in = l->pkts_out = 0;
+      verbosef("updated '%s', next line at %llu", l->fn, (llu)l->next_real);
+   }
+}
+
+void daylog_acct(uint64_t amount, uint64_t pkts, enum graph_dir dir) {
+   int i;
+
+   if (!enabled)
+      return; /* daylogging disabled */
 
    /* Accounting. */
-   if (dir == GRAPH_IN) {
-      bytes_in += amount;
-      pkts_in++;
-   } else {
-      assert(dir == GRAPH_OUT);
-      bytes_out += amount;
-      pkts_out++;
+   for (i=0; i<NUM_LOGS; i++) {
+      struct daylog *l = &logs[i];
+
+      if (l->fn == NULL)
+         continue;
+      if (dir == GRAPH_IN) {
+         l->bytes_in += amount;
+         l->pkts_in += pkts;
+      } else {
+         assert(dir == GRAPH_OUT);
+         l->bytes_out += amount;
+         l->pkts_out += pkts;
+      }
    }
 }
 
@@ -6,8 +6,12 @@
 
 #include "graph_db.h" /* for graph_dir */
 
-void daylog_init(const char *filename);
+/* Any of the filenames can be NULL, to not keep that log. */
+void daylog_init(const char *day_fn, const char *hour_fn,
+                 const char *minute_fn);
 void daylog_free(void);
-void daylog_acct(uint64_t amount, enum graph_dir dir);
+void daylog_reopen(void); /* after the files were rotated */
+void daylog_rotate(void); /* once a second */
+void daylog_acct(uint64_t amount, uint64_t pkts, enum graph_dir dir);
 
 /* vim:set ts=3 sw=3 tw=78 et: */
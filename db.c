@@ -13,6 +13,8 @@
 #include <netinet/in.h> /* for ntohs() and friends */
 #include <assert.h>
 #include <fcntl.h>
+#include <stdio.h> /* for rename() */
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -20,10 +22,17 @@
 #include "hosts_db.h"
 #include "graph_db.h"
 #include "db.h"
+#include "now.h"
+#include "opt.h"
+#include "sketch.h"
+#include "str.h"
 
 static const unsigned char export_file_header[] = {0xDA, 0x31, 0x41, 0x59};
 static const unsigned char export_tag_hosts_ver1[] = {0xDA, 'H', 'S', 0x01};
 static const unsigned char export_tag_graph_ver1[] = {0xDA, 'G', 'R', 0x01};
+static const unsigned char export_tag_graph_ver2[] = {0xDA, 'G', 'R', 0x02};
+static const unsigned char export_tag_meta_ver1[] = {0xDA, 'M', 'D', 0x01};
+static const unsigned char export_tag_journal_ver1[] = {0xDA, 'J', 'L', 0x01};
 
 #ifndef swap64
 static uint64_t swap64(uint64_t _x) {
@@ -292,6 +301,86 @@ read_file_header(const int fd, const uint8_t expected[4])
    return 1;
 }
 
+/* The metadata section is optional, older files end after the graphs.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+import_meta(const int fd)
+{
+   uint8_t got[4], mode;
+   uint32_t rate;
+   ssize_t numread;
+
+   numread = read(fd, got, sizeof(got));
+   if (numread == 0) return 1;
+   if (numread != (ssize_t)sizeof(got) ||
+       memcmp(got, export_tag_meta_ver1, sizeof(got)) != 0) {
+      warnx("at pos %u: bad metadata section header", xtell(fd));
+      return 0;
+   }
+   if (!read32(fd, &rate)) return 0;
+   if (!read8(fd, &mode)) return 0;
+   if (rate == 0) rate = 1;
+   if (rate != opt_sample)
+      verbosef("imported counters were sampled 1 in %u%s, "
+         "now sampling 1 in %u",
+         rate, mode ? " (random)" : "", opt_sample);
+   return 1;
+}
+
+/* The graphs section is version 1 (fixed graphs) or 2 (any tiers).
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+import_graphs(const int fd)
+{
+   uint8_t got[4];
+
+   if (!readn(fd, got, sizeof(got))) return 0;
+   if (memcmp(got, export_tag_graph_ver2, sizeof(got)) == 0)
+      return graph_import(fd, 2);
+   if (memcmp(got, export_tag_graph_ver1, sizeof(got)) == 0)
+      return graph_import(fd, 1);
+   warnx("bad graphs section header: "
+      "expecting %02x%02x%02x%02x, got %02x%02x%02x%02x",
+      export_tag_graph_ver2[0], export_tag_graph_ver2[1],
+      export_tag_graph_ver2[2], export_tag_graph_ver2[3],
+      got[0], got[1], got[2], got[3]);
+   return 0;
+}
+
+/* With --journal, entries of what changed in the hosts table are appended
+ * after the metadata.  An entry that was cut short by a crash is where we
+ * stop: everything before it was whole.
+ */
+static void
+import_journal(const int fd)
+{
+   uint8_t got[4];
+   uint64_t when;
+   ssize_t numread;
+   unsigned int entries = 0;
+
+   for (;;) {
+      const unsigned int pos = xtell(fd);
+
+      numread = read(fd, got, sizeof(got));
+      if (numread == 0)
+         break;
+      if (numread != (ssize_t)sizeof(got) ||
+          memcmp(got, export_tag_journal_ver1, sizeof(got)) != 0 ||
+          !read64(fd, &when) ||
+          !hosts_db_replay(fd)) {
+         warnx("at pos %u: journal entry is cut short, ignoring the rest",
+               pos);
+         break;
+      }
+      entries++;
+   }
+   if (entries > 0)
+      verbosef("replayed %u journal entries", entries);
+}
+
 /* Returns 0 on failure, 1 on success. */
 static int
 db_import_from_fd(const int fd)
@@ -299,26 +388,37 @@ db_import_from_fd(const int fd)
    if (!read_file_header(fd, export_file_header)) return 0;
    if (!read_file_header(fd, export_tag_hosts_ver1)) return 0;
    if (!hosts_db_import(fd)) return 0;
-   if (!read_file_header(fd, export_tag_graph_ver1)) return 0;
-   if (!graph_import(fd)) return 0;
+   if (!import_graphs(fd)) return 0;
+   if (!import_meta(fd)) return 0;
+   import_journal(fd);
    return 1;
 }
 
-void
-db_import(const char *filename)
+/* Returns 0 on failure, 1 on success. */
+static int
+import_file(const char *filename)
 {
-   int fd = open(filename, O_RDONLY | O_NOFOLLOW);
+   int ok, fd = open(filename, O_RDONLY | O_NOFOLLOW);
    if (fd == -1) {
       warn("can't import from \"%s\"", filename);
-      return;
+      return 0;
    }
-   if (!db_import_from_fd(fd)) {
+   ok = db_import_from_fd(fd);
+   if (!ok) {
       warnx("import failed");
       /* don't stay in an inconsistent state: */
       hosts_db_reset();
       graph_reset();
+      sketch_reset(); /* the hosts we did read went into it */
    }
    close(fd);
+   return ok;
+}
+
+void
+db_import(const char *filename)
+{
+   (void)import_file(filename);
 }
 
 /* Returns 0 on failure, 1 on success. */
@@ -331,31 +431,152 @@ db_export_to_fd(const int fd)
       return 0;
    if (!hosts_db_export(fd))
       return 0;
-   if (!writen(fd, export_tag_graph_ver1, sizeof(export_tag_graph_ver1)))
+   if (!writen(fd, export_tag_graph_ver2, sizeof(export_tag_graph_ver2)))
       return 0;
    if (!graph_export(fd))
       return 0;
+   if (!writen(fd, export_tag_meta_ver1, sizeof(export_tag_meta_ver1)))
+      return 0;
+   if (!write32(fd, opt_sample))
+      return 0;
+   if (!write8(fd, opt_want_sample_random ? 1 : 0))
+      return 0;
    return 1;
 }
 
-void
-db_export(const char *filename)
+/* Writes to filename.tmp, and renames it over filename once it's all on
+ * disk, so a crash during the export leaves the old file alone.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+export_file(const char *filename)
 {
-   int fd = open(filename, O_WRONLY | O_CREAT | O_NOFOLLOW | O_TRUNC, 0600);
+   char *tmp;
+   int fd, ok;
+
+   xasprintf(&tmp, "%s.tmp", filename);
+   fd = open(tmp, O_WRONLY | O_CREAT | O_NOFOLLOW | O_TRUNC, 0600);
    if (fd == -1) {
-      warn("can't export to \"%s\"", filename);
-      return;
+      warn("can't export to \"%s\"", tmp);
+      free(tmp);
+      return 0;
    }
    verbosef("exporting db to file \"%s\"", filename);
-   if (!db_export_to_fd(fd))
-      warnx("export failed");
-   else
+   ok = db_export_to_fd(fd);
+   if (ok && fsync(fd) == -1) {
+      warn("fsync(\"%s\") failed", tmp);
+      ok = 0;
+   }
+   close(fd);
+   if (ok && rename(tmp, filename) == -1) {
+      warn("can't rename \"%s\" to \"%s\"", tmp, filename);
+      ok = 0;
+   }
+   if (ok)
       verbosef("export successful");
+   else {
+      warnx("export failed");
+      unlink(tmp);
+   }
+   free(tmp);
+   return ok;
+}
+
+void
+db_export(const char *filename)
+{
+   (void)export_file(filename);
+}
 
-   /* FIXME: should write to another filename and use the rename() syscall to
-    * atomically update the output file on success
+/* ---------------------------------------------------------------------------
+ * The --journal: a full export, followed by entries of what changed in the
+ * hosts table since, one every interval.  Every so often, we compact it by
+ * doing a new export, which starts without any entries.  Graphs aren't
+ * journalled, only exported, see --graph-store for those.
+ */
+static const char *journal_fn = NULL;
+static int journal_fd = -1;
+static unsigned int journal_interval, journal_compact;
+static int64_t journal_next, compact_next; /* monotonic */
+
+void
+db_journal_compact(void)
+{
+   if (journal_fn == NULL)
+      return;
+   if (journal_fd != -1)
+      close(journal_fd);
+   /* If the export fails, the old file and its entries are still good, so
+    * we carry on appending to them.
     */
-   close(fd);
+   if (export_file(journal_fn))
+      hosts_db_journal_mark();
+   journal_fd = open(journal_fn, O_WRONLY | O_APPEND | O_NOFOLLOW);
+   if (journal_fd == -1)
+      warn("can't open journal \"%s\" for append", journal_fn);
+   compact_next = now_mono() + journal_compact;
+}
+
+void
+db_journal_init(const char *filename, const unsigned int interval,
+                const unsigned int compact)
+{
+   journal_fn = filename;
+   journal_interval = interval;
+   journal_compact = compact;
+   if (access(filename, F_OK) == 0) {
+      verbosef("loading journal \"%s\"", filename);
+      (void)import_file(filename);
+      /* The file already holds what we just loaded, so if the export below
+       * fails and we append to it, only count what's new.
+       */
+      hosts_db_journal_mark();
+   }
+   /* Start afresh, which also cuts off an entry that was cut short. */
+   db_journal_compact();
+   journal_next = now_mono() + journal_interval;
+}
+
+void
+db_journal_poll(void)
+{
+   const int64_t t = now_mono();
+   uint32_t count;
+
+   if (journal_fn == NULL)
+      return;
+   if (t >= compact_next) {
+      db_journal_compact();
+      journal_next = t + journal_interval;
+      return;
+   }
+   if (t < journal_next || journal_fd == -1)
+      return;
+   journal_next = t + journal_interval;
+
+   count = hosts_db_journal_count();
+   if (count == 0)
+      return; /* so a quiet network costs nothing */
+   if (!writen(journal_fd, export_tag_journal_ver1,
+               sizeof(export_tag_journal_ver1)) ||
+       !write64(journal_fd, (uint64_t)now_real()) ||
+       !hosts_db_journal(journal_fd, count)) {
+      /* Entries after a broken one would be ignored, so start afresh. */
+      warnx("write to journal \"%s\" failed", journal_fn);
+      compact_next = t;
+   }
+}
+
+void
+db_journal_free(void)
+{
+   if (journal_fn == NULL)
+      return;
+   db_journal_compact();
+   if (journal_fd != -1)
+      close(journal_fd);
+   journal_fd = -1;
+   journal_fn = NULL;
 }
 
 /* vim:set ts=3 sw=3 tw=78 et: */
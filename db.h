@@ -11,6 +11,13 @@ struct addr;
 
 void db_import(const char *filename);
 void db_export(const char *filename);
+
+/* --journal: loads the file if there is one, then keeps it up to date. */
+void db_journal_init(const char *filename, const unsigned int interval,
+                     const unsigned int compact);
+void db_journal_poll(void);
+void db_journal_compact(void);
+void db_journal_free(void);
 void test_64order(void);
 
 /* read helpers */
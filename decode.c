@@ -53,6 +53,16 @@
 #ifndef ETHERTYPE_IPV6
 # define ETHERTYPE_IPV6 0x86DD
 #endif
+#ifndef ETHERTYPE_VLAN
+# define ETHERTYPE_VLAN 0x8100
+#endif
+#define ETHERTYPE_QINQ     0x88A8 /* 802.1ad service tag */
+#define ETHERTYPE_QINQ_OLD 0x9100 /* pre-standard QinQ */
+#define ETHERTYPE_MPLS     0x8847
+#define ETHERTYPE_MPLS_MC  0x8848
+#define ETHERTYPE_TEB      0x6558 /* transparent Ethernet bridging */
+#define ETHERTYPE_ERSPAN   0x88BE /* type I and II */
+#define ETHERTYPE_ERSPAN3  0x22EB
 
 #include <netinet/in_systm.h> /* n_long */
 #include <netinet/ip.h> /* struct ip */
@@ -67,9 +77,32 @@
 #define IPV6_HDR_LEN    sizeof(struct ip6_hdr)
 #define TCP_HDR_LEN     sizeof(struct tcphdr)
 #define UDP_HDR_LEN     sizeof(struct udphdr)
+#define ICMP_HDR_LEN    4 /* type, code, checksum */
 #define NULL_HDR_LEN    4
 #define SLL_HDR_LEN     16
 #define RAW_HDR_LEN     0
+#define VLAN_TAG_LEN    4
+#define MAX_VLAN_TAGS   2
+#define GRE_HDR_LEN     4
+#define VXLAN_HDR_LEN   8
+#define GENEVE_HDR_LEN  8
+#define MPLS_LABEL_LEN  4
+#define MAX_MPLS_LABELS 8
+#define MAX_DECAP_DEPTH 3
+#define MAX_IPV6_EXTS   8
+#define IP_OPTS_LEN     40 /* IPv4 options, or a few IPv6 extension headers */
+#define DECAP_HDR_LEN   128 /* room for the outer headers when decapsulating */
+
+#define VXLAN_PORT      4789
+#define GENEVE_PORT     6081
+
+#ifndef IPPROTO_GRE
+# define IPPROTO_GRE 47
+#endif
+#ifndef IP_OFFMASK
+# define IP_OFFMASK 0x1fff
+#endif
+#define IP6F_OFFMASK_BE 0xFFF8 /* after ntohs() */
 
 #ifndef IPV6_VERSION
 # define IPV6_VERSION 0x60
@@ -93,11 +126,29 @@ static int decode_raw(DECODER_ARGS);
                     const uint32_t len, \
                     struct pktsummary *sm
 
+static int helper_ether(HELPER_ARGS);
+static int helper_vlan(const u_char **pdata, uint32_t *len, u_short *type,
+                       struct pktsummary *sm);
 static int helper_pppoe(HELPER_ARGS);
+static int helper_mpls(HELPER_ARGS);
+static int helper_gre(HELPER_ARGS);
+static int helper_vxlan(HELPER_ARGS);
+static int helper_geneve(HELPER_ARGS);
+static int helper_decap(int (*helper)(HELPER_ARGS), HELPER_ARGS);
 static int helper_ip(HELPER_ARGS);
 static int helper_ipv6(HELPER_ARGS);
+static int helper_ipv6_exts(const u_char **pdata, uint32_t *len,
+                            struct pktsummary *sm);
+static void helper_jumbo(const u_char *ext, const uint32_t extlen,
+                         struct pktsummary *sm);
 static void helper_ip_deeper(HELPER_ARGS); /* protocols like TCP/UDP */
 
+/* Bytes of 802.1Q and QinQ tags that helper_vlan() took off the current
+ * packet, which the link header length doesn't include.  Tags inside a
+ * tunnel don't count, see helper_decap().
+ */
+static uint32_t vlan_hdrlen;
+
 /* Link-type header information */
 static const struct linkhdr linkhdrs[] = {
   /* linktype       hdrlen         handler       */
@@ -128,19 +179,58 @@ const struct linkhdr *getlinkhdr(const int linktype) {
    return NULL;
 }
 
+/* Decode a packet and work out its length, according to --len-from.
+ * Returns 0 on decode failure, like the decoder.
+ */
+int decode_packet(const struct linkhdr *lh, DECODER_ARGS) {
+   vlan_hdrlen = 0;
+   if (!lh->decoder(pheader, pdata, sm))
+      return 0;
+   switch (opt_len_from) {
+      case LEN_FROM_CAPLEN:
+         sm->len = pheader->caplen;
+         break;
+      case LEN_FROM_WIRE:
+         sm->len = pheader->len;
+         break;
+      default:
+         /* The IP length is zero for TSO and GRO super-frames, and for
+          * jumbograms we couldn't find the real length of.  Use what was on
+          * the wire, less the link header and any VLAN tags.
+          */
+         if ((sm->len == 0) && (pheader->len > lh->hdrlen + vlan_hdrlen))
+            sm->len = pheader->len - lh->hdrlen - vlan_hdrlen;
+         break;
+   }
+   return 1;
+}
+
 /* Returns the minimum snaplen needed to decode everything up to and including
  * the TCP/UDP packet headers.
  */
 int getsnaplen(const struct linkhdr *lh) {
-   return (int)(lh->hdrlen + IPV6_HDR_LEN + MAX(TCP_HDR_LEN, UDP_HDR_LEN));
+   unsigned int hdrlen = lh->hdrlen;
+
+   if (lh->decoder == decode_ether)
+      hdrlen += MAX_VLAN_TAGS * VLAN_TAG_LEN;
+   if (opt_want_decap)
+      hdrlen += DECAP_HDR_LEN;
+   return (int)(hdrlen + IPV6_HDR_LEN + IP_OPTS_LEN +
+                MAX(TCP_HDR_LEN, UDP_HDR_LEN));
 }
 
 static int decode_ether(DECODER_ARGS) {
+   return helper_ether(pdata, pheader->caplen, sm);
+}
+
+static int helper_ether(HELPER_ARGS) {
    u_short type;
    const struct ether_header *hdr = (const struct ether_header *)pdata;
+   const u_char *payload;
+   uint32_t paylen;
 
-   if (pheader->caplen < ETHER_HDR_LEN) {
-      verbosef("ether: packet too short (%u bytes)", pheader->caplen);
+   if (len < ETHER_HDR_LEN) {
+      verbosef("ether: packet too short (%u bytes)", len);
       return 0;
    }
 #ifdef __sun
@@ -151,20 +241,23 @@ static int decode_ether(DECODER_ARGS) {
    memcpy(sm->dst_mac, hdr->ether_dhost, sizeof(sm->dst_mac));
 #endif
    type = ntohs(hdr->ether_type);
+   payload = pdata + ETHER_HDR_LEN;
+   paylen = len - ETHER_HDR_LEN;
+   if (!helper_vlan(&payload, &paylen, &type, sm))
+      return 0;
    switch (type) {
       case ETHERTYPE_IP:
       case ETHERTYPE_IPV6:
          if (!opt_want_pppoe)
-            return helper_ip(pdata + ETHER_HDR_LEN,
-                             pheader->caplen - ETHER_HDR_LEN,
-                             sm);
+            return helper_ip(payload, paylen, sm);
          verbosef("ether: discarded IP packet, expecting PPPoE instead");
          return 0;
+      case ETHERTYPE_MPLS:
+      case ETHERTYPE_MPLS_MC:
+         return helper_mpls(payload, paylen, sm);
       case ETHERTYPE_PPPOE:
          if (opt_want_pppoe)
-            return helper_pppoe(pdata + ETHER_HDR_LEN,
-                                pheader->caplen - ETHER_HDR_LEN,
-                                sm);
+            return helper_pppoe(payload, paylen, sm);
          verbosef("ether: got PPPoE frame: maybe you want --pppoe");
          return 0;
       case ETHERTYPE_ARP:
@@ -249,18 +342,25 @@ static int decode_linux_sll(DECODER_ARGS) {
       uint16_t ether_type;
    } *hdr = (const struct sll_header *)pdata;
    u_short type;
+   const u_char *payload;
+   uint32_t len;
 
    if (pheader->caplen < SLL_HDR_LEN) {
       verbosef("linux_sll: packet too short (%u bytes)", pheader->caplen);
       return 0;
    }
    type = ntohs(hdr->ether_type);
+   payload = pdata + SLL_HDR_LEN;
+   len = pheader->caplen - SLL_HDR_LEN;
+   if (!helper_vlan(&payload, &len, &type, sm))
+      return 0;
    switch (type) {
    case ETHERTYPE_IP:
    case ETHERTYPE_IPV6:
-      return helper_ip(pdata + SLL_HDR_LEN,
-                       pheader->caplen - SLL_HDR_LEN,
-                       sm);
+      return helper_ip(payload, len, sm);
+   case ETHERTYPE_MPLS:
+   case ETHERTYPE_MPLS_MC:
+      return helper_mpls(payload, len, sm);
    case ETHERTYPE_ARP:
       /* known protocol, don't complain about it. */
       return 0;
@@ -275,6 +375,36 @@ static int decode_raw(DECODER_ARGS) {
    return helper_ip(pdata, pheader->caplen, sm);
 }
 
+/* Strip 802.1Q and QinQ tags off the front of the payload, leaving <type>
+ * as the encapsulated ethertype.  The outermost VLAN ID goes in the summary.
+ */
+static int helper_vlan(const u_char **pdata, uint32_t *len, u_short *type,
+                       struct pktsummary *sm) {
+   int tags = 0;
+
+   while (*type == ETHERTYPE_VLAN || *type == ETHERTYPE_QINQ ||
+          *type == ETHERTYPE_QINQ_OLD) {
+      const u_char *tag = *pdata;
+
+      if (tags == MAX_VLAN_TAGS) {
+         verbosef("vlan: more than %d tags", MAX_VLAN_TAGS);
+         return 0;
+      }
+      if (*len < VLAN_TAG_LEN) {
+         verbosef("vlan: packet too short (%u bytes)", *len);
+         return 0;
+      }
+      if (tags == 0)
+         sm->vlan = (uint16_t)(((tag[0] << 8) | tag[1]) & 0x0FFF);
+      *type = (u_short)((tag[2] << 8) | tag[3]);
+      *pdata += VLAN_TAG_LEN;
+      *len -= VLAN_TAG_LEN;
+      vlan_hdrlen += VLAN_TAG_LEN;
+      tags++;
+   }
+   return 1;
+}
+
 static int helper_pppoe(HELPER_ARGS) {
    if (len < PPPOE_HDR_LEN) {
       verbosef("pppoe: packet too short (%u bytes)", len);
@@ -299,6 +429,7 @@ static int helper_pppoe(HELPER_ARGS) {
 
 static int helper_ip(HELPER_ARGS) {
    const struct ip *hdr = (const struct ip *)pdata;
+   uint32_t hlen;
 
    if (len < IP_HDR_LEN) {
       verbosef("ip: packet too short (%u bytes)", len);
@@ -311,8 +442,13 @@ static int helper_ip(HELPER_ARGS) {
       verbosef("ip: version %d (expecting 4 or 6)", hdr->ip_v);
       return 0;
    }
+   hlen = (uint32_t)hdr->ip_hl * 4;
+   if (hlen < IP_HDR_LEN) {
+      verbosef("ip: bad header length (%u bytes)", hlen);
+      return 0;
+   }
 
-   sm->len = ntohs(hdr->ip_len);
+   sm->len = ntohs(hdr->ip_len); /* 0 from TSO, see decode_packet() */
    sm->proto = hdr->ip_p;
 
    sm->src.family = IPv4;
@@ -321,12 +457,24 @@ static int helper_ip(HELPER_ARGS) {
    sm->dst.family = IPv4;
    sm->dst.ip.v4 = hdr->ip_dst.s_addr;
 
-   helper_ip_deeper(pdata + IP_HDR_LEN, len - IP_HDR_LEN, sm);
+   /* Only the first fragment has the TCP or UDP header. */
+   if (ntohs(hdr->ip_off) & IP_OFFMASK) {
+      sm->fragment = 1;
+      return 1;
+   }
+   if (len < hlen) {
+      verbosef("ip: options truncated (%u of %u bytes)", len, hlen);
+      sm->proto = IPPROTO_INVALID; /* don't do accounting! */
+      return 1;
+   }
+   helper_ip_deeper(pdata + hlen, len - hlen, sm);
    return 1;
 }
 
 static int helper_ipv6(HELPER_ARGS) {
    const struct ip6_hdr *hdr = (const struct ip6_hdr *)pdata;
+   const u_char *upper;
+   uint32_t upper_len;
 
    if (len < IPV6_HDR_LEN) {
       verbosef("ipv6: packet too short (%u bytes)", len);
@@ -342,13 +490,113 @@ static int helper_ipv6(HELPER_ARGS) {
     * count the header bytes.
     */
    sm->len = ntohs(hdr->ip6_plen) + IPV6_HDR_LEN;
+   if (hdr->ip6_plen == 0)
+      sm->len = 0; /* jumbogram or offload, see decode_packet() */
    sm->proto = hdr->ip6_nxt;
    sm->src.family = IPv6;
    memcpy(&sm->src.ip.v6, &hdr->ip6_src, sizeof(sm->src.ip.v6));
    sm->dst.family = IPv6;
    memcpy(&sm->dst.ip.v6, &hdr->ip6_dst, sizeof(sm->dst.ip.v6));
 
-   helper_ip_deeper(pdata + IPV6_HDR_LEN, len - IPV6_HDR_LEN, sm);
+   upper = pdata + IPV6_HDR_LEN;
+   upper_len = len - IPV6_HDR_LEN;
+   switch (sm->proto) {
+      case IPPROTO_HOPOPTS:
+      case IPPROTO_ROUTING:
+      case IPPROTO_FRAGMENT:
+      case IPPROTO_DSTOPTS:
+      case IPPROTO_AH:
+         if (!helper_ipv6_exts(&upper, &upper_len, sm))
+            return 1;
+   }
+   helper_ip_deeper(upper, upper_len, sm);
+   return 1;
+}
+
+/* Look for a Jumbo Payload option (RFC 2675) in a hop-by-hop header. */
+static void helper_jumbo(const u_char *ext, const uint32_t extlen,
+                         struct pktsummary *sm) {
+   uint32_t pos = 2;
+
+   while (pos < extlen) {
+      if (ext[pos] == 0) { /* Pad1 */
+         pos++;
+         continue;
+      }
+      if (pos + 2 > extlen || pos + 2 + ext[pos + 1] > extlen)
+         return;
+      if ((ext[pos] == 0xC2) && (ext[pos + 1] == 4)) {
+         sm->len = IPV6_HDR_LEN + (((uint32_t)ext[pos + 2] << 24) |
+                                   ((uint32_t)ext[pos + 3] << 16) |
+                                   ((uint32_t)ext[pos + 4] << 8) |
+                                    (uint32_t)ext[pos + 5]);
+         return;
+      }
+      pos += 2 + ext[pos + 1];
+   }
+}
+
+/* Walk the IPv6 extension headers, leaving sm->proto as the upper layer
+ * protocol.  Returns 0 if there's no upper layer header to look at, which
+ * is the case for non-first fragments.
+ */
+static int helper_ipv6_exts(const u_char **pdata, uint32_t *len,
+                            struct pktsummary *sm) {
+   int exts;
+
+   for (exts = 0; exts < MAX_IPV6_EXTS; exts++) {
+      const u_char *ext = *pdata;
+      uint32_t extlen;
+
+      if (*len < 8) {
+         verbosef("ipv6: extension header too short (%u bytes)", *len);
+         sm->proto = IPPROTO_INVALID; /* don't do accounting! */
+         return 0;
+      }
+      switch (sm->proto) {
+         case IPPROTO_HOPOPTS:
+            extlen = ((uint32_t)ext[1] + 1) * 8;
+            if ((sm->len == 0) && (*len >= extlen))
+               helper_jumbo(ext, extlen, sm);
+            break;
+         case IPPROTO_ROUTING:
+         case IPPROTO_DSTOPTS:
+            extlen = ((uint32_t)ext[1] + 1) * 8;
+            break;
+         case IPPROTO_AH:
+            extlen = ((uint32_t)ext[1] + 2) * 4;
+            break;
+         case IPPROTO_FRAGMENT:
+            extlen = 8;
+            if ((((ext[2] << 8) | ext[3]) & IP6F_OFFMASK_BE) != 0) {
+               sm->proto = ext[0];
+               sm->fragment = 1;
+               return 0;
+            }
+            break;
+         default:
+            return 1; /* upper layer */
+      }
+      if (*len < extlen) {
+         verbosef("ipv6: extension header truncated (%u of %u bytes)",
+                  *len, extlen);
+         sm->proto = IPPROTO_INVALID; /* don't do accounting! */
+         return 0;
+      }
+      sm->proto = ext[0];
+      *pdata += extlen;
+      *len -= extlen;
+   }
+   switch (sm->proto) {
+      case IPPROTO_HOPOPTS:
+      case IPPROTO_ROUTING:
+      case IPPROTO_FRAGMENT:
+      case IPPROTO_DSTOPTS:
+      case IPPROTO_AH:
+         verbosef("ipv6: more than %d extension headers", MAX_IPV6_EXTS);
+         sm->proto = IPPROTO_INVALID; /* don't do accounting! */
+         return 0;
+   }
    return 1;
 }
 
@@ -384,9 +632,210 @@ static void helper_ip_deeper(HELPER_ARGS) {
          }
          sm->src_port = ntohs(uhdr->uh_sport);
          sm->dst_port = ntohs(uhdr->uh_dport);
+         if (!opt_want_decap)
+            return;
+         if (sm->dst_port == VXLAN_PORT)
+            helper_decap(helper_vxlan, pdata + UDP_HDR_LEN,
+                         len - UDP_HDR_LEN, sm);
+         else if (sm->dst_port == GENEVE_PORT)
+            helper_decap(helper_geneve, pdata + UDP_HDR_LEN,
+                         len - UDP_HDR_LEN, sm);
+         return;
+      }
+
+      case IPPROTO_ICMP:
+      case IPPROTO_ICMPV6:
+         if (len < ICMP_HDR_LEN) {
+            verbosef("icmp: packet too short (%u bytes)", len);
+            return;
+         }
+         sm->has_icmp = 1;
+         sm->icmp_type = pdata[0];
+         sm->icmp_code = pdata[1];
+         return;
+
+      case IPPROTO_GRE:
+         if (opt_want_decap)
+            helper_decap(helper_gre, pdata, len, sm);
          return;
+
+      case IPPROTO_IPIP:
+      case IPPROTO_IPV6:
+         if (opt_want_decap)
+            helper_decap(helper_ip, pdata, len, sm);
+         return;
+   }
+}
+
+/* Decode the packet inside a tunnel with the given helper, and if that
+ * works, replace the summary with the inner one, except for the VLAN, which
+ * stays the outermost one.  The outer summary is left alone if the inner
+ * packet can't be decoded.  Tunnels inside tunnels are followed up to
+ * MAX_DECAP_DEPTH deep.
+ *
+ * Returns 1 if the inner packet was decoded.
+ */
+static int helper_decap(int (*helper)(HELPER_ARGS), HELPER_ARGS) {
+   static int depth = 0;
+   const uint32_t outer_vlan_hdrlen = vlan_hdrlen;
+   struct pktsummary inner;
+   int ret;
+
+   if (depth == MAX_DECAP_DEPTH) {
+      verbosef("decap: more than %d levels of tunnels", MAX_DECAP_DEPTH);
+      return 0;
+   }
+   memcpy(&inner, sm, sizeof(inner));
+   inner.src_port = inner.dst_port = 0;
+   inner.tcp_flags = 0;
+   inner.fragment = 0;
+   inner.has_icmp = 0;
+   depth++;
+   ret = helper(pdata, len, &inner);
+   depth--;
+   vlan_hdrlen = outer_vlan_hdrlen;
+   if (ret) {
+      inner.vlan = sm->vlan; /* not the tenant's VLAN */
+      memcpy(sm, &inner, sizeof(*sm));
+   }
+   return ret;
+}
+
+/* Payload of a given ethertype, inside a tunnel. */
+static int helper_ethertype(const u_short type, HELPER_ARGS) {
+   switch (type) {
+      case ETHERTYPE_IP:
+      case ETHERTYPE_IPV6:
+         return helper_ip(pdata, len, sm);
+      case ETHERTYPE_TEB:
+         return helper_ether(pdata, len, sm);
+      case ETHERTYPE_MPLS:
+      case ETHERTYPE_MPLS_MC:
+         return helper_mpls(pdata, len, sm);
+      default:
+         verbosef("decap: unknown protocol (0x%04x)", type);
+         return 0;
+   }
+}
+
+/* MPLS label stack, with IP or an Ethernet pseudowire at the bottom. */
+static int helper_mpls(HELPER_ARGS) {
+   const u_char *p = pdata;
+   uint32_t left = len;
+   int labels;
+
+   for (labels = 0; ; labels++) {
+      int bottom;
+
+      if (labels == MAX_MPLS_LABELS) {
+         verbosef("mpls: more than %d labels", MAX_MPLS_LABELS);
+         return 0;
       }
+      if (left < MPLS_LABEL_LEN) {
+         verbosef("mpls: packet too short (%u bytes)", len);
+         return 0;
+      }
+      bottom = p[2] & 0x01;
+      p += MPLS_LABEL_LEN;
+      left -= MPLS_LABEL_LEN;
+      if (bottom)
+         break;
+   }
+   if (left < 1) {
+      verbosef("mpls: no payload");
+      return 0;
+   }
+   switch (p[0] >> 4) {
+      case 4:
+      case 6:
+         return helper_ip(p, left, sm);
+      case 0:
+         /* Ethernet pseudowire with a control word. */
+         if (left < MPLS_LABEL_LEN)
+            return 0;
+         return helper_decap(helper_ether, p + MPLS_LABEL_LEN,
+                             left - MPLS_LABEL_LEN, sm);
+      default:
+         verbosef("mpls: unknown payload (0x%02x)", p[0]);
+         return 0;
+   }
+}
+
+/* GRE (RFC 2784, 2890), carrying IP, Ethernet, MPLS or ERSPAN. */
+static int helper_gre(HELPER_ARGS) {
+   uint16_t flags, type;
+   uint32_t hdrlen = GRE_HDR_LEN;
+
+   if (len < GRE_HDR_LEN) {
+      verbosef("gre: packet too short (%u bytes)", len);
+      return 0;
+   }
+   flags = (uint16_t)((pdata[0] << 8) | pdata[1]);
+   type = (uint16_t)((pdata[2] << 8) | pdata[3]);
+   if ((flags & 0x0007) != 0) {
+      verbosef("gre: version %d (expecting 0)", flags & 0x0007);
+      return 0;
+   }
+   if (flags & 0x8000) hdrlen += 4; /* checksum */
+   if (flags & 0x2000) hdrlen += 4; /* key */
+   if (flags & 0x1000) hdrlen += 4; /* sequence number */
+
+   switch (type) {
+      case ETHERTYPE_ERSPAN:
+         /* Type II has a sequence number and an 8 byte header,
+          * type I has neither.
+          */
+         if (flags & 0x1000) hdrlen += 8;
+         type = ETHERTYPE_TEB;
+         break;
+      case ETHERTYPE_ERSPAN3:
+         hdrlen += 12;
+         /* The O flag means there's an 8 byte platform subheader. */
+         if ((len >= hdrlen) && (pdata[hdrlen - 1] & 0x01))
+            hdrlen += 8;
+         type = ETHERTYPE_TEB;
+         break;
+   }
+   if (len < hdrlen) {
+      verbosef("gre: packet too short (%u bytes)", len);
+      return 0;
+   }
+   return helper_ethertype(type, pdata + hdrlen, len - hdrlen, sm);
+}
+
+/* VXLAN (RFC 7348), always carrying Ethernet. */
+static int helper_vxlan(HELPER_ARGS) {
+   if (len < VXLAN_HDR_LEN) {
+      verbosef("vxlan: packet too short (%u bytes)", len);
+      return 0;
+   }
+   if ((pdata[0] & 0x08) == 0) {
+      verbosef("vxlan: VNI flag not set");
+      return 0;
+   }
+   return helper_ether(pdata + VXLAN_HDR_LEN, len - VXLAN_HDR_LEN, sm);
+}
+
+/* GENEVE (RFC 8926), skipping over any options. */
+static int helper_geneve(HELPER_ARGS) {
+   uint32_t hdrlen;
+   uint16_t type;
+
+   if (len < GENEVE_HDR_LEN) {
+      verbosef("geneve: packet too short (%u bytes)", len);
+      return 0;
+   }
+   if ((pdata[0] >> 6) != 0) {
+      verbosef("geneve: version %d (expecting 0)", pdata[0] >> 6);
+      return 0;
+   }
+   hdrlen = GENEVE_HDR_LEN + (uint32_t)(pdata[0] & 0x3F) * 4;
+   type = (uint16_t)((pdata[2] << 8) | pdata[3]);
+   if (len < hdrlen) {
+      verbosef("geneve: packet too short (%u bytes)", len);
+      return 0;
    }
+   return helper_ethertype(type, pdata + hdrlen, len - hdrlen, sm);
 }
 
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -21,16 +21,26 @@
 # define IPPROTO_OSPF 89
 #endif
 
+#ifndef IPPROTO_ICMPV6
+# define IPPROTO_ICMPV6 58
+#endif
+
 #define PPPOE_HDR_LEN 8
 
 /* Decoding creates a summary which is passed to accounting. */
 struct pktsummary {
    /* Fields are in host byte order (except IPs) */
    struct addr src, dst;
-   uint16_t len;
+   uint64_t len;  /* bytes */
+   uint64_t pkts; /* packets: 1 when capturing, more for a flow record */
    uint8_t proto; /* IPPROTO_INVALID means don't do proto accounting */
    uint8_t tcp_flags;           /* only for TCP */
+   uint8_t fragment;            /* non-first fragment, so no ports */
    uint16_t src_port, dst_port; /* only for TCP, UDP */
+   uint8_t has_icmp;            /* icmp_type and icmp_code are set */
+   uint8_t icmp_type, icmp_code; /* only for ICMP, ICMPv6 */
+   uint16_t vlan; /* outermost 802.1Q VLAN ID, 0 if untagged */
+   int64_t ms;    /* capture time since the epoch, 0 means now */
    uint8_t src_mac[ETHER_ADDR_LEN], /* only for Ethernet */
            dst_mac[ETHER_ADDR_LEN]; /* only for Ethernet */
 };
@@ -50,8 +60,16 @@ struct linkhdr {
    decoder_fn *decoder;
 };
 
+/* Where packet lengths come from, for --len-from. */
+enum len_from {
+   LEN_FROM_IP,     /* IP header: the default */
+   LEN_FROM_CAPLEN, /* bytes captured */
+   LEN_FROM_WIRE    /* frame length on the wire, from pcap */
+};
+
 const struct linkhdr *getlinkhdr(const int linktype);
 int getsnaplen(const struct linkhdr *lh);
+int decode_packet(const struct linkhdr *lh, DECODER_ARGS);
 
 #endif /* __DARKSTAT_DECODE_H */
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -35,6 +35,10 @@
  */
 int opt_want_pppoe = 0;
 
+/* Follow tunnels, for coverage of the inner decoders. */
+int opt_want_decap = 1;
+int opt_len_from = 0;
+
 /* Only enable verbose if debugging the fuzzer. */
 static const int verbose = 0;
 
@@ -71,10 +75,14 @@ static void print_summary(const struct pktsummary* s) {
   printf("pktsummary:\n");
   printf("  src=%s\n", addr_to_str(&s->src));
   printf("  dst=%s\n", addr_to_str(&s->dst));
-  printf("  len=0x%04x (%d) proto=0x%02x tcp_flags=0x%02x\n",
-      s->len, s->len, s->proto, s->tcp_flags);
+  printf("  len=0x%04llx (%llu) proto=0x%02x tcp_flags=0x%02x\n",
+      (unsigned long long)s->len, (unsigned long long)s->len,
+      s->proto, s->tcp_flags);
   printf("  src_port=0x%04x (%d) dst_port=0x%04x (%d)\n",
       s->src_port, s->src_port, s->dst_port, s->dst_port);
+  printf("  vlan=%u fragment=%u\n", s->vlan, s->fragment);
+  if (s->has_icmp)
+    printf("  icmp_type=%u icmp_code=%u\n", s->icmp_type, s->icmp_code);
   printf("  src_mac=%02x:%02x:%02x:%02x:%02x:%02x\n",
       s->src_mac[0],
       s->src_mac[1],
@@ -11,21 +11,28 @@
 #include "addr.c"
 #include "bsd.c"
 #include "cap.c"
+#include "collect.c"
 #include "conv.c"
 #include "daylog.c"
 #include "db.c"
 #include "decode.c"
 #include "dns.c"
 #include "err.c"
+#include "flow.c"
 #include "graph_db.c"
+#include "hll.c"
 #include "hosts_db.c"
 #include "hosts_sort.c"
 #include "html.c"
 #include "http.c"
+#include "ipfix.c"
+#include "json.c"
 #include "localip.c"
 #include "ncache.c"
 #include "now.c"
 #include "pidfile.c"
+#include "sketch.c"
+#include "stats.c"
 #include "str.c"
 
 #include "darkstat.c"
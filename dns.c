@@ -113,6 +113,7 @@ tree_cmp(struct tree_rec *a, struct tree_rec *b)
 
 static RB_HEAD(tree_t, tree_rec) ip_tree = RB_INITIALIZER(&tree_rec);
 RB_GENERATE_STATIC(tree_t, tree_rec, ptree, tree_cmp)
+static unsigned int queue_len = 0; /* records in ip_tree */
 
 void
 dns_queue(const struct addr *const ipaddr)
@@ -138,6 +139,7 @@ dns_queue(const struct addr *const ipaddr)
       free(rec);
       return;
    }
+   queue_len++;
 
    num_w = write(dns_sock[PARENT], ipaddr, sizeof(*ipaddr)); /* won't block */
    if (num_w == 0)
@@ -157,11 +159,19 @@ dns_unqueue(const struct addr *const ipaddr)
    if ((rec = RB_FIND(tree_t, &ip_tree, &tmp)) != NULL) {
       RB_REMOVE(tree_t, &ip_tree, rec);
       free(rec);
+      queue_len--;
    }
    else
       verbosef("couldn't unqueue %s - not in queue!", addr_to_str(ipaddr));
 }
 
+/* Lookups sent to the child and not answered yet. */
+unsigned int
+dns_queue_len(void)
+{
+   return (queue_len);
+}
+
 /*
  * Returns non-zero if result waiting, stores IP and name into given pointers
  * (name buffer is allocated by dns_poll)
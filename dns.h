@@ -13,5 +13,6 @@ void dns_init(const char *privdrop_user);
 void dns_stop(void);
 void dns_queue(const struct addr *const ipaddr);
 void dns_poll(void);
+unsigned int dns_queue_len(void);
 
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
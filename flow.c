@@ -0,0 +1,327 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * flow.c: cache of 5-tuple flows
+ *
+ * Every packet is accounted to a flow keyed by (src, dst, proto, src port,
+ * dst port).  Flows end when they have been idle for opt_flow_idle seconds,
+ * when they have been running for opt_flow_active seconds, when TCP says
+ * so (FIN or RST), or when the cache is full and they are the least
+ * recently used.  Ended flows are written to a CSV log and/or exported to
+ * a collector (see ipfix.c).
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#define _GNU_SOURCE 1 /* for O_NOFOLLOW on Linux */
+
+#include "conv.h"
+#include "decode.h"
+#include "err.h"
+#include "flow.h"
+#include "ipfix.h"
+#include "now.h"
+#include "opt.h"
+#include "queue.h"
+#include "str.h"
+
+#define __FAVOR_BSD
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct flow {
+   LIST_ENTRY(flow) hash_entries;
+   TAILQ_ENTRY(flow) lru_entries; /* least recently used first */
+   TAILQ_ENTRY(flow) age_entries; /* oldest first */
+   time_t first_mono, last_mono;
+   struct flow_rec rec;
+};
+
+LIST_HEAD(flow_list, flow);
+TAILQ_HEAD(flow_queue, flow);
+
+static struct flow_list *flow_table = NULL; /* NULL if flows are disabled */
+static uint32_t flow_bits, flow_count;
+static struct flow_queue flow_lru = TAILQ_HEAD_INITIALIZER(flow_lru);
+static struct flow_queue flow_age = TAILQ_HEAD_INITIALIZER(flow_age);
+
+/* Ended flows are kept here for reuse instead of being freed. */
+static struct flow_list flow_spare = LIST_HEAD_INITIALIZER(flow_spare);
+
+static time_t flow_last_expire;
+static uint64_t flow_stat_created, flow_stat_idle, flow_stat_active,
+   flow_stat_tcp_end, flow_stat_evicted;
+static unsigned int flow_sample_skipped;
+
+/* Flow log. */
+#define FLOW_LOG_FLUSH 65536 /* bytes */
+static const char *flow_log_pattern = NULL;
+static char *flow_log_fn = NULL;
+static int flow_log_fd = -1;
+static struct str *flow_log_buf = NULL;
+
+/* ---------------------------------------------------------------------------
+ * Hash the 5-tuple.
+ */
+static uint32_t flow_addr_fold(const struct addr *const a) {
+   uint32_t w[4];
+
+   if (a->family == IPv4)
+      return a->ip.v4;
+   assert(a->family == IPv6);
+   memcpy(w, &(a->ip.v6), sizeof(w));
+   return w[0] ^ w[1] ^ w[2] ^ w[3];
+}
+
+#define GOLDEN32 0x9E3779B1U
+
+static uint32_t flow_hash(const struct flow_key *const k) {
+   uint32_t h;
+
+   h = flow_addr_fold(&(k->src)) * GOLDEN32;
+   h = (h ^ flow_addr_fold(&(k->dst))) * GOLDEN32;
+   h = (h ^ (((uint32_t)k->src_port << 16) | k->dst_port)) * GOLDEN32;
+   h = (h ^ k->proto) * GOLDEN32;
+   return h >> (32 - flow_bits);
+}
+
+static int flow_key_equal(const struct flow_key *const a,
+                          const struct flow_key *const b) {
+   return (a->src_port == b->src_port) &&
+          (a->dst_port == b->dst_port) &&
+          (a->proto == b->proto) &&
+          addr_equal(&(a->src), &(b->src)) &&
+          addr_equal(&(a->dst), &(b->dst));
+}
+
+/* ---------------------------------------------------------------------------
+ * Flow log: CSV, with the filename expanded by strftime() so that a pattern
+ * like "flows-%Y%m%d.csv" rotates the log daily.
+ */
+static void flow_log_open(void) {
+   char fn[1024];
+   time_t t = now_real();
+   struct stat st;
+
+   if (strftime(fn, sizeof(fn), flow_log_pattern, localtime(&t)) == 0)
+      errx(1, "flow log pattern \"%s\" expanded to nothing",
+         flow_log_pattern);
+   if ((flow_log_fn != NULL) && (strcmp(fn, flow_log_fn) == 0))
+      return; /* still the same file */
+
+   if (flow_log_fd != -1)
+      close(flow_log_fd);
+   free(flow_log_fn);
+   flow_log_fn = xstrdup(fn);
+   flow_log_fd = open(flow_log_fn,
+      O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW, 0600);
+   if (flow_log_fd == -1) {
+      warn("flow log: couldn't open '%s' for append", flow_log_fn);
+      free(flow_log_fn);
+      flow_log_fn = NULL; /* so the next flush tries again */
+      return;
+   }
+   verbosef("flow log: writing to '%s'", flow_log_fn);
+   if ((fstat(flow_log_fd, &st) == 0) && (st.st_size == 0)) {
+      const char hdr[] = "first,last,src,dst,proto,src_port,dst_port,"
+                         "packets,bytes,tcp_flags\n";
+      if (write(flow_log_fd, hdr, sizeof(hdr) - 1) != sizeof(hdr) - 1)
+         warn("flow log: couldn't write to '%s'", flow_log_fn);
+   }
+}
+
+static void flow_log_flush(void) {
+   ssize_t wr;
+
+   if ((flow_log_buf == NULL) || (str_len(flow_log_buf) == 0))
+      return;
+   flow_log_open();
+   if (flow_log_fd != -1) {
+      wr = str_write(flow_log_buf, flow_log_fd);
+      if (wr == -1)
+         warn("flow log: couldn't write to '%s'", flow_log_fn);
+      else if (wr != (ssize_t)str_len(flow_log_buf))
+         warnx("flow log: truncated write to '%s': wrote %d of %d bytes",
+               flow_log_fn, (int)wr, (int)str_len(flow_log_buf));
+   }
+   str_free(flow_log_buf);
+   flow_log_buf = NULL;
+}
+
+static void flow_log(const struct flow_rec *const r) {
+   if (flow_log_pattern == NULL)
+      return;
+   if (flow_log_buf == NULL)
+      flow_log_buf = str_make();
+   str_appendf(flow_log_buf, "%qu,%qu,%s,",
+      (qu)r->first, (qu)r->last, addr_to_str(&(r->key.src)));
+   str_appendf(flow_log_buf, "%s,%u,%u,%u,%qu,%qu,%u\n",
+      addr_to_str(&(r->key.dst)),
+      r->key.proto, r->key.src_port, r->key.dst_port,
+      (qu)r->pkts, (qu)r->bytes, r->tcp_flags);
+   if (str_len(flow_log_buf) >= FLOW_LOG_FLUSH)
+      flow_log_flush();
+}
+
+/* ---------------------------------------------------------------------------
+ * End a flow: output it and move it to the spare list.
+ */
+static void flow_end(struct flow *f) {
+   flow_log(&(f->rec));
+   ipfix_add(&(f->rec));
+   LIST_REMOVE(f, hash_entries);
+   TAILQ_REMOVE(&flow_lru, f, lru_entries);
+   TAILQ_REMOVE(&flow_age, f, age_entries);
+   LIST_INSERT_HEAD(&flow_spare, f, hash_entries);
+   flow_count--;
+}
+
+void flow_init(const char *pattern) {
+   uint32_t i;
+
+   assert(flow_table == NULL);
+   assert(opt_flows_max > 0);
+
+   /* At most one flow per hash chain on average, when the cache is full. */
+   for (flow_bits = 1; (1U << flow_bits) < opt_flows_max &&
+        flow_bits < 31; flow_bits++)
+      ;
+   flow_table = xcalloc(1U << flow_bits, sizeof(*flow_table));
+   for (i = 0; i < (1U << flow_bits); i++)
+      LIST_INIT(&flow_table[i]);
+   flow_count = 0;
+   flow_last_expire = now_mono();
+
+   flow_log_pattern = pattern;
+   verbosef("max %u flows, idle timeout %u secs, active timeout %u secs",
+      opt_flows_max, opt_flow_idle, opt_flow_active);
+   if (opt_flow_sample > 1)
+      verbosef("flows: sampling 1 in %u packets", opt_flow_sample);
+}
+
+void flow_free(void) {
+   struct flow *f;
+
+   if (flow_table == NULL)
+      return;
+   while ((f = TAILQ_FIRST(&flow_age)) != NULL)
+      flow_end(f);
+   flow_log_flush();
+   ipfix_flush();
+   if (flow_log_fd != -1)
+      close(flow_log_fd);
+   flow_log_fd = -1;
+   free(flow_log_fn);
+   flow_log_fn = NULL;
+
+   while ((f = LIST_FIRST(&flow_spare)) != NULL) {
+      LIST_REMOVE(f, hash_entries);
+      free(f);
+   }
+   free(flow_table);
+   flow_table = NULL;
+   verbosef("flows: %llu created, ended by idle %llu, active %llu, "
+      "tcp %llu, evicted %llu", (llu)flow_stat_created, (llu)flow_stat_idle,
+      (llu)flow_stat_active, (llu)flow_stat_tcp_end, (llu)flow_stat_evicted);
+}
+
+/* ---------------------------------------------------------------------------
+ * Account for a packet.
+ */
+void flow_acct(const struct pktsummary * const sm) {
+   struct flow_key key;
+   struct flow_list *chain;
+   struct flow *f;
+
+   /* Deterministic 1-in-N sampling: only every Nth packet is counted. */
+   if (opt_flow_sample > 1) {
+      if (++flow_sample_skipped < opt_flow_sample)
+         return;
+      flow_sample_skipped = 0;
+   }
+
+   memset(&key, 0, sizeof(key));
+   key.src = sm->src;
+   key.dst = sm->dst;
+   key.proto = sm->proto;
+   if ((sm->proto == IPPROTO_TCP) || (sm->proto == IPPROTO_UDP)) {
+      key.src_port = sm->src_port;
+      key.dst_port = sm->dst_port;
+   }
+
+   chain = &flow_table[flow_hash(&key)];
+   LIST_FOREACH(f, chain, hash_entries)
+      if (flow_key_equal(&(f->rec.key), &key))
+         break;
+
+   if (f == NULL) {
+      if (flow_count >= opt_flows_max) {
+         flow_stat_evicted++;
+         flow_end(TAILQ_FIRST(&flow_lru));
+      }
+      if ((f = LIST_FIRST(&flow_spare)) != NULL)
+         LIST_REMOVE(f, hash_entries);
+      else
+         f = xmalloc(sizeof(*f));
+      memset(&(f->rec), 0, sizeof(f->rec));
+      f->rec.key = key;
+      f->rec.first = now_real();
+      f->first_mono = now_mono();
+      LIST_INSERT_HEAD(chain, f, hash_entries);
+      TAILQ_INSERT_TAIL(&flow_age, f, age_entries);
+      TAILQ_INSERT_TAIL(&flow_lru, f, lru_entries);
+      flow_count++;
+      flow_stat_created++;
+   } else if (TAILQ_NEXT(f, lru_entries) != NULL) {
+      /* Move to the most recently used end. */
+      TAILQ_REMOVE(&flow_lru, f, lru_entries);
+      TAILQ_INSERT_TAIL(&flow_lru, f, lru_entries);
+   }
+
+   f->rec.last = now_real();
+   f->last_mono = now_mono();
+   f->rec.bytes += sm->len;
+   f->rec.pkts += sm->pkts;
+   if (sm->proto == IPPROTO_TCP) {
+      f->rec.tcp_flags |= sm->tcp_flags;
+      if (sm->tcp_flags & (TH_FIN | TH_RST)) {
+         flow_stat_tcp_end++;
+         flow_end(f);
+      }
+   }
+}
+
+/* ---------------------------------------------------------------------------
+ * End flows which have timed out.  Both queues are ordered by the time we
+ * check, so we only ever look at flows which are due, plus one.
+ */
+void flow_expire(void) {
+   time_t now = now_mono();
+   struct flow *f;
+
+   if ((flow_table == NULL) || (now == flow_last_expire))
+      return;
+   flow_last_expire = now;
+
+   while (((f = TAILQ_FIRST(&flow_lru)) != NULL) &&
+          (f->last_mono + (time_t)opt_flow_idle < now)) {
+      flow_stat_idle++;
+      flow_end(f);
+   }
+   while (((f = TAILQ_FIRST(&flow_age)) != NULL) &&
+          (f->first_mono + (time_t)opt_flow_active <= now)) {
+      flow_stat_active++;
+      flow_end(f);
+   }
+   flow_log_flush();
+   ipfix_flush();
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
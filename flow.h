@@ -0,0 +1,40 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * flow.h: cache of 5-tuple flows
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_FLOW_H
+#define __DARKSTAT_FLOW_H
+
+#include "addr.h"
+
+#include <stdint.h>
+#include <time.h>
+
+struct pktsummary;
+
+/* Flows are unidirectional, like NetFlow. */
+struct flow_key {
+   struct addr src, dst;
+   uint16_t src_port, dst_port; /* only for TCP, UDP, zero otherwise */
+   uint8_t proto;
+};
+
+/* What we know about a flow when it expires. */
+struct flow_rec {
+   struct flow_key key;
+   time_t first, last; /* real time */
+   uint64_t bytes, pkts;
+   uint8_t tcp_flags; /* union of flags seen, only for TCP */
+};
+
+void flow_init(const char *log_pattern);
+void flow_free(void); /* expires all flows */
+void flow_acct(const struct pktsummary * const sm);
+void flow_expire(void); /* once per event loop */
+
+#endif /* __DARKSTAT_FLOW_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
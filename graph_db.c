@@ -3,11 +3,23 @@
  *
  * graph_db.c: round robin database for graph data
  *
+ * The graphs are a chain of tiers, each with a bar width and a number of
+ * bars, finest first.  A packet only goes into the finest tier's current
+ * bar.  When a tier moves on to a new bar, the bar it's leaving is added
+ * to the next tier's current bar, so every tier's bars are the sum of the
+ * finer tier's, without adding anything up twice.  The current bar of a
+ * tier is missing whatever is still waiting in the finer tiers' current
+ * bars, which we add back in when showing or exporting it.
+ *
  * You may use, modify and redistribute this file under the terms of the
  * GNU General Public License version 2. (see COPYING.GPL)
  */
 
+#define _GNU_SOURCE 1 /* for O_NOFOLLOW on Linux */
+
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cap.h"
 #include "conv.h"
@@ -16,97 +28,569 @@
 #include "err.h"
 #include "str.h"
 #include "html.h"
+#include "json.h"
 #include "graph_db.h"
+#include "hll.h" /* for hll_hash */
 #include "now.h"
 #include "opt.h"
 
 #include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h> /* for offsetof() */
+#include <stdio.h> /* for snprintf() */
 #include <stdlib.h>
 #include <string.h> /* for memcpy() */
 #include <time.h>
+#include <unistd.h>
 
 #define GRAPH_WIDTH "320"
 #define GRAPH_HEIGHT "200"
 
+#define SEC_MS  1000
+#define MIN_MS  (60 * SEC_MS)
+#define HOUR_MS (60 * MIN_MS)
+#define DAY_MS  (24 * (int64_t)HOUR_MS)
+
 struct graph {
-   uint64_t *in, *out;
-   unsigned int offset; /* i.e. seconds start at 0, days start at 1 */
-   unsigned int pos, num_bars;
-   const char *unit;
-   unsigned int bar_secs; /* one bar represents <n> seconds */
+   uint64_t *in, *out; /* num_bars of the totals, maybe in the graph store */
+   int64_t bar; /* which bar we're in, counting from the epoch */
+   unsigned int pos, num_bars; /* pos is bar % num_bars */
+   char unit[16]; /* XML element */
+   uint64_t bar_ms; /* one bar represents <n> milliseconds */
+   char title[40];
+   uint64_t *vlan_in, *vlan_out; /* num_bars for each series after 0 */
+};
+
+#define MAX_TIERS 8
+#define DEFAULT_TIERS "1s:60,1m:60,1h:24,1d:31"
+
+static struct graph graph_db[MAX_TIERS];
+static unsigned int graph_db_size = 0;
+static time_t start_mono, start_real;
+
+static int64_t last_ms; /* how far the graphs have moved, 0 before we start */
+static time_t tz_when;  /* when we last looked at the timezone */
+static int64_t tz_ms;   /* local time minus UTC */
+
+/* With --vlans, every VLAN gets its own series of graphs, and totals. */
+#define MAX_VLAN 4095
+struct series {
+   uint16_t vlan;
+   uint64_t in, out;    /* bytes, as graphed */
+   uint64_t bytes, pkts; /* everything on the VLAN */
 };
+static struct series *series = NULL;
+static unsigned int num_series = 1, max_series = 1;
+static uint16_t vlan_series[MAX_VLAN + 1]; /* 0 means no series yet */
+
+/* The bars of series s. */
+static uint64_t *series_in(const struct graph *g, const unsigned int s) {
+   return (s == 0) ? g->in : g->vlan_in + (s - 1) * g->num_bars;
+}
 
-static struct graph
-   graph_secs = {NULL, NULL, 0, 0, 60, "seconds", 1},
-   graph_mins = {NULL, NULL, 0, 0, 60, "minutes", 60},
-   graph_hrs  = {NULL, NULL, 0, 0, 24, "hours",   3600},
-   graph_days = {NULL, NULL, 1, 0, 31, "days",    86400};
+static uint64_t *series_out(const struct graph *g, const unsigned int s) {
+   return (s == 0) ? g->out : g->vlan_out + (s - 1) * g->num_bars;
+}
 
-static struct graph *graph_db[] = {
-   &graph_secs, &graph_mins, &graph_hrs, &graph_days
+/* With --graph-store, the bars of the totals live in a file mapped into
+ * memory, so they're saved as soon as they change, and picked up again at
+ * startup without parsing anything.  The header has the rest: where each
+ * tier is up to, and the total counters.  It's rewritten whenever a tier
+ * moves on, and every second for the counters, so a crash loses no more
+ * than a second of those.  The checksum catches a header that was only
+ * half written.
+ *
+ * The file is in host byte order, and isn't meant to be portable: that's
+ * what --export is for.  VLAN graphs aren't kept in it.
+ */
+#define STORE_VERSION 1
+struct store_header {
+   char magic[4]; /* "DSGS" */
+   uint32_t version, num_tiers, unused;
+   int64_t last_ms;
+   uint64_t total_bytes, total_packets;
+   struct {
+      uint64_t bar_ms;
+      int64_t bar;
+      uint32_t num_bars, pos;
+   } tier[MAX_TIERS];
+   uint64_t checksum; /* hll_hash() of everything before it */
+};
+static struct store_header *store = NULL;
+static size_t store_size;
+
+/* With --host-graphs, that many hosts also get graphs of their last hour
+ * and day.  Their bars live in one arena, indexed by the host's graph slot,
+ * and are only brought up to date when they're touched, so a quiet host
+ * costs nothing.
+ */
+#define HOST_MINS 60
+#define HOST_HRS 24
+struct host_graph {
+   time_t min_start; /* real time at the start of the current minute bar */
+   time_t hr_start;  /* and hour bar */
+   uint64_t min_in[HOST_MINS], min_out[HOST_MINS];
+   uint64_t hr_in[HOST_HRS], hr_out[HOST_HRS];
+};
+static struct host_graph *host_graphs = NULL;
+
+static const struct graph host_graph_db[] = { /* just the shape */
+   {NULL, NULL, 0, 0, HOST_MINS, "minutes", MIN_MS,  "last 60 minutes",
+    NULL, NULL},
+   {NULL, NULL, 0, 0, HOST_HRS,  "hours",   HOUR_MS, "last 24 hours",
+    NULL, NULL}
+};
+
+/* Where the current bars are, so we call localtime() once a second rather
+ * than once a packet.
+ */
+static struct {
+   time_t now, min_start, hr_start;
+   unsigned int min_pos, hr_pos;
+} host_clock;
+
+/* ---------------------------------------------------------------------------
+ * Tiers, from --graph-tiers.
+ */
+static const struct {
+   const char *suffix, *name;
+   uint64_t ms;
+} tier_units[] = {
+   { "ms", NULL,      1 },
+   { "s",  "seconds", SEC_MS },
+   { "m",  "minutes", MIN_MS },
+   { "h",  "hours",   HOUR_MS },
+   { "d",  "days",    DAY_MS }
 };
 
-static unsigned int graph_db_size = sizeof(graph_db)/sizeof(*graph_db);
-static time_t start_mono, start_real, last_real;
+/* Parses one "<width><unit>:<bars>" into g, returns where it stopped. */
+static const char *parse_tier(const char *spec, struct graph *g,
+                              const unsigned int num) {
+   const char *p = spec;
+   char *end;
+   unsigned long width, bars;
+   unsigned int u;
+   size_t len = 0;
+
+   width = strtoul(p, &end, 10);
+   for (u=0; u<sizeof(tier_units)/sizeof(*tier_units); u++) {
+      len = strlen(tier_units[u].suffix);
+      if (strncmp(end, tier_units[u].suffix, len) == 0 && end[len] == ':')
+         break;
+   }
+   if (end == p || width == 0 || width > 1000000 ||
+       u == sizeof(tier_units)/sizeof(*tier_units))
+      errx(1, "--graph-tiers: bad bar width at \"%s\", "
+              "expecting something like 100ms, 1s, 5m, 1h or 1d", p);
+   p = end + len + 1;
+   bars = strtoul(p, &end, 10);
+   if (end == p || bars == 0 || bars > 65535 ||
+       (*end != ',' && *end != '\0'))
+      errx(1, "--graph-tiers: bad number of bars at \"%s\"", p);
+
+   memset(g, 0, sizeof(*g));
+   g->bar_ms = (uint64_t)width * tier_units[u].ms;
+   g->num_bars = (unsigned int)bars;
+   if (width == 1 && tier_units[u].name != NULL) {
+      snprintf(g->unit, sizeof(g->unit), "%s", tier_units[u].name);
+      snprintf(g->title, sizeof(g->title), "last %u %s",
+               (unsigned int)bars, tier_units[u].name);
+   } else {
+      snprintf(g->unit, sizeof(g->unit), "tier%u", num);
+      snprintf(g->title, sizeof(g->title), "last %u bars of %u%s",
+               (unsigned int)bars, (unsigned int)width, tier_units[u].suffix);
+   }
+   return end;
+}
+
+void graph_tiers(const char *spec) {
+   const char *p = spec;
+
+   graph_db_size = 0;
+   for (;;) {
+      struct graph *g;
+
+      if (graph_db_size == MAX_TIERS)
+         errx(1, "--graph-tiers: there can't be more than %d tiers",
+              MAX_TIERS);
+      g = &graph_db[graph_db_size];
+      p = parse_tier(p, g, graph_db_size);
+      if (graph_db_size > 0) {
+         const struct graph *finer = &graph_db[graph_db_size - 1];
+
+         if (g->bar_ms <= finer->bar_ms || g->bar_ms % finer->bar_ms != 0)
+            errx(1, "--graph-tiers: every bar width must be a multiple "
+                    "of the one before it");
+      }
+      graph_db_size++;
+      if (*p == '\0')
+         break;
+      p++; /* skip the comma */
+   }
+}
+
+/* Bars of a day or longer start at local midnight, the rest are aligned to
+ * UTC, which is the same thing unless the timezone is something odd.
+ */
+static int is_daily(const struct graph *g) {
+   return (g->bar_ms % DAY_MS == 0);
+}
+
+static int64_t bar_at(const struct graph *g, const int64_t ms) {
+   if (is_daily(g))
+      return (ms + tz_ms) / (int64_t)g->bar_ms;
+   return ms / (int64_t)g->bar_ms;
+}
+
+/* Works out tz_ms without timegm() or tm_gmtoff, which aren't portable. */
+static void tz_update(const time_t t) {
+   struct tm *tm;
+   int64_t d;
+
+   if (t == tz_when)
+      return;
+   tz_when = t;
+   tm = localtime(&t);
+   d = tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec - (int64_t)(t % 86400);
+   if (d > 14 * 3600)
+      d -= 86400;
+   else if (d < -14 * 3600)
+      d += 86400;
+   tz_ms = d * SEC_MS;
+}
+
+/* The totals are allocated once, in graph_init(), this is for the VLANs. */
+static void alloc_series(void) {
+   unsigned int i;
+
+   if (max_series > 1)
+      for (i=0; i<graph_db_size; i++) {
+         size_t size =
+            sizeof(uint64_t) * graph_db[i].num_bars * (max_series - 1);
+         graph_db[i].vlan_in  = xrealloc(graph_db[i].vlan_in, size);
+         graph_db[i].vlan_out = xrealloc(graph_db[i].vlan_out, size);
+      }
+   series = xrealloc(series, sizeof(*series) * max_series);
+}
+
+/* ---------------------------------------------------------------------------
+ * The graph store, from --graph-store.
+ */
+static void store_sync(void) {
+   unsigned int i;
+
+   if (store == NULL)
+      return;
+   store->last_ms = last_ms;
+   store->total_bytes = acct_total_bytes;
+   store->total_packets = acct_total_packets;
+   for (i=0; i<graph_db_size; i++) {
+      store->tier[i].bar = graph_db[i].bar;
+      store->tier[i].pos = graph_db[i].pos;
+   }
+   store->checksum = hll_hash(store, offsetof(struct store_header, checksum));
+}
+
+/* Returns 1 if the header is ours, and matches the tiers we have. */
+static int store_valid(void) {
+   unsigned int i;
+
+   if (memcmp(store->magic, "DSGS", sizeof(store->magic)) != 0 ||
+       store->version != STORE_VERSION ||
+       store->num_tiers != graph_db_size ||
+       store->checksum !=
+          hll_hash(store, offsetof(struct store_header, checksum)))
+      return 0;
+   for (i=0; i<graph_db_size; i++)
+      if (store->tier[i].bar_ms != graph_db[i].bar_ms ||
+          store->tier[i].num_bars != graph_db[i].num_bars ||
+          store->tier[i].bar < 0 ||
+          store->tier[i].pos != store->tier[i].bar % graph_db[i].num_bars)
+         return 0;
+   return 1;
+}
+
+/* Maps the store, and moves the totals' bars into it.  If it has bars from
+ * last time, we carry on from there.
+ */
+static void store_open(const char *filename) {
+   struct stat st;
+   uint64_t *bars;
+   unsigned int i;
+   int fd;
+
+   store_size = sizeof(struct store_header);
+   for (i=0; i<graph_db_size; i++)
+      store_size += 2 * sizeof(uint64_t) * graph_db[i].num_bars;
+
+   fd = open(filename, O_RDWR | O_CREAT | O_NOFOLLOW, 0600);
+   if (fd == -1)
+      err(1, "can't open graph store \"%s\"", filename);
+   if (fstat(fd, &st) == -1)
+      err(1, "fstat(\"%s\") failed", filename);
+   if (st.st_size != (off_t)store_size) {
+      if (st.st_size != 0)
+         warnx("graph store \"%s\" is the wrong size, starting afresh",
+               filename);
+      if (ftruncate(fd, 0) == -1 || ftruncate(fd, (off_t)store_size) == -1)
+         err(1, "can't resize graph store \"%s\"", filename);
+   }
+   store = mmap(NULL, store_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (store == MAP_FAILED)
+      err(1, "can't mmap graph store \"%s\"", filename);
+   close(fd);
+
+   bars = (uint64_t *)(store + 1);
+   for (i=0; i<graph_db_size; i++) {
+      struct graph *g = &graph_db[i];
+
+      free(g->in);
+      free(g->out);
+      g->in = bars;
+      g->out = bars + g->num_bars;
+      bars += 2 * g->num_bars;
+   }
+
+   if (store_valid()) {
+      verbosef("carrying on from graph store \"%s\"", filename);
+      last_ms = store->last_ms;
+      acct_total_bytes = store->total_bytes;
+      acct_total_packets = store->total_packets;
+      for (i=0; i<graph_db_size; i++) {
+         graph_db[i].bar = store->tier[i].bar;
+         graph_db[i].pos = store->tier[i].pos;
+      }
+      return;
+   }
+
+   if (st.st_size == (off_t)store_size)
+      warnx("graph store \"%s\" doesn't match --graph-tiers or is damaged, "
+            "starting afresh", filename);
+   memset(store, 0, store_size);
+   memcpy(store->magic, "DSGS", sizeof(store->magic));
+   store->version = STORE_VERSION;
+   store->num_tiers = graph_db_size;
+   for (i=0; i<graph_db_size; i++) {
+      store->tier[i].bar_ms = graph_db[i].bar_ms;
+      store->tier[i].num_bars = graph_db[i].num_bars;
+   }
+   store_sync();
+}
+
+static void store_close(void) {
+   unsigned int i;
+
+   if (store == NULL)
+      return;
+   store_sync();
+   if (msync(store, store_size, MS_SYNC) == -1)
+      warn("msync() of graph store failed");
+   munmap(store, store_size);
+   store = NULL;
+   for (i=0; i<graph_db_size; i++)
+      graph_db[i].in = graph_db[i].out = NULL;
+}
 
 void graph_init(void) {
    unsigned int i;
+
+   if (graph_db_size == 0)
+      graph_tiers(DEFAULT_TIERS);
    for (i=0; i<graph_db_size; i++) {
-      graph_db[i]->in  = xmalloc(sizeof(uint64_t) * graph_db[i]->num_bars);
-      graph_db[i]->out = xmalloc(sizeof(uint64_t) * graph_db[i]->num_bars);
+      graph_db[i].in  = xcalloc(graph_db[i].num_bars, sizeof(uint64_t));
+      graph_db[i].out = xcalloc(graph_db[i].num_bars, sizeof(uint64_t));
    }
+   alloc_series();
+   if (opt_host_graphs != 0)
+      host_graphs = xcalloc(opt_host_graphs, sizeof(*host_graphs));
    graph_reset();
+   if (opt_graph_store != NULL)
+      store_open(opt_graph_store);
 }
 
 static void zero_graph(struct graph *g) {
    memset(g->in,  0, sizeof(uint64_t) * g->num_bars);
    memset(g->out, 0, sizeof(uint64_t) * g->num_bars);
+   if (num_series > 1) {
+      memset(g->vlan_in,  0, sizeof(uint64_t) * g->num_bars * (num_series-1));
+      memset(g->vlan_out, 0, sizeof(uint64_t) * g->num_bars * (num_series-1));
+   }
 }
 
 void graph_reset(void) {
    unsigned int i;
 
+   /* Forget all the VLANs. */
+   num_series = 1;
+   memset(vlan_series, 0, sizeof(vlan_series));
+   memset(series, 0, sizeof(*series));
+
    for (i=0; i<graph_db_size; i++)
-      zero_graph(graph_db[i]);
+      zero_graph(&graph_db[i]);
 
    /* Reset starting time. */
    start_mono = now_mono();
    start_real = now_real();
-   last_real = 0;
+   last_ms = 0;
+   tz_when = 0;
+   tz_update(start_real);
 
    /* Clear counters. */
    acct_total_bytes = 0;
    acct_total_packets = 0;
+   store_sync();
 }
 
 void graph_free(void) {
    unsigned int i;
 
+   store_close();
    for (i=0; i<graph_db_size; i++) {
-      free(graph_db[i]->in);
-      free(graph_db[i]->out);
+      free(graph_db[i].in);
+      free(graph_db[i].out);
+      free(graph_db[i].vlan_in);
+      free(graph_db[i].vlan_out);
+      graph_db[i].in = graph_db[i].out = NULL;
+      graph_db[i].vlan_in = graph_db[i].vlan_out = NULL;
    }
+   free(series);
+   series = NULL;
+   num_series = max_series = 1;
+   free(host_graphs);
+   host_graphs = NULL;
 }
 
-void graph_acct(uint64_t amount, enum graph_dir dir) {
+/* Start the graphs at time ms, with nothing in them. */
+static void graph_start(const int64_t ms) {
    unsigned int i;
-   for (i=0; i<graph_db_size; i++)
-      if (dir == GRAPH_IN) {
-         graph_db[i]->in[  graph_db[i]->pos ] += amount;
-      } else {
-         assert(dir == GRAPH_OUT);
-         graph_db[i]->out[ graph_db[i]->pos ] += amount;
+
+   verbosef("first rotate");
+   last_ms = ms;
+   for (i=0; i<graph_db_size; i++) {
+      struct graph *g = &graph_db[i];
+
+      g->bar = bar_at(g, ms);
+      g->pos = (unsigned int)(g->bar % g->num_bars);
+   }
+}
+
+/* Move the graphs forward to time ms, finest tier first: as each tier
+ * leaves its current bar, that bar is added to the next tier's current bar,
+ * and the bars we move into are zeroed.
+ */
+static void advance(const int64_t ms) {
+   unsigned int i, s;
+   int moved = 0;
+
+   if (ms <= last_ms)
+      return;
+   last_ms = ms;
+   for (i=0; i<graph_db_size; i++) {
+      struct graph *g = &graph_db[i];
+      const int64_t bar = bar_at(g, ms);
+      int64_t n;
+
+      if (bar <= g->bar)
+         continue;
+      moved = 1;
+      if (i + 1 < graph_db_size) {
+         struct graph *up = &graph_db[i + 1];
+
+         for (s=0; s<num_series; s++) {
+            series_in(up, s)[up->pos] += series_in(g, s)[g->pos];
+            series_out(up, s)[up->pos] += series_out(g, s)[g->pos];
+         }
+      }
+      n = bar - g->bar;
+      if (n > (int64_t)g->num_bars)
+         n = g->num_bars;
+      for (; n > 0; n--) {
+         g->pos = (g->pos + 1) % g->num_bars;
+         for (s=0; s<num_series; s++)
+            series_in(g, s)[g->pos] = series_out(g, s)[g->pos] = 0;
       }
+      g->bar = bar;
+      g->pos = (unsigned int)(bar % g->num_bars);
+   }
+   if (moved)
+      store_sync();
 }
 
-/* Advance a graph: advance the pos, zeroing out bars as we move. */
-static void advance(struct graph *g, const unsigned int pos) {
-   if (g->pos == pos)
-      return; /* didn't need to advance */
-   do {
-      g->pos = (g->pos + 1) % g->num_bars;
-      g->in[g->pos] = g->out[g->pos] = 0;
-   } while (g->pos != pos);
+/* Adds to the bars that time ms falls in.  Usually that's the finest tier's
+ * current bar, and we're done.  A late packet goes into a bar that's been
+ * left behind, and then into the next tier up, until we reach a tier where
+ * it's in the current bar.
+ */
+static void series_acct(const unsigned int s, const int64_t ms,
+                        uint64_t amount, enum graph_dir dir) {
+   unsigned int i;
+
+   for (i=0; i<graph_db_size; i++) {
+      struct graph *g = &graph_db[i];
+      const int64_t bar = bar_at(g, ms);
+
+      if (g->bar - bar < (int64_t)g->num_bars) {
+         const unsigned int j = (unsigned int)(bar % g->num_bars);
+
+         if (dir == GRAPH_IN) {
+            series_in(g, s)[j] += amount;
+         } else {
+            assert(dir == GRAPH_OUT);
+            series_out(g, s)[j] += amount;
+         }
+      }
+      if (bar >= g->bar)
+         break;
+   }
+}
+
+void graph_acct(uint64_t amount, enum graph_dir dir, const uint16_t vlan,
+                const int64_t ms) {
+   int64_t t = ms;
+
+   if (t == 0)
+      t = (last_ms != 0) ? last_ms : (int64_t)now_real() * SEC_MS;
+   if (last_ms == 0)
+      graph_start(t);
+   advance(t);
+
+   series_acct(0, t, amount, dir);
+   if (vlan != 0) {
+      const unsigned int s = vlan_series[vlan];
+
+      assert(s != 0);
+      series_acct(s, t, amount, dir);
+      if (dir == GRAPH_IN)
+         series[s].in += amount;
+      else
+         series[s].out += amount;
+   }
+}
+
+void graph_acct_vlan(const uint16_t vlan, uint64_t bytes, uint64_t pkts) {
+   unsigned int i, s;
+
+   assert(vlan != 0 && vlan <= MAX_VLAN);
+   s = vlan_series[vlan];
+   if (s == 0) {
+      if (num_series == max_series) {
+         max_series *= 2;
+         alloc_series();
+      }
+      s = num_series++;
+      vlan_series[vlan] = (uint16_t)s;
+      memset(&series[s], 0, sizeof(series[s]));
+      series[s].vlan = vlan;
+      for (i=0; i<graph_db_size; i++) {
+         struct graph *g = &graph_db[i];
+
+         memset(series_in(g, s),  0, sizeof(uint64_t) * g->num_bars);
+         memset(series_out(g, s), 0, sizeof(uint64_t) * g->num_bars);
+      }
+   }
+   series[s].bytes += bytes;
+   series[s].pkts += pkts;
 }
 
 /* Rotate a graph: rotate all bars so that the bar at the current pos is moved
@@ -114,7 +598,7 @@ static void advance(struct graph *g, const unsigned int pos) {
  */
 static void rotate(struct graph *g, const unsigned int pos) {
    uint64_t *tmp;
-   unsigned int i, ofs;
+   unsigned int i, s, ofs;
    size_t size;
 
    if (pos == g->pos)
@@ -124,13 +608,17 @@ static void rotate(struct graph *g, const unsigned int pos) {
    tmp = xmalloc(size);
    ofs = g->num_bars + pos - g->pos;
 
-   for (i=0; i<g->num_bars; i++)
-      tmp[ (i+ofs) % g->num_bars ] = g->in[i];
-   memcpy(g->in, tmp, size);
+   for (s=0; s<num_series; s++) {
+      uint64_t *in = series_in(g, s), *out = series_out(g, s);
 
-   for (i=0; i<g->num_bars; i++)
-      tmp[ (i+ofs) % g->num_bars ] = g->out[i];
-   memcpy(g->out, tmp, size);
+      for (i=0; i<g->num_bars; i++)
+         tmp[ (i+ofs) % g->num_bars ] = in[i];
+      memcpy(in, tmp, size);
+
+      for (i=0; i<g->num_bars; i++)
+         tmp[ (i+ofs) % g->num_bars ] = out[i];
+      memcpy(out, tmp, size);
+   }
 
    free(tmp);
    assert(g->num_bars > 0);
@@ -138,8 +626,8 @@ static void rotate(struct graph *g, const unsigned int pos) {
    g->pos = pos;
 }
 
-static void graph_resync(const time_t new_real) {
-   struct tm *tm;
+static void graph_resync(const int64_t new_ms) {
+   unsigned int i;
    /*
     * If real time went backwards, we assume that the time adjustment should
     * only affect display.  i.e., if we have:
@@ -161,64 +649,190 @@ static void graph_resync(const time_t new_real) {
     * We rely on graph advancement to happen at the correct real time to
     * account for, for example, bandwidth used per day.
     */
-   assert(new_real < last_real);
-
-   tm = localtime(&new_real);
-   if (tm->tm_sec == 60)
-      tm->tm_sec = 59; /* mis-handle leap seconds */
+   assert(new_ms < last_ms);
 
-   rotate(&graph_secs, tm->tm_sec);
-   rotate(&graph_mins, tm->tm_min);
-   rotate(&graph_hrs, tm->tm_hour);
-   rotate(&graph_days, tm->tm_mday - 1);
+   for (i=0; i<graph_db_size; i++) {
+      struct graph *g = &graph_db[i];
 
-   last_real = new_real;
+      g->bar = bar_at(g, new_ms);
+      rotate(g, (unsigned int)(g->bar % g->num_bars));
+   }
+   last_ms = new_ms;
 }
 
+/* Called about once a second.  Bars shorter than that move forward with the
+ * packet timestamps, or when the graphs are looked at.
+ */
 void graph_rotate(void) {
-   time_t t, td;
+   static time_t synced = 0;
+   const time_t t = now_real();
+   const int64_t ms = (int64_t)t * SEC_MS;
+
+   tz_update(t);
+   if (last_ms == 0)
+      graph_start(ms);
+   else if (ms + 2 * SEC_MS < last_ms) {
+      /* Packet timestamps can be up to a second ahead of now_real(). */
+      verbosef("graph_db: realtime went backwards! "
+               "(from %lld to %lld ms)", (lld)last_ms, (lld)ms);
+      graph_resync(ms);
+   } else
+      advance(ms);
+
+   if (t != synced) {
+      synced = t;
+      store_sync(); /* for the counters */
+   }
+}
+
+/* ---------------------------------------------------------------------------
+ * Per-host graphs.
+ */
+static void host_clock_update(void) {
+   const time_t t = now_real();
    struct tm *tm;
-   unsigned int i;
 
-   t = now_real();
-   td = t - last_real;
+   if (t == host_clock.now)
+      return;
+   tm = localtime(&t);
+   host_clock.now = t;
+   host_clock.min_start = t - tm->tm_sec;
+   host_clock.hr_start = host_clock.min_start - tm->tm_min * 60;
+   host_clock.min_pos = (unsigned int)tm->tm_min;
+   host_clock.hr_pos = (unsigned int)tm->tm_hour;
+}
 
-   if (last_real == 0) {
-      verbosef("first rotate");
-      last_real = t;
-      tm = localtime(&t);
-      graph_secs.pos = tm->tm_sec;
-      graph_mins.pos = tm->tm_min;
-      graph_hrs.pos = tm->tm_hour;
-      graph_days.pos = tm->tm_mday - 1;
+static struct host_graph *get_host_graph(const unsigned int slot) {
+   assert(host_graphs != NULL);
+   assert(slot >= 1 && slot <= opt_host_graphs);
+   return &host_graphs[slot - 1];
+}
+
+/* Zero the bars that time has moved past, up to and including the current
+ * one at pos.  If time went backwards, keep everything.
+ */
+static void host_ring_advance(uint64_t *in, uint64_t *out,
+                              const unsigned int num_bars,
+                              const unsigned int pos, time_t *start,
+                              const time_t new_start,
+                              const unsigned int bar_secs) {
+   unsigned int i, n;
+
+   if (new_start == *start)
       return;
+   if (new_start > *start) {
+      n = (new_start - *start >= (time_t)(num_bars * bar_secs))
+          ? num_bars : (unsigned int)((new_start - *start) / bar_secs);
+      if (n == 0)
+         n = 1; /* e.g. DST changed, but we're in a new bar */
+      for (i = 0; i < n; i++) {
+         const unsigned int j = (pos + num_bars - i) % num_bars;
+         in[j] = out[j] = 0;
+      }
    }
+   *start = new_start;
+}
 
-   if (t == last_real)
-      return; /* time has not advanced a full second, don't rotate */
+/* Bring a host's graphs up to now. */
+static void host_graph_sync(struct host_graph *hg) {
+   host_clock_update();
+   host_ring_advance(hg->min_in, hg->min_out, HOST_MINS, host_clock.min_pos,
+                     &hg->min_start, host_clock.min_start, 60);
+   host_ring_advance(hg->hr_in, hg->hr_out, HOST_HRS, host_clock.hr_pos,
+                     &hg->hr_start, host_clock.hr_start, 3600);
+}
 
-   if (t < last_real) {
-      verbosef("graph_db: realtime went backwards! "
-               "(from %ld to %ld, offset is %ld)",
-               last_real, t, td);
-      graph_resync(t);
-      return;
+void graph_host_clear(const unsigned int slot) {
+   struct host_graph *hg = get_host_graph(slot);
+
+   memset(hg, 0, sizeof(*hg));
+   host_clock_update();
+   hg->min_start = host_clock.min_start;
+   hg->hr_start = host_clock.hr_start;
+}
+
+void graph_host_acct(const unsigned int slot, const uint64_t in,
+                     const uint64_t out) {
+   struct host_graph *hg = get_host_graph(slot);
+
+   host_graph_sync(hg);
+   hg->min_in[host_clock.min_pos] += in;
+   hg->min_out[host_clock.min_pos] += out;
+   hg->hr_in[host_clock.hr_pos] += in;
+   hg->hr_out[host_clock.hr_pos] += out;
+}
+
+/* Bars are written oldest first, so the last one is the current one. */
+static int host_ring_export(const int fd, const uint64_t *in,
+                            const uint64_t *out, const unsigned int num_bars,
+                            const unsigned int pos) {
+   unsigned int i;
+
+   for (i = 1; i <= num_bars; i++) {
+      const unsigned int j = (pos + i) % num_bars;
+
+      if (!write64(fd, in[j])) return 0;
+      if (!write64(fd, out[j])) return 0;
    }
+   return 1;
+}
 
-   /* else, normal rotation */
-   last_real = t;
-   tm = localtime(&t);
+int graph_host_export(const int fd, const unsigned int slot) {
+   struct host_graph *hg = get_host_graph(slot);
 
-   /* zero out graphs which have been completely rotated through */
-   for (i=0; i<graph_db_size; i++)
-      if (td >= (int)(graph_db[i]->num_bars * graph_db[i]->bar_secs))
-         zero_graph(graph_db[i]);
+   host_graph_sync(hg);
+   if (!write64(fd, (uint64_t)hg->min_start)) return 0;
+   if (!host_ring_export(fd, hg->min_in, hg->min_out, HOST_MINS,
+                         host_clock.min_pos)) return 0;
+   if (!host_ring_export(fd, hg->hr_in, hg->hr_out, HOST_HRS,
+                         host_clock.hr_pos)) return 0;
+   return 1;
+}
+
+static int host_ring_import(const int fd, uint64_t *in, uint64_t *out,
+                            const unsigned int num_bars,
+                            const unsigned int pos) {
+   unsigned int i;
+   uint64_t bin, bout;
+
+   for (i = 1; i <= num_bars; i++) {
+      const unsigned int j = (pos + i) % num_bars;
 
-   /* advance the current position, zeroing up to it */
-   advance(&graph_secs, tm->tm_sec);
-   advance(&graph_mins, tm->tm_min);
-   advance(&graph_hrs, tm->tm_hour);
-   advance(&graph_days, tm->tm_mday - 1);
+      if (!read64(fd, &bin)) return 0;
+      if (!read64(fd, &bout)) return 0;
+      if (in != NULL) {
+         in[j] = bin;
+         out[j] = bout;
+      }
+   }
+   return 1;
+}
+
+/* A slot of 0 reads the graphs and throws them away. */
+int graph_host_import(const int fd, const unsigned int slot) {
+   struct host_graph *hg = (slot == 0) ? NULL : get_host_graph(slot);
+   uint64_t last;
+   time_t t;
+   struct tm *tm;
+   unsigned int min_pos = 0, hr_pos = 0;
+
+   if (!read64(fd, &last)) return 0;
+   if (hg != NULL) {
+      /* Lay the bars out as they were at the time, then catch up. */
+      t = (time_t)last;
+      tm = localtime(&t);
+      min_pos = (unsigned int)tm->tm_min;
+      hr_pos = (unsigned int)tm->tm_hour;
+      hg->min_start = t - tm->tm_sec;
+      hg->hr_start = hg->min_start - tm->tm_min * 60;
+   }
+   if (!host_ring_import(fd, hg ? hg->min_in : NULL, hg ? hg->min_out : NULL,
+                         HOST_MINS, min_pos)) return 0;
+   if (!host_ring_import(fd, hg ? hg->hr_in : NULL, hg ? hg->hr_out : NULL,
+                         HOST_HRS, hr_pos)) return 0;
+   if (hg != NULL)
+      host_graph_sync(hg);
+   return 1;
 }
 
 /* ---------------------------------------------------------------------------
@@ -227,43 +841,128 @@ void graph_rotate(void) {
  * This function will retrieve the data sans the header.  We expect the caller
  * to have validated the header of the segment, and left the file position at
  * the start of the data.
+ *
+ * Version 1 has the four graphs we used to have, version 2 has any tiers.
+ * A tier is only imported if we have one with the same bar width and number
+ * of bars.  Bars are exported as shown, so the current bars include what
+ * was still waiting in the finer tiers.
  */
-int graph_import(const int fd) {
+static struct graph *find_tier(const uint64_t bar_ms,
+                               const unsigned int num_bars) {
+   unsigned int i;
+
+   for (i=0; i<graph_db_size; i++)
+      if (graph_db[i].bar_ms == bar_ms && graph_db[i].num_bars == num_bars)
+         return &graph_db[i];
+   return NULL;
+}
+
+static int import_tier(const int fd, const uint64_t bar_ms,
+                       const unsigned int num_bars, const unsigned int pos,
+                       int *imported) {
+   struct graph *g = find_tier(bar_ms, num_bars);
+   unsigned int j;
+   uint64_t in, out;
+
+   verbosef("at file pos %u, importing graph of %u bars of %llu ms",
+      xtell(fd), num_bars, (llu)bar_ms);
+
+   if (pos >= num_bars) {
+      warn("pos is %u, should be < num_bars which is %u", pos, num_bars);
+      return 0;
+   }
+   if (g == NULL)
+      verbosef("no such tier in --graph-tiers, skipping it");
+   else {
+      g->pos = pos;
+      imported[g - graph_db] = 1;
+   }
+   for (j=0; j<num_bars; j++) {
+      if (!read64(fd, &in)) return 0;
+      if (!read64(fd, &out)) return 0;
+      if (g != NULL) {
+         g->in[j] = in;
+         g->out[j] = out;
+      }
+   }
+   return 1;
+}
+
+int graph_import(const int fd, const int ver) {
+   static const uint64_t v1_ms[] = { SEC_MS, MIN_MS, HOUR_MS, DAY_MS };
+   static const unsigned int v1_bars[] = { 60, 60, 24, 31 };
+   int imported[MAX_TIERS];
    uint64_t last;
-   unsigned int i, j;
+   unsigned int i, num_tiers;
 
+   memset(imported, 0, sizeof(imported));
    if (!read64(fd, &last)) return 0;
-   last_real = last;
+   if (ver == 1) {
+      last *= SEC_MS;
+      num_tiers = 4;
+   } else {
+      uint8_t n;
 
-   for (i=0; i<graph_db_size; i++) {
-      unsigned char num_bars, pos;
-      unsigned int filepos = xtell(fd);
+      if (!read8(fd, &n)) return 0;
+      num_tiers = n;
+   }
 
-      if (!read8(fd, &num_bars)) return 0;
-      if (!read8(fd, &pos)) return 0;
+   for (i=0; i<num_tiers; i++) {
+      uint64_t bar_ms;
+      unsigned int num_bars, pos;
 
-      verbosef("at file pos %u, importing graph with %u bars",
-         filepos, (unsigned int)num_bars);
+      if (ver == 1) {
+         uint8_t b, p;
 
-      if (pos >= num_bars) {
-         warn("pos is %u, should be < num_bars which is %u",
-            (unsigned int)pos, (unsigned int)num_bars);
-         return 0;
-      }
+         if (!read8(fd, &b)) return 0;
+         if (!read8(fd, &p)) return 0;
+         if (b != v1_bars[i]) {
+            warn("num_bars is %u, expecting %u", (unsigned int)b, v1_bars[i]);
+            return 0;
+         }
+         bar_ms = v1_ms[i];
+         num_bars = b;
+         pos = p;
+      } else {
+         uint16_t b, p;
 
-      if (graph_db[i]->num_bars != num_bars) {
-         warn("num_bars is %u, expecting %u",
-            (unsigned int)num_bars, graph_db[i]->num_bars);
-         return 0;
+         if (!read64(fd, &bar_ms)) return 0;
+         if (!read16(fd, &b)) return 0;
+         if (!read16(fd, &p)) return 0;
+         num_bars = b;
+         pos = p;
       }
+      if (!import_tier(fd, bar_ms, num_bars, pos, imported)) return 0;
+   }
 
-      graph_db[i]->pos = pos;
-      for (j=0; j<num_bars; j++) {
-         if (!read64(fd, &(graph_db[i]->in[j]))) return 0;
-         if (!read64(fd, &(graph_db[i]->out[j]))) return 0;
+   /* Line the tiers up at the time of the export, and what didn't come from
+    * the file starts out empty.
+    */
+   last_ms = (int64_t)last;
+   for (i=0; i<graph_db_size; i++) {
+      struct graph *g = &graph_db[i];
+
+      g->bar = bar_at(g, last_ms);
+      if (imported[i])
+         rotate(g, (unsigned int)(g->bar % g->num_bars));
+      else {
+         zero_graph(g);
+         g->pos = (unsigned int)(g->bar % g->num_bars);
       }
    }
 
+   /* Take what's waiting in the finer tiers back out of the current bars.
+    * Coarsest first, so the finer tier still has its whole current bar.
+    */
+   for (i=graph_db_size - 1; i>0; i--) {
+      struct graph *g = &graph_db[i];
+      const struct graph *finer = &graph_db[i - 1];
+      const uint64_t fin = finer->in[finer->pos], fout = finer->out[finer->pos];
+
+      g->in[g->pos] -= (g->in[g->pos] < fin) ? g->in[g->pos] : fin;
+      g->out[g->pos] -= (g->out[g->pos] < fout) ? g->out[g->pos] : fout;
+   }
+   store_sync();
    return 1;
 }
 
@@ -273,16 +972,25 @@ int graph_import(const int fd) {
  */
 int graph_export(const int fd) {
    unsigned int i, j;
+   uint64_t wait_in = 0, wait_out = 0; /* in the finer tiers' current bars */
 
-   if (!write64(fd, (uint64_t)last_real)) return 0;
+   if (!write64(fd, (uint64_t)last_ms)) return 0;
+   if (!write8(fd, (uint8_t)graph_db_size)) return 0;
    for (i=0; i<graph_db_size; i++) {
-      if (!write8(fd, graph_db[i]->num_bars)) return 0;
-      if (!write8(fd, graph_db[i]->pos)) return 0;
+      const struct graph *g = &graph_db[i];
 
-      for (j=0; j<graph_db[i]->num_bars; j++) {
-         if (!write64(fd, graph_db[i]->in[j])) return 0;
-         if (!write64(fd, graph_db[i]->out[j])) return 0;
+      if (!write64(fd, g->bar_ms)) return 0;
+      if (!write16(fd, (uint16_t)g->num_bars)) return 0;
+      if (!write16(fd, (uint16_t)g->pos)) return 0;
+
+      for (j=0; j<g->num_bars; j++) {
+         const int cur = (j == g->pos);
+
+         if (!write64(fd, g->in[j] + (cur ? wait_in : 0))) return 0;
+         if (!write64(fd, g->out[j] + (cur ? wait_out : 0))) return 0;
       }
+      wait_in += g->in[g->pos];
+      wait_out += g->out[g->pos];
    }
    return 1;
 }
@@ -290,9 +998,58 @@ int graph_export(const int fd) {
 /* ---------------------------------------------------------------------------
  * Web interface: front page!
  */
+
+/* The graphs themselves, drawn by graph.js from graphs.xml */
+static void html_graphs(struct str *buf, const struct graph *graphs,
+                        const unsigned int num_graphs) {
+   unsigned int i;
+
+   str_append(buf,
+      "<div id=\"graphs\">\n"
+      "Graphs require JavaScript.\n"
+      "<script type=\"text/javascript\">\n"
+      "//<![CDATA[\n"
+      "var graph_width = " GRAPH_WIDTH ";\n"
+      "var graph_height = " GRAPH_HEIGHT ";\n"
+      "var bar_gap = 1;\n"
+      "var graphs_uri = \"graphs.xml\";\n"
+      "var graphs = [\n"
+   );
+
+   for (i=0; i<num_graphs; i++) {
+      const struct graph *g = &graphs[i];
+
+      str_appendf(buf,
+         " { id:\"g%u\", "
+            "name:\"%s\", "
+            "title:\"%s\", ",
+         i, g->unit, g->title);
+      if (g->bar_ms % SEC_MS == 0)
+         str_appendf(buf, "bar_secs:%qu", (qu)(g->bar_ms / SEC_MS));
+      else
+         str_appendf(buf, "bar_secs:%qu/1000", (qu)g->bar_ms);
+      str_appendf(buf, " }%s\n", (i < num_graphs-1) ? "," : "");
+      /* trailing comma breaks on IE, makes the array one element longer */
+   }
+
+   str_append(buf,
+      "];\n"
+      "window.onload = graphs_init;\n"
+      "//]]>\n"
+      "</script>\n"
+      "</div>\n"
+   );
+}
+
+static void html_sampling(struct str *buf) {
+   if (opt_sample > 1)
+      str_appendf(buf, "<b>Sampling</b> %s1 in %u packets, "
+         "<b>so these are estimates.</b><br>\n",
+         opt_want_sample_random ? "randomly " : "", opt_sample);
+}
+
 struct str *html_front_page(void) {
    struct str *buf, *rf;
-   unsigned int i;
    char start_when[100];
    time_t d_real, d_mono;
 
@@ -319,44 +1076,15 @@ struct str *html_front_page(void) {
       "<b>Seen</b> <span id=\"tb\">%'qu</span> <b>bytes, "
       "in</b> <span id=\"tp\">%'qu</span> <b>packets.</b> "
       "(<span id=\"pc\">%'u</span> <b>captured,</b> "
-      "<span id=\"pd\">%'u</span> <b>dropped)</b><br>\n"
-      "</p>\n",
+      "<span id=\"pd\">%'u</span> <b>dropped)</b><br>\n",
       (qu)acct_total_bytes,
       (qu)acct_total_packets,
       cap_pkts_recv,
       cap_pkts_drop);
+   html_sampling(buf);
+   str_append(buf, "</p>\n");
 
-   str_append(buf,
-      "<div id=\"graphs\">\n"
-      "Graphs require JavaScript.\n"
-      "<script type=\"text/javascript\">\n"
-      "//<![CDATA[\n"
-      "var graph_width = " GRAPH_WIDTH ";\n"
-      "var graph_height = " GRAPH_HEIGHT ";\n"
-      "var bar_gap = 1;\n"
-      "var graphs_uri = \"graphs.xml\";\n"
-      "var graphs = [\n"
-   );
-
-   for (i=0; i<graph_db_size; i++)
-      str_appendf(buf,
-         " { id:\"g%u\", "
-            "name:\"%s\", "
-            "title:\"last %u %s\", "
-            "bar_secs:%u"
-         " }%s\n",
-         i, graph_db[i]->unit, graph_db[i]->num_bars, graph_db[i]->unit,
-         graph_db[i]->bar_secs, (i < graph_db_size-1) ? "," : "");
-      /* trailing comma breaks on IE, makes the array one element longer */
-
-   str_append(buf,
-      "];\n"
-      "window.onload = graphs_init;\n"
-      "//]]>\n"
-      "</script>\n"
-      "</div>\n"
-   );
-
+   html_graphs(buf, graph_db, graph_db_size);
    html_close(buf);
    return (buf);
 }
@@ -364,35 +1092,278 @@ struct str *html_front_page(void) {
 /* ---------------------------------------------------------------------------
  * Web interface: graphs.xml
  */
-struct str *xml_graphs(void) {
-   unsigned int i, j;
-   struct str *buf = str_make(), *rf;
+/* What a bar is called: the millisecond, second, minute or hour it starts
+ * at, or the day of the month.
+ */
+static unsigned int bar_label(const struct graph *g, const int64_t bar) {
+   int64_t ms = bar * (int64_t)g->bar_ms; /* when it starts */
+
+   if (is_daily(g)) {
+      const time_t t = (time_t)(ms / SEC_MS);
+
+      return (unsigned int)gmtime(&t)->tm_mday; /* ms is local already */
+   }
+   ms += tz_ms;
+   if (g->bar_ms < SEC_MS)
+      return (unsigned int)(ms % SEC_MS);
+   if (g->bar_ms < MIN_MS)
+      return (unsigned int)((ms / SEC_MS) % 60);
+   if (g->bar_ms < HOUR_MS)
+      return (unsigned int)((ms / MIN_MS) % 60);
+   return (unsigned int)((ms / HOUR_MS) % 24);
+}
+
+/* One graph's bars, oldest first, ending at pos.  If bar isn't negative,
+ * the bars are labelled by bar_label(), otherwise by position.
+ */
+static void xml_bars(struct str *buf, const struct graph *g,
+                     const uint64_t *in, const uint64_t *out,
+                     const unsigned int pos, const int64_t bar,
+                     const uint64_t wait_in, const uint64_t wait_out) {
+   unsigned int j = pos, i = 0;
+
+   str_appendf(buf, "<%s>\n", g->unit);
+   do {
+      j = (j + 1) % g->num_bars;
+      i++;
+      /* <element pos="" in="" out=""/> */
+      str_appendf(buf, "<e p=\"%u\" i=\"%qu\" o=\"%qu\"/>\n",
+         (bar < 0) ? j : bar_label(g, bar - g->num_bars + i),
+         (qu)(in[j] + ((j == pos) ? wait_in : 0)),
+         (qu)(out[j] + ((j == pos) ? wait_out : 0)));
+   } while (j != pos);
+   str_appendf(buf, "</%s>\n", g->unit);
+}
+
+/* The <graphs> element, with totals for the counters on the page. */
+static void xml_graphs_open(struct str *buf,
+                            const uint64_t bytes, const uint64_t pkts) {
+   struct str *rf;
 
    str_appendf(buf, "<graphs tp=\"%qu\" tb=\"%qu\" pc=\"%u\" pd=\"%u\" rf=\"",
-      (qu)acct_total_packets,
-      (qu)acct_total_bytes,
+      (qu)pkts,
+      (qu)bytes,
       cap_pkts_recv,
       cap_pkts_drop);
    rf = length_of_time(now_real() - start_real);
    str_appendstr(buf, rf);
    str_free(rf);
    str_append(buf, "\">\n");
+}
+
+static struct str *xml_series(const unsigned int s,
+                              const uint64_t bytes, const uint64_t pkts) {
+   unsigned int i;
+   uint64_t wait_in = 0, wait_out = 0; /* in the finer tiers' current bars */
+   struct str *buf = str_make();
+
+   if (last_ms != 0)
+      advance((int64_t)now_real() * SEC_MS);
+   xml_graphs_open(buf, bytes, pkts);
+   for (i=0; i<graph_db_size; i++) {
+      const struct graph *g = &graph_db[i];
+      const uint64_t *in = series_in(g, s), *out = series_out(g, s);
+
+      xml_bars(buf, g, in, out, g->pos, g->bar, wait_in, wait_out);
+      wait_in += in[g->pos];
+      wait_out += out[g->pos];
+   }
+   str_append(buf, "</graphs>\n");
+   return (buf);
+}
+
+struct str *xml_graphs(void) {
+   return xml_series(0, acct_total_bytes, acct_total_packets);
+}
+
+/* ---------------------------------------------------------------------------
+ * JSON API: /api/graphs
+ *
+ * The same as graphs.xml, but every bar has the time it starts at, in
+ * milliseconds since the epoch, instead of a label.
+ */
+static void json_bars(struct json *j, const struct graph *g,
+                      const uint64_t *in, const uint64_t *out,
+                      const uint64_t wait_in, const uint64_t wait_out) {
+   const int64_t shift = is_daily(g) ? tz_ms : 0; /* daily bars are local */
+   unsigned int pos = g->pos, k = pos, i = 0;
+
+   json_object(j, NULL);
+   json_uint(j, "bar_ms", g->bar_ms);
+   json_array(j, "bars");
+   do {
+      k = (k + 1) % g->num_bars;
+      i++;
+      json_object(j, NULL);
+      json_int(j, "start",
+         (g->bar - g->num_bars + i) * (int64_t)g->bar_ms - shift);
+      json_uint(j, "in", in[k] + ((k == pos) ? wait_in : 0));
+      json_uint(j, "out", out[k] + ((k == pos) ? wait_out : 0));
+      json_end(j);
+   } while (k != pos);
+   json_end(j);
+   json_end(j);
+}
+
+struct str *json_graphs(void) {
+   unsigned int i;
+   uint64_t wait_in = 0, wait_out = 0;
+   struct str *buf = str_make();
+   struct json j;
 
+   if (last_ms != 0)
+      advance((int64_t)now_real() * SEC_MS);
+   json_init(&j, buf);
+   json_object(&j, NULL);
+   json_uint(&j, "bytes", acct_total_bytes);
+   json_uint(&j, "packets", acct_total_packets);
+   json_uint(&j, "pkts_captured", cap_pkts_recv);
+   json_uint(&j, "pkts_dropped", cap_pkts_drop);
+   json_int(&j, "running_since", (int64_t)start_real);
+   json_array(&j, "tiers");
    for (i=0; i<graph_db_size; i++) {
-      const struct graph *g = graph_db[i];
-
-      str_appendf(buf, "<%s>\n", g->unit);
-      j = g->pos;
-      do {
-         j = (j + 1) % g->num_bars;
-         /* <element pos="" in="" out=""/> */
-         str_appendf(buf, "<e p=\"%u\" i=\"%qu\" o=\"%qu\"/>\n",
-            g->offset + j,
-            (qu)g->in[j],
-            (qu)g->out[j]);
-      } while (j != g->pos);
-      str_appendf(buf, "</%s>\n", g->unit);
+      const struct graph *g = &graph_db[i];
+
+      json_bars(&j, g, g->in, g->out, wait_in, wait_out);
+      wait_in += g->in[g->pos];
+      wait_out += g->out[g->pos];
    }
+   json_end(&j);
+   json_end(&j);
+   return (buf);
+}
+
+/* ---------------------------------------------------------------------------
+ * Web interface: VLANs
+ */
+
+/* Returns the series for "/vlans/<id><rest>", or 0 if there isn't one. */
+static unsigned int uri_series(const char *uri, const char *rest) {
+   const char *p = uri + strlen("/vlans/");
+   unsigned int vlan = 0;
+
+   if (!isdigit((unsigned char)*p))
+      return 0;
+   while (isdigit((unsigned char)*p)) {
+      vlan = vlan * 10 + (unsigned int)(*p - '0');
+      if (vlan > MAX_VLAN)
+         return 0;
+      p++;
+   }
+   if (strcmp(p, rest) != 0)
+      return 0;
+   return vlan_series[vlan];
+}
+
+static int cmp_series(const void *a, const void *b) {
+   const uint16_t x = series[*(const unsigned int *)a].vlan,
+                  y = series[*(const unsigned int *)b].vlan;
+   return (x > y) - (x < y);
+}
+
+static void format_vlans(struct str *buf) {
+   unsigned int *order, i;
+
+   if (num_series == 1) {
+      str_append(buf, "<p>No tagged traffic has been seen.</p>\n");
+      return;
+   }
+   order = xcalloc(num_series - 1, sizeof(*order));
+   for (i=1; i<num_series; i++)
+      order[i - 1] = i;
+   qsort(order, num_series - 1, sizeof(*order), cmp_series);
+
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>VLAN</th>\n"
+      " <th>In</th>\n"
+      " <th>Out</th>\n"
+      " <th>Total</th>\n"
+      " <th>Packets</th>\n"
+      "</tr>\n");
+   for (i=0; i<num_series - 1; i++) {
+      const struct series *v = &series[order[i]];
+
+      str_appendf(buf,
+         "<tr>\n"
+         " <td><a href=\"%u/\">%u</a></td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         "</tr>\n",
+         v->vlan, v->vlan,
+         (qu)v->in,
+         (qu)v->out,
+         (qu)v->bytes,
+         (qu)v->pkts);
+   }
+   str_append(buf, "</table>\n");
+   free(order);
+}
+
+struct str *html_vlans(const char *uri) {
+   struct str *buf;
+   unsigned int s;
+   char title[16];
+
+   if (strcmp(uri, "/vlans/") == 0) {
+      buf = str_make();
+      html_open(buf, "VLANs", /*path_depth=*/1, /*want_graph_js=*/0);
+      if (opt_want_vlans)
+         format_vlans(buf);
+      else
+         str_append(buf, "<p>VLANs aren't being tracked. "
+                         "Use the --vlans option to enable them.</p>\n");
+      html_close(buf);
+      return (buf);
+   }
+
+   if ((s = uri_series(uri, "/")) == 0)
+      return (NULL);
+   snprintf(title, sizeof(title), "VLAN %u", series[s].vlan);
+   buf = str_make();
+   html_open(buf, title, /*path_depth=*/2, /*want_graph_js=*/1);
+   str_appendf(buf, "<p>\n"
+      "<b>Seen</b> <span id=\"tb\">%'qu</span> <b>bytes, "
+      "in</b> <span id=\"tp\">%'qu</span> <b>packets.</b><br>\n",
+      (qu)series[s].bytes,
+      (qu)series[s].pkts);
+   html_sampling(buf);
+   str_append(buf, "</p>\n");
+   html_graphs(buf, graph_db, graph_db_size);
+   html_close(buf);
+   return (buf);
+}
+
+struct str *xml_vlan_graphs(const char *uri) {
+   unsigned int s = uri_series(uri, "/graphs.xml");
+
+   if (s == 0)
+      return (NULL);
+   return xml_series(s, series[s].bytes, series[s].pkts);
+}
+
+/* ---------------------------------------------------------------------------
+ * Web interface: per-host graphs, on the host's page.
+ */
+void html_host_graphs(struct str *buf) {
+   html_graphs(buf, host_graph_db,
+               sizeof(host_graph_db)/sizeof(*host_graph_db));
+}
+
+struct str *xml_host_graphs(const unsigned int slot,
+                            const uint64_t bytes, const uint64_t pkts) {
+   struct host_graph *hg = get_host_graph(slot);
+   struct str *buf = str_make();
+
+   host_graph_sync(hg);
+   xml_graphs_open(buf, bytes, pkts);
+   xml_bars(buf, &host_graph_db[0], hg->min_in, hg->min_out,
+            host_clock.min_pos, -1, 0, 0);
+   xml_bars(buf, &host_graph_db[1], hg->hr_in, hg->hr_out,
+            host_clock.hr_pos, -1, 0, 0);
    str_append(buf, "</graphs>\n");
    return (buf);
 }
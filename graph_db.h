@@ -15,16 +15,38 @@ enum graph_dir {
    MAX_GRAPH_DIR = 2
 };
 
+/* Parses --graph-tiers, exits if it's no good.  Without it, graph_init()
+ * uses the default: 1s:60,1m:60,1h:24,1d:31
+ */
+void graph_tiers(const char *spec);
 void graph_init(void);
 void graph_reset(void);
 void graph_free(void);
-void graph_acct(uint64_t amount, enum graph_dir dir);
+/* vlan is 0, or one already passed to graph_acct_vlan().  ms is when it
+ * happened, in milliseconds since the epoch, or 0 for now.
+ */
+void graph_acct(uint64_t amount, enum graph_dir dir, const uint16_t vlan,
+                const int64_t ms);
+void graph_acct_vlan(const uint16_t vlan, uint64_t bytes, uint64_t pkts);
 void graph_rotate(void);
-int graph_import(const int fd);
+int graph_import(const int fd, const int ver); /* 1 or 2 */
 int graph_export(const int fd);
 
+/* Per-host graphs, in slots 1 to opt_host_graphs. */
+void graph_host_clear(const unsigned int slot);
+void graph_host_acct(const unsigned int slot, const uint64_t in,
+                     const uint64_t out);
+int graph_host_import(const int fd, const unsigned int slot);
+int graph_host_export(const int fd, const unsigned int slot);
+
 struct str *html_front_page(void);
 struct str *xml_graphs(void);
+struct str *json_graphs(void);
+struct str *html_vlans(const char *uri);
+struct str *xml_vlan_graphs(const char *uri);
+void html_host_graphs(struct str *buf);
+struct str *xml_host_graphs(const unsigned int slot,
+                            const uint64_t bytes, const uint64_t pkts);
 
 #endif
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -0,0 +1,88 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * hll.c: HyperLogLog sketch, for counting distinct things
+ *
+ * See Flajolet et al., "HyperLogLog: the analysis of a near-optimal
+ * cardinality estimation algorithm" (2007).  The top HLL_BITS of the hash
+ * pick a register, which keeps the highest "rank" (position of the first
+ * one bit) seen in the rest of the hash.
+ *
+ * Registers are four bits, which caps the rank at 15 and the estimate at
+ * about 1.5 million.  That's plenty for peers and ports of one host, and
+ * it keeps the sketch to 32 bytes.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#include "hll.h"
+
+#include <math.h> /* for log */
+
+#define RANK_MAX 15
+#define ALPHA 0.709 /* bias correction for 64 registers */
+
+uint64_t hll_hash(const void *data, const size_t len) {
+   const uint8_t *p = data;
+   uint64_t h = 0xcbf29ce484222325ULL; /* FNV-1a */
+   size_t i;
+
+   for (i = 0; i < len; i++) {
+      h ^= p[i];
+      h *= 0x100000001b3ULL;
+   }
+   /* FNV's high bits are poor, and we use them for the register index,
+    * so finish with MurmurHash3's fmix64.
+    */
+   h ^= h >> 33;
+   h *= 0xff51afd7ed558ccdULL;
+   h ^= h >> 33;
+   h *= 0xc4ceb9fe1a85ec53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+static unsigned int get_reg(const struct hll *h, const unsigned int i) {
+   return (h->reg[i / 2] >> ((i & 1) * 4)) & 0xF;
+}
+
+void hll_add(struct hll *h, const uint64_t hash) {
+   const unsigned int i = (unsigned int)(hash >> (64 - HLL_BITS));
+   uint64_t rest = hash << HLL_BITS;
+   unsigned int rank = 1;
+
+   while (rank < RANK_MAX && (rest & (1ULL << 63)) == 0) {
+      rest <<= 1;
+      rank++;
+   }
+   if (rank > get_reg(h, i)) {
+      const unsigned int shift = (i & 1) * 4;
+      h->reg[i / 2] = (uint8_t)((h->reg[i / 2] & ~(0xF << shift)) |
+                                (rank << shift));
+   }
+}
+
+uint64_t hll_count(const struct hll *h) {
+   const double m = HLL_REGISTERS;
+   uint32_t sum = 0; /* of 2^(RANK_MAX - register) */
+   unsigned int i, zeroes = 0;
+   double e;
+
+   for (i = 0; i < HLL_REGISTERS; i++) {
+      const unsigned int r = get_reg(h, i);
+      sum += 1U << (RANK_MAX - r);
+      if (r == 0)
+         zeroes++;
+   }
+   if (zeroes == HLL_REGISTERS)
+      return 0;
+   e = ALPHA * m * m * (1U << RANK_MAX) / sum;
+
+   /* Small range correction: linear counting is better here. */
+   if (e <= 2.5 * m && zeroes != 0)
+      e = m * log(m / zeroes);
+   return (uint64_t)(e + 0.5);
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
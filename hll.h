@@ -0,0 +1,34 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * hll.h: HyperLogLog sketch, for counting distinct things
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_HLL_H
+#define __DARKSTAT_HLL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HLL_BITS 6                   /* index bits */
+#define HLL_REGISTERS (1 << HLL_BITS) /* 4 bits each, two to a byte */
+
+/* The standard error is about 1.04 / sqrt(HLL_REGISTERS), or 13%.  All
+ * zeroes is an empty sketch.
+ */
+struct hll {
+   uint8_t reg[HLL_REGISTERS / 2];
+};
+
+/* A 64-bit hash of the data, for hll_add(). */
+uint64_t hll_hash(const void *data, const size_t len);
+
+void hll_add(struct hll *h, const uint64_t hash);
+
+/* Estimated number of distinct hashes added. */
+uint64_t hll_count(const struct hll *h);
+
+#endif /* __DARKSTAT_HLL_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
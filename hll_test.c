@@ -0,0 +1,66 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * hll_test.c: tests for hll.c
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "hll.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int retcode = 0;
+
+/* Adds n distinct items, each one dups times, and checks that the estimate
+ * is within tolerance (a fraction of n).
+ */
+static void test_count(uint32_t n, int dups, double tolerance) {
+  struct hll h;
+  uint32_t i;
+  int j;
+  uint64_t got;
+  double err;
+
+  memset(&h, 0, sizeof(h));
+  for (j = 0; j < dups; j++)
+    for (i = 0; i < n; i++)
+      hll_add(&h, hll_hash(&i, sizeof(i)));
+  got = hll_count(&h);
+  err = (n == 0) ? (double)got : ((double)got - n) / n;
+  if (err < 0) err = -err;
+
+  printf("%s: %u distinct (x%d) -> %llu\n",
+      (err <= tolerance) ? "PASS" : "FAIL", n, dups,
+      (unsigned long long)got);
+  if (err > tolerance) retcode = 1;
+}
+
+int main(void) {
+  test_count(0, 1, 0);
+  test_count(1, 1000, 0);
+  test_count(10, 3, 0.2);
+  test_count(50, 1, 0.2);
+  test_count(1000, 2, 0.4);
+  test_count(65536, 1, 0.4);
+  test_count(500000, 1, 0.4);
+
+  if (sizeof(struct hll) != 32) {
+    printf("FAIL: sizeof(struct hll) is %u\n", (unsigned)sizeof(struct hll));
+    retcode = 1;
+  }
+  return retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
@@ -7,20 +7,28 @@
  * GNU General Public License version 2. (see COPYING.GPL)
  */
 
+#include "acct.h"
+#include "cap.h"
 #include "cdefs.h"
 #include "conv.h"
 #include "decode.h"
 #include "dns.h"
 #include "err.h"
+#include "graph_db.h"
 #include "hosts_db.h"
 #include "db.h"
 #include "html.h"
+#include "json.h"
 #include "ncache.h"
 #include "now.h"
 #include "opt.h"
+#include "sketch.h"
+#include "stats.h"
 #include "str.h"
 
 #include <netdb.h>  /* struct addrinfo */
+#define __FAVOR_BSD
+#include <netinet/tcp.h> /* TH_SYN etc */
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
@@ -34,6 +42,12 @@ int hosts_db_show_macs = 0;
 /* FIXME: specify somewhere more sane/tunable */
 #define MAX_ENTRIES 30 /* in an HTML table rendered from a hashtable */
 
+/* Weight kept by the old rate each second: a time constant of about eight
+ * seconds.  After RATE_IDLE_SECS of silence, the rate is just zero.
+ */
+#define RATE_DECAY 0.875
+#define RATE_IDLE_SECS 300
+
 typedef uint32_t (hash_func_t)(const struct hashtable *, const void *);
 typedef void (free_func_t)(struct bucket *);
 typedef const void * (key_func_t)(const struct bucket *);
@@ -41,6 +55,7 @@ typedef int (find_func_t)(const struct bucket *, const void *);
 typedef struct bucket * (make_func_t)(const void *);
 typedef void (format_cols_func_t)(struct str *);
 typedef void (format_row_func_t)(struct str *, const struct bucket *);
+typedef void (json_row_func_t)(struct json *, const struct bucket *);
 
 struct hashtable {
    uint8_t bits;     /* size of hashtable in bits */
@@ -73,6 +88,9 @@ struct hashtable {
 
    format_row_func_t *format_row_func;
    /* format record and append to str */
+
+   json_row_func_t *json_row_func;
+   /* format record as a JSON object */
 };
 
 static void hashtable_reduce(struct hashtable *ht);
@@ -81,10 +99,14 @@ static void hashtable_free(struct hashtable *h);
 #define HOST_BITS 1  /* initial size of hosts table */
 #define PORT_BITS 1  /* initial size of ports tables */
 #define PROTO_BITS 1 /* initial size of proto table */
+#define PAIR_BITS 1  /* minimum initial size of pairs table */
 
 /* We only use one hosts_db hashtable and this is it. */
 static struct hashtable *hosts_db = NULL;
 
+/* Conversations between pairs of hosts, NULL unless --pairs-max is set. */
+static struct hashtable *pairs_db = NULL;
+
 /* phi^-1 (reciprocal of golden ratio) = (sqrt(5) - 1) / 2 */
 static const double phi_1 =
    0.61803398874989490252573887119069695472717285156250;
@@ -143,6 +165,14 @@ hash_func_host(const struct hashtable *h _unused_, const void *key)
 
 #define CASTKEY(type) (*((const type *)key))
 
+static uint32_t
+hash_func_pair(const struct hashtable *h, const void *key)
+{
+   const struct pair *p = key;
+   return (hash_func_host(h, &(p->a)) ^
+           (hash_func_host(h, &(p->b)) * h->coeff));
+}
+
 static uint32_t
 hash_func_short(const struct hashtable *h, const void *key)
 {
@@ -183,6 +213,24 @@ key_func_ip_proto(const struct bucket *b)
    return &(b->u.ip_proto.proto);
 }
 
+static const void *
+key_func_icmp_type(const struct bucket *b)
+{
+   return &(b->u.icmp_type.type_code);
+}
+
+static const void *
+key_func_tcp_flags(const struct bucket *b)
+{
+   return &(b->u.tcp_flags.flags);
+}
+
+static const void *
+key_func_pair(const struct bucket *b)
+{
+   return &(b->u.pair);
+}
+
 /* ---------------------------------------------------------------------------
  * find_func collection
  */
@@ -211,6 +259,26 @@ find_func_ip_proto(const struct bucket *b, const void *key)
    return (b->u.ip_proto.proto == CASTKEY(uint8_t));
 }
 
+static int
+find_func_icmp_type(const struct bucket *b, const void *key)
+{
+   return (b->u.icmp_type.type_code == CASTKEY(uint16_t));
+}
+
+static int
+find_func_tcp_flags(const struct bucket *b, const void *key)
+{
+   return (b->u.tcp_flags.flags == CASTKEY(uint8_t));
+}
+
+static int
+find_func_pair(const struct bucket *b, const void *key)
+{
+   const struct pair *p = key;
+   return (addr_equal(&(p->a), &(b->u.pair.a)) &&
+           addr_equal(&(p->b), &(b->u.pair.b)));
+}
+
 /* ---------------------------------------------------------------------------
  * make_func collection
  */
@@ -218,11 +286,13 @@ find_func_ip_proto(const struct bucket *b, const void *key)
 #define MAKE_BUCKET(name_bucket, name_content, type) struct { \
    struct bucket *next; \
    uint64_t in, out, total; \
+   uint64_t pkts_in, pkts_out; \
    union { struct type t; } u; } _custom_bucket; \
    struct bucket *name_bucket = xcalloc(1, sizeof(_custom_bucket)); \
    struct type *name_content = &(name_bucket->u.type); \
    name_bucket->next = NULL; \
-   name_bucket->in = name_bucket->out = name_bucket->total = 0;
+   name_bucket->in = name_bucket->out = name_bucket->total = 0; \
+   name_bucket->pkts_in = name_bucket->pkts_out = 0;
 
 static struct bucket *
 make_func_host(const void *key)
@@ -231,25 +301,51 @@ make_func_host(const void *key)
    h->addr = CASTKEY(struct addr);
    h->dns = NULL;
    h->last_seen_mono = 0;
+   h->rate_bytes = h->rate_pkts = 0;
+   h->rate_cur_bytes = h->rate_cur_pkts = 0;
+   h->rate_mono = 0;
+   memset(&h->peers, 0, sizeof(h->peers));
+   memset(&h->ports, 0, sizeof(h->ports));
+   h->graph = 0;
+   h->journal_in = h->journal_out = 0;
+   h->journal_pkts_in = h->journal_pkts_out = 0;
    memset(&h->mac_addr, 0, sizeof(h->mac_addr));
    h->ports_tcp = NULL;
    h->ports_tcp_remote = NULL;
    h->ports_udp = NULL;
    h->ports_udp_remote = NULL;
    h->ip_protos = NULL;
+   h->icmp_types = NULL;
+   h->tcp_flags = NULL;
    return (b);
 }
 
+/* With --host-graphs, hosts own graph slots: graph_owners[slot - 1]. */
+static struct bucket **graph_owners = NULL;
+static unsigned int graph_owners_used = 0;
+/* The slot of the owner with the smallest total, or 0 if we need to look
+ * again.  Totals keep growing, so it's only trusted for a second.
+ */
+static unsigned int graph_owners_min = 0;
+static time_t graph_owners_min_mono;
+
 static void
 free_func_host(struct bucket *b)
 {
    struct host *h = &(b->u.host);
+   if (h->graph != 0) {
+      graph_owners[h->graph - 1] = NULL;
+      graph_owners_used--;
+      graph_owners_min = 0;
+   }
    if (h->dns != NULL) free(h->dns);
    hashtable_free(h->ports_tcp);
    hashtable_free(h->ports_tcp_remote);
    hashtable_free(h->ports_udp);
    hashtable_free(h->ports_udp_remote);
    hashtable_free(h->ip_protos);
+   hashtable_free(h->icmp_types);
+   hashtable_free(h->tcp_flags);
 }
 
 static struct bucket *
@@ -277,6 +373,33 @@ make_func_ip_proto(const void *key)
    return (b);
 }
 
+static struct bucket *
+make_func_icmp_type(const void *key)
+{
+   MAKE_BUCKET(b, p, icmp_type);
+   p->type_code = CASTKEY(uint16_t);
+   p->v6 = 0;
+   return (b);
+}
+
+static struct bucket *
+make_func_tcp_flags(const void *key)
+{
+   MAKE_BUCKET(b, p, tcp_flags);
+   p->flags = CASTKEY(uint8_t);
+   return (b);
+}
+
+static struct bucket *
+make_func_pair(const void *key)
+{
+   MAKE_BUCKET(b, p, pair);
+   p->a = CASTKEY(struct pair).a;
+   p->b = CASTKEY(struct pair).b;
+   p->last_seen_mono = 0;
+   return (b);
+}
+
 static void
 free_func_simple(struct bucket *b _unused_)
 {
@@ -287,6 +410,30 @@ free_func_simple(struct bucket *b _unused_)
  * format_func collection (ordered by struct)
  */
 
+static void
+format_cell_last_seen(struct str *buf, const int64_t last)
+{
+   int64_t now = (int64_t)now_mono();
+   struct str *last_str = NULL;
+
+   if ((now >= last) && (last != 0))
+      last_str = length_of_time(now - last);
+
+   str_append(buf, " <td class=\"num\">");
+   if (last_str == NULL) {
+      if (last == 0)
+         str_append(buf, "(never)");
+      else
+         str_appendf(buf, "(clock error: last = %qd, now = %qu)",
+                     (qd)last,
+                     (qu)now);
+   } else {
+      str_appendstr(buf, last_str);
+      str_free(last_str);
+   }
+   str_append(buf, "</td>");
+}
+
 static void
 format_cols_host(struct str *buf)
 {
@@ -304,7 +451,9 @@ format_cols_host(struct str *buf)
    str_append(buf,
       " <th><a href=\"?sort=in\">In</a></th>\n"
       " <th><a href=\"?sort=out\">Out</a></th>\n"
-      " <th><a href=\"?sort=total\">Total</a></th>\n");
+      " <th><a href=\"?sort=total\">Total</a></th>\n"
+      " <th><a href=\"?sort=packets\">Packets</a></th>\n"
+      " <th><a href=\"?sort=rate\">Rate (B/s)</a></th>\n");
    if (opt_want_lastseen) str_append(buf,
       " <th><a href=\"?sort=lastseen\">Last seen</a></th>\n");
    str_append(buf,
@@ -334,35 +483,19 @@ format_row_host(struct str *buf, const struct bucket *b)
          b->u.host.mac_addr[5]);
 
    str_appendf(buf,
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n",
       (qu)b->in,
       (qu)b->out,
-      (qu)b->total);
-
-   if (opt_want_lastseen) {
-      int64_t last = b->u.host.last_seen_mono;
-      int64_t now = (int64_t)now_mono();
-      struct str *last_str = NULL;
-
-      if ((now >= last) && (last != 0))
-         last_str = length_of_time(now - last);
-
-      str_append(buf, " <td class=\"num\">");
-      if (last_str == NULL) {
-         if (last == 0)
-            str_append(buf, "(never)");
-         else
-            str_appendf(buf, "(clock error: last = %qd, now = %qu)",
-                        (qd)last,
-                        (qu)now);
-      } else {
-         str_appendstr(buf, last_str);
-         str_free(last_str);
-      }
-      str_append(buf, "</td>");
-   }
+      (qu)b->total,
+      (qu)(b->pkts_in + b->pkts_out),
+      (qu)b->u.host.rate_bytes);
+
+   if (opt_want_lastseen)
+      format_cell_last_seen(buf, b->u.host.last_seen_mono);
 
    str_appendf(buf, "</tr>\n");
 
@@ -382,6 +515,7 @@ format_cols_port_tcp(struct str *buf)
       " <th>In</td>\n"
       " <th>Out</td>\n"
       " <th>Total</td>\n"
+      " <th>Packets</td>\n"
       " <th>SYNs</td>\n"
       "</tr>\n"
    );
@@ -400,12 +534,14 @@ format_row_port_tcp(struct str *buf, const struct bucket *b)
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
       "</tr>\n",
       p->port,
       getservtcp(p->port),
       (qu)b->in,
       (qu)b->out,
       (qu)b->total,
+      (qu)(b->pkts_in + b->pkts_out),
       (qu)p->syn
    );
 }
@@ -421,6 +557,7 @@ format_cols_port_udp(struct str *buf)
       " <th>In</td>\n"
       " <th>Out</td>\n"
       " <th>Total</td>\n"
+      " <th>Packets</td>\n"
       "</tr>\n"
    );
 }
@@ -437,12 +574,14 @@ format_row_port_udp(struct str *buf, const struct bucket *b)
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
       "</tr>\n",
       p->port,
       getservudp(p->port),
       (qu)b->in,
       (qu)b->out,
-      (qu)b->total
+      (qu)b->total,
+      (qu)(b->pkts_in + b->pkts_out)
    );
 }
 
@@ -457,6 +596,7 @@ format_cols_ip_proto(struct str *buf)
       " <th>In</td>\n"
       " <th>Out</td>\n"
       " <th>Total</td>\n"
+      " <th>Packets</td>\n"
       "</tr>\n"
    );
 }
@@ -473,15 +613,342 @@ format_row_ip_proto(struct str *buf, const struct bucket *b)
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
       " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
       "</tr>\n",
       p->proto,
       getproto(p->proto),
       (qu)b->in,
       (qu)b->out,
-      (qu)b->total
+      (qu)b->total,
+      (qu)(b->pkts_in + b->pkts_out)
+   );
+}
+
+static const char *
+icmp_type_name(const int v6, const uint8_t type)
+{
+   if (!v6) switch (type) {
+      case 0:  return "echo reply";
+      case 3:  return "destination unreachable";
+      case 4:  return "source quench";
+      case 5:  return "redirect";
+      case 8:  return "echo request";
+      case 9:  return "router advertisement";
+      case 10: return "router solicitation";
+      case 11: return "time exceeded";
+      case 12: return "parameter problem";
+      case 13: return "timestamp request";
+      case 14: return "timestamp reply";
+   } else switch (type) {
+      case 1:   return "destination unreachable";
+      case 2:   return "packet too big";
+      case 3:   return "time exceeded";
+      case 4:   return "parameter problem";
+      case 128: return "echo request";
+      case 129: return "echo reply";
+      case 130: return "multicast listener query";
+      case 131: return "multicast listener report";
+      case 132: return "multicast listener done";
+      case 133: return "router solicitation";
+      case 134: return "router advertisement";
+      case 135: return "neighbor solicitation";
+      case 136: return "neighbor advertisement";
+      case 137: return "redirect";
+      case 143: return "multicast listener report v2";
+   }
+   return "";
+}
+
+static void
+format_cols_icmp_type(struct str *buf)
+{
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>Type</td>\n"
+      " <th>Code</td>\n"
+      " <th>Message</td>\n"
+      " <th>In</td>\n"
+      " <th>Out</td>\n"
+      " <th>Total</td>\n"
+      " <th>Packets</td>\n"
+      "</tr>\n"
+   );
+}
+
+static void
+format_row_icmp_type(struct str *buf, const struct bucket *b)
+{
+   const struct icmp_type *p = &(b->u.icmp_type);
+
+   str_appendf(buf,
+      "<tr>\n"
+      " <td class=\"num\">%u</td>\n"
+      " <td class=\"num\">%u</td>\n"
+      " <td>%s</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      "</tr>\n",
+      p->type_code >> 8,
+      p->type_code & 0xFF,
+      icmp_type_name(p->v6, (uint8_t)(p->type_code >> 8)),
+      (qu)b->in,
+      (qu)b->out,
+      (qu)b->total,
+      (qu)(b->pkts_in + b->pkts_out)
+   );
+}
+
+static void
+format_cols_tcp_flags(struct str *buf)
+{
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>Flags</td>\n"
+      " <th>In</td>\n"
+      " <th>Out</td>\n"
+      " <th>Total</td>\n"
+      " <th>Packets in</td>\n"
+      " <th>Packets out</td>\n"
+      "</tr>\n"
+   );
+}
+
+/* Names a combination of flags like "SYN-ACK", or "none". */
+static void
+format_flags(struct str *buf, const uint8_t flags)
+{
+   static const struct {
+      uint8_t flag;
+      const char *name;
+   } names[] = {
+      { TH_SYN, "SYN" }, { TH_FIN, "FIN" }, { TH_RST, "RST" },
+      { TH_PUSH, "PSH" }, { TH_ACK, "ACK" }, { TH_URG, "URG" }
+   };
+   size_t i;
+   int first = 1;
+
+   for (i = 0; i < sizeof(names) / sizeof(*names); i++)
+      if (flags & names[i].flag) {
+         if (!first)
+            str_append(buf, "-");
+         str_append(buf, names[i].name);
+         first = 0;
+      }
+   if (first)
+      str_append(buf, "none");
+}
+
+static void
+format_row_tcp_flags(struct str *buf, const struct bucket *b)
+{
+   str_append(buf,
+      "<tr>\n"
+      " <td>");
+   format_flags(buf, b->u.tcp_flags.flags);
+   str_appendf(buf, "</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      "</tr>\n",
+      (qu)b->in,
+      (qu)b->out,
+      (qu)b->total,
+      (qu)b->pkts_in,
+      (qu)b->pkts_out
    );
 }
 
+static void
+format_cols_pair(struct str *buf)
+{
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>Host A</th>\n"
+      " <th>Host B</th>\n"
+      " <th><a href=\"?sort=out\">A to B</a></th>\n"
+      " <th><a href=\"?sort=in\">B to A</a></th>\n"
+      " <th><a href=\"?sort=total\">Total</a></th>\n"
+      " <th><a href=\"?sort=packets\">Packets</a></th>\n");
+   if (opt_want_lastseen) str_append(buf,
+      " <th>Last seen</th>\n");
+   str_append(buf,
+      "</tr>\n");
+}
+
+static void
+format_row_pair(struct str *buf, const struct bucket *b)
+{
+   const struct pair *p = &(b->u.pair);
+   char a[INET6_ADDRSTRLEN];
+
+   /* addr_to_str() returns a static buffer. */
+   snprintf(a, sizeof(a), "%s", addr_to_str(&(p->a)));
+   str_appendf(buf,
+      "<tr>\n"
+      " <td><a href=\"../hosts/%s/\">%s</a></td>\n",
+      a, a);
+   str_appendf(buf,
+      " <td><a href=\"../hosts/%s/\">%s</a></td>\n",
+      addr_to_str(&(p->b)), addr_to_str(&(p->b)));
+   str_appendf(buf,
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n"
+      " <td class=\"num\">%'qu</td>\n",
+      (qu)b->out,
+      (qu)b->in,
+      (qu)b->total,
+      (qu)(b->pkts_in + b->pkts_out));
+   if (opt_want_lastseen)
+      format_cell_last_seen(buf, p->last_seen_mono);
+   str_append(buf, "</tr>\n");
+}
+
+/* ---------------------------------------------------------------------------
+ * json_row_func collection (ordered by struct)
+ */
+
+static void
+json_counters(struct json *j, const struct bucket *b)
+{
+   json_uint(j, "in", b->in);
+   json_uint(j, "out", b->out);
+   json_uint(j, "total", b->total);
+   json_uint(j, "pkts_in", b->pkts_in);
+   json_uint(j, "pkts_out", b->pkts_out);
+}
+
+/* As a time_t, or null if never. */
+static void
+json_last_seen(struct json *j, const int64_t last)
+{
+   if (last == 0)
+      json_null(j, "last_seen");
+   else
+      json_int(j, "last_seen", (int64_t)mono_to_real(last));
+}
+
+static void
+json_host_fields(struct json *j, const struct bucket *b)
+{
+   json_str(j, "ip", addr_to_str(&(b->u.host.addr)));
+   json_str(j, "hostname", b->u.host.dns);
+   if (hosts_db_show_macs) {
+      struct str *mac = str_make();
+      char *s;
+      size_t len;
+
+      str_appendf(mac, "%x:%x:%x:%x:%x:%x",
+         b->u.host.mac_addr[0],
+         b->u.host.mac_addr[1],
+         b->u.host.mac_addr[2],
+         b->u.host.mac_addr[3],
+         b->u.host.mac_addr[4],
+         b->u.host.mac_addr[5]);
+      str_appendn(mac, "", 1);
+      str_extract(mac, &len, &s);
+      json_str(j, "mac", s);
+      free(s);
+   }
+   json_counters(j, b);
+   json_uint(j, "rate_bytes", (uint64_t)b->u.host.rate_bytes);
+   json_uint(j, "rate_pkts", (uint64_t)b->u.host.rate_pkts);
+   json_last_seen(j, b->u.host.last_seen_mono);
+
+   /* Only resolve hosts "on demand" */
+   if (b->u.host.dns == NULL)
+      dns_queue(&(b->u.host.addr));
+}
+
+static void
+json_row_host(struct json *j, const struct bucket *b)
+{
+   json_object(j, NULL);
+   json_host_fields(j, b);
+   json_end(j);
+}
+
+static void
+json_row_port_tcp(struct json *j, const struct bucket *b)
+{
+   json_object(j, NULL);
+   json_uint(j, "port", b->u.port_tcp.port);
+   json_str(j, "service", getservtcp(b->u.port_tcp.port));
+   json_counters(j, b);
+   json_uint(j, "syn", b->u.port_tcp.syn);
+   json_end(j);
+}
+
+static void
+json_row_port_udp(struct json *j, const struct bucket *b)
+{
+   json_object(j, NULL);
+   json_uint(j, "port", b->u.port_udp.port);
+   json_str(j, "service", getservudp(b->u.port_udp.port));
+   json_counters(j, b);
+   json_end(j);
+}
+
+static void
+json_row_ip_proto(struct json *j, const struct bucket *b)
+{
+   json_object(j, NULL);
+   json_uint(j, "proto", b->u.ip_proto.proto);
+   json_str(j, "name", getproto(b->u.ip_proto.proto));
+   json_counters(j, b);
+   json_end(j);
+}
+
+static void
+json_row_icmp_type(struct json *j, const struct bucket *b)
+{
+   const struct icmp_type *p = &(b->u.icmp_type);
+
+   json_object(j, NULL);
+   json_uint(j, "type", p->type_code >> 8);
+   json_uint(j, "code", p->type_code & 0xFF);
+   json_str(j, "message", icmp_type_name(p->v6, (uint8_t)(p->type_code >> 8)));
+   json_counters(j, b);
+   json_end(j);
+}
+
+static void
+json_row_tcp_flags(struct json *j, const struct bucket *b)
+{
+   struct str *flags = str_make();
+   char *s;
+   size_t len;
+
+   format_flags(flags, b->u.tcp_flags.flags);
+   str_appendn(flags, "", 1);
+   str_extract(flags, &len, &s);
+   json_object(j, NULL);
+   json_str(j, "flags", s);
+   json_counters(j, b);
+   json_end(j);
+   free(s);
+}
+
+static void
+json_row_pair(struct json *j, const struct bucket *b)
+{
+   const struct pair *p = &(b->u.pair);
+
+   json_object(j, NULL);
+   json_str(j, "a", addr_to_str(&(p->a)));
+   json_str(j, "b", addr_to_str(&(p->b)));
+   json_counters(j, b);
+   json_last_seen(j, p->last_seen_mono);
+   json_end(j);
+}
+
 /* ---------------------------------------------------------------------------
  * Initialise a hashtable.
  */
@@ -495,7 +962,8 @@ hashtable_make(const uint8_t bits,
    find_func_t *find_func,
    make_func_t *make_func,
    format_cols_func_t *format_cols_func,
-   format_row_func_t *format_row_func)
+   format_row_func_t *format_row_func,
+   json_row_func_t *json_row_func)
 {
    struct hashtable *hash;
    assert(bits > 0);
@@ -514,6 +982,7 @@ hashtable_make(const uint8_t bits,
    hash->make_func = make_func;
    hash->format_cols_func = format_cols_func;
    hash->format_row_func = format_row_func;
+   hash->json_row_func = json_row_func;
    hash->count = 0;
    hash->table = xcalloc(hash->size, sizeof(*hash->table));
    memset(&(hash->stats), 0, sizeof(hash->stats));
@@ -529,7 +998,21 @@ hosts_db_init(void)
    assert(hosts_db == NULL);
    hosts_db = hashtable_make(HOST_BITS, opt_hosts_max, opt_hosts_keep,
       hash_func_host, free_func_host, key_func_host, find_func_host,
-      make_func_host, format_cols_host, format_row_host);
+      make_func_host, format_cols_host, format_row_host, json_row_host);
+   if (opt_host_graphs != 0)
+      graph_owners = xcalloc(opt_host_graphs, sizeof(*graph_owners));
+
+   assert(pairs_db == NULL);
+   if (opt_pairs_max != 0) {
+      uint8_t bits = PAIR_BITS;
+
+      /* Size for a full table up front, so we don't rehash under load. */
+      while ((1U << bits) < opt_pairs_max + opt_pairs_max / 4 && bits < 31)
+         bits++;
+      pairs_db = hashtable_make(bits, opt_pairs_max, opt_pairs_keep,
+         hash_func_pair, free_func_simple, key_func_pair, find_func_pair,
+         make_func_pair, format_cols_pair, format_row_pair, json_row_pair);
+   }
 }
 
 static void
@@ -596,17 +1079,20 @@ hashtable_search(struct hashtable *h, const void *key)
 {
    uint32_t pos;
    struct bucket *b;
+   unsigned int probes = 0;
 
    h->stats.searches++;
    pos = h->hash_func(h, key) & h->mask;
    b = h->table[pos];
    while (b != NULL) {
+      probes++;
       if (h->find_func(b, key))
-         return (b);
+         break;
       else
          b = b->next;
    }
-   return (NULL);
+   stats_probe(probes);
+   return (b);
 }
 
 typedef enum { NO_REDUCE = 0, ALLOW_REDUCE = 1 } reduce_bool;
@@ -727,7 +1213,7 @@ hashtable_reduce(struct hashtable *ht)
       }
    }
    assert(pos == ht->count);
-   qsort_buckets(table, ht->count, 0, ht->count_keep, TOTAL);
+   sort_buckets(table, ht->count, 0, ht->count_keep, TOTAL);
    cutoff = table[ht->count_keep]->total;
    free(table);
 
@@ -753,6 +1239,7 @@ hashtable_reduce(struct hashtable *ht)
          b = next;
       }
    }
+   ht->stats.deletions += rmd;
    verbosef("hashtable_reduce: removed %u buckets, left %u",
       rmd, ht->count);
    hashtable_rehash(ht, ht->bits); /* is this needed? */
@@ -761,30 +1248,58 @@ hashtable_reduce(struct hashtable *ht)
 /* Reduce hosts_db if needed. */
 void hosts_db_reduce(void)
 {
-   if (hosts_db->count >= hosts_db->count_max)
+   if (hosts_db->count >= hosts_db->count_max) {
+      struct timespec t;
+
+      timer_start(&t);
       hashtable_reduce(hosts_db);
+      stats_time(STATS_REDUCE, &t);
+   }
+}
+
+/* Reduce pairs_db if needed. */
+void pairs_db_reduce(void)
+{
+   if (pairs_db->count >= pairs_db->count_max) {
+      struct timespec t;
+
+      timer_start(&t);
+      hashtable_reduce(pairs_db);
+      stats_time(STATS_REDUCE, &t);
+   }
 }
 
 /* ---------------------------------------------------------------------------
- * Reset hosts_db to empty.
+ * Free all the buckets in a hashtable, leaving it empty.
  */
-void
-hosts_db_reset(void)
+static void
+hashtable_empty(struct hashtable *ht)
 {
    unsigned int i;
 
-   for (i=0; i<hosts_db->size; i++) {
-      struct bucket *next, *b = hosts_db->table[i];
+   for (i=0; i<ht->size; i++) {
+      struct bucket *next, *b = ht->table[i];
       while (b != NULL) {
          next = b->next;
-         hosts_db->free_func(b);
+         ht->free_func(b);
          free(b);
          b = next;
       }
-      hosts_db->table[i] = NULL;
+      ht->table[i] = NULL;
    }
+   ht->count = 0;
+}
+
+/* ---------------------------------------------------------------------------
+ * Reset hosts_db to empty.
+ */
+void
+hosts_db_reset(void)
+{
    verbosef("hosts_db reset to empty, freed %u hosts", hosts_db->count);
-   hosts_db->count = 0;
+   hashtable_empty(hosts_db);
+   if (pairs_db != NULL)
+      hashtable_empty(pairs_db);
 }
 
 /* ---------------------------------------------------------------------------
@@ -807,6 +1322,13 @@ void hosts_db_free(void)
    free(hosts_db->table);
    free(hosts_db);
    hosts_db = NULL;
+
+   hashtable_free(pairs_db);
+   pairs_db = NULL;
+   free(graph_owners);
+   graph_owners = NULL;
+   graph_owners_used = 0;
+   graph_owners_min = 0;
 }
 
 /* ---------------------------------------------------------------------------
@@ -820,7 +1342,7 @@ host_get_port_tcp(struct bucket *host, const uint16_t port)
       h->ports_tcp = hashtable_make(PORT_BITS, opt_ports_max, opt_ports_keep,
          hash_func_short, free_func_simple, key_func_port_tcp,
          find_func_port_tcp, make_func_port_tcp,
-         format_cols_port_tcp, format_row_port_tcp);
+         format_cols_port_tcp, format_row_port_tcp, json_row_port_tcp);
    return (hashtable_find_or_insert(h->ports_tcp, &port, ALLOW_REDUCE));
 }
 
@@ -832,7 +1354,8 @@ host_get_port_tcp_remote(struct bucket *host, const uint16_t port)
       h->ports_tcp_remote = hashtable_make(
           PORT_BITS, opt_ports_max, opt_ports_keep, hash_func_short,
           free_func_simple, key_func_port_tcp, find_func_port_tcp,
-          make_func_port_tcp, format_cols_port_tcp, format_row_port_tcp);
+          make_func_port_tcp, format_cols_port_tcp, format_row_port_tcp,
+          json_row_port_tcp);
    return (hashtable_find_or_insert(h->ports_tcp_remote, &port, ALLOW_REDUCE));
 }
 
@@ -847,7 +1370,7 @@ host_get_port_udp(struct bucket *host, const uint16_t port)
       h->ports_udp = hashtable_make(PORT_BITS, opt_ports_max, opt_ports_keep,
          hash_func_short, free_func_simple, key_func_port_udp,
          find_func_port_udp, make_func_port_udp,
-         format_cols_port_udp, format_row_port_udp);
+         format_cols_port_udp, format_row_port_udp, json_row_port_udp);
    return (hashtable_find_or_insert(h->ports_udp, &port, ALLOW_REDUCE));
 }
 
@@ -859,7 +1382,8 @@ host_get_port_udp_remote(struct bucket *host, const uint16_t port)
       h->ports_udp_remote = hashtable_make(
           PORT_BITS, opt_ports_max, opt_ports_keep, hash_func_short,
           free_func_simple, key_func_port_udp, find_func_port_udp,
-          make_func_port_udp, format_cols_port_udp, format_row_port_udp);
+          make_func_port_udp, format_cols_port_udp, format_row_port_udp,
+          json_row_port_udp);
    return (hashtable_find_or_insert(h->ports_udp_remote, &port, ALLOW_REDUCE));
 }
 
@@ -876,29 +1400,190 @@ host_get_ip_proto(struct bucket *host, const uint8_t proto)
       h->ip_protos = hashtable_make(PROTO_BITS, PROTOS_MAX, PROTOS_KEEP,
          hash_func_byte, free_func_simple, key_func_ip_proto,
          find_func_ip_proto, make_func_ip_proto,
-         format_cols_ip_proto, format_row_ip_proto);
+         format_cols_ip_proto, format_row_ip_proto, json_row_ip_proto);
    return (hashtable_find_or_insert(h->ip_protos, &proto, ALLOW_REDUCE));
 }
 
-static struct str *html_hosts_main(const char *qs);
-static struct str *html_hosts_detail(const char *ip);
-
 /* ---------------------------------------------------------------------------
- * Web interface: delegate the /hosts/ space.
+ * Find or create an icmp_type inside a host.  It's ICMPv6 for IPv6 hosts.
  */
-struct str *
-html_hosts(const char *uri, const char *query)
+struct bucket *
+host_get_icmp_type(struct bucket *host, const uint8_t type,
+                   const uint8_t code)
 {
-   unsigned int i, num_elems;
-   char **elem = split('/', uri, &num_elems);
-   struct str *buf = NULL;
+   struct host *h = &host->u.host;
+   struct bucket *b;
+   const uint16_t type_code = (uint16_t)((type << 8) | code);
+   static const unsigned int ICMP_MAX = 512, ICMP_KEEP = 256;
+   assert(h != NULL);
+   if (h->icmp_types == NULL)
+      h->icmp_types = hashtable_make(PROTO_BITS, ICMP_MAX, ICMP_KEEP,
+         hash_func_short, free_func_simple, key_func_icmp_type,
+         find_func_icmp_type, make_func_icmp_type,
+         format_cols_icmp_type, format_row_icmp_type, json_row_icmp_type);
+   b = hashtable_find_or_insert(h->icmp_types, &type_code, ALLOW_REDUCE);
+   b->u.icmp_type.v6 = (h->addr.family == IPv6);
+   return (b);
+}
+
+/* ---------------------------------------------------------------------------
+ * Find or create a tcp_flags combination inside a host.  There are only 64
+ * of them, so the table is never reduced.
+ */
+struct bucket *
+host_get_tcp_flags(struct bucket *host, const uint8_t flags)
+{
+   struct host *h = &host->u.host;
+   static const unsigned int FLAGS_MAX = 64, FLAGS_KEEP = 64;
+   assert(h != NULL);
+   assert((flags & ~(TH_FIN|TH_SYN|TH_RST|TH_PUSH|TH_ACK|TH_URG)) == 0);
+   if (h->tcp_flags == NULL)
+      h->tcp_flags = hashtable_make(PROTO_BITS, FLAGS_MAX, FLAGS_KEEP,
+         hash_func_byte, free_func_simple, key_func_tcp_flags,
+         find_func_tcp_flags, make_func_tcp_flags,
+         format_cols_tcp_flags, format_row_tcp_flags, json_row_tcp_flags);
+   return (hashtable_find_or_insert(h->tcp_flags, &flags, ALLOW_REDUCE));
+}
+
+/* ---------------------------------------------------------------------------
+ * Find or create the conversation between a and b, which must be ordered
+ * (addr_cmp(a, b) <= 0).  Only valid when the pairs table is enabled.
+ */
+struct bucket *
+pair_get(const struct addr *const a, const struct addr *const b)
+{
+   struct pair key;
+
+   assert(pairs_db != NULL);
+   assert(addr_cmp(a, b) <= 0);
+   memset(&key, 0, sizeof(key));
+   key.a = *a;
+   key.b = *b;
+   return (hashtable_find_or_insert(pairs_db, &key, NO_REDUCE));
+}
+
+/* ---------------------------------------------------------------------------
+ * Bring a host's rates up to the current second.  This is done lazily, when
+ * the host sees traffic or before its rates are read.
+ */
+void
+host_update_rate(struct bucket *host)
+{
+   struct host *h = &host->u.host;
+   int64_t now = (int64_t)now_mono(), idle;
+
+   if (now == h->rate_mono)
+      return;
+   if (now < h->rate_mono) {
+      /* Clock went backwards, restart the current second. */
+      h->rate_mono = now;
+      return;
+   }
+
+   /* Fold in the last second that saw traffic. */
+   h->rate_bytes = h->rate_bytes * RATE_DECAY +
+                   (double)h->rate_cur_bytes * (1 - RATE_DECAY);
+   h->rate_pkts = h->rate_pkts * RATE_DECAY +
+                  (double)h->rate_cur_pkts * (1 - RATE_DECAY);
+   h->rate_cur_bytes = h->rate_cur_pkts = 0;
+
+   /* Decay over the silent seconds since then. */
+   idle = now - h->rate_mono - 1;
+   if (idle >= RATE_IDLE_SECS)
+      h->rate_bytes = h->rate_pkts = 0;
+   else
+      for (; idle > 0; idle--) {
+         h->rate_bytes *= RATE_DECAY;
+         h->rate_pkts *= RATE_DECAY;
+      }
+   h->rate_mono = now;
+}
+
+/* Account for traffic into or out of a host. */
+void
+host_acct_rate(struct bucket *host, const uint64_t bytes, const uint64_t pkts)
+{
+   host_update_rate(host);
+   host->u.host.rate_cur_bytes += bytes;
+   host->u.host.rate_cur_pkts += pkts;
+}
+
+/* Give the host a graph slot: a free one, or the one belonging to the
+ * smallest owner if this host is half again as big.  Returns 0 if there
+ * isn't one for it.
+ */
+static int
+host_claim_graph(struct bucket *host)
+{
+   unsigned int i, slot = 0;
+
+   if (graph_owners_used < opt_host_graphs) {
+      for (i=0; graph_owners[i] != NULL; i++)
+         ;
+      slot = i + 1;
+      graph_owners_used++;
+   } else {
+      const struct bucket *min;
+
+      if ((graph_owners_min == 0) || (graph_owners_min_mono != now_mono())) {
+         graph_owners_min = 1;
+         for (i=1; i<opt_host_graphs; i++)
+            if (graph_owners[i]->total <
+                graph_owners[graph_owners_min - 1]->total)
+               graph_owners_min = i + 1;
+         graph_owners_min_mono = now_mono();
+      }
+      min = graph_owners[graph_owners_min - 1];
+      if (host->total <= min->total + min->total / 2)
+         return 0;
+      slot = graph_owners_min;
+      graph_owners[slot - 1]->u.host.graph = 0;
+      graph_owners_min = 0; /* the new owner is bigger */
+   }
+   graph_owners[slot - 1] = host;
+   host->u.host.graph = slot;
+   graph_host_clear(slot);
+   return 1;
+}
+
+/* Account for traffic into or out of a host's graphs, if it has them. */
+void
+host_acct_graph(struct bucket *host, const uint64_t in, const uint64_t out)
+{
+   if (graph_owners == NULL)
+      return;
+   if ((host->u.host.graph == 0) && !host_claim_graph(host))
+      return;
+   graph_host_acct(host->u.host.graph, in, out);
+}
+
+static void
+host_update_rate_foreach(const struct bucket *b, const void *user_data _unused_)
+{
+   host_update_rate((struct bucket *)b);
+}
+
+static struct str *html_table_main(const char *qs, const char *title,
+   struct hashtable *ht);
+static void html_prefixes(struct str *buf);
+static struct str *html_hosts_detail(const char *ip);
+
+/* ---------------------------------------------------------------------------
+ * Web interface: delegate the /hosts/ space.
+ */
+struct str *
+html_hosts(const char *uri, const char *query)
+{
+   unsigned int i, num_elems;
+   char **elem = split('/', uri, &num_elems);
+   struct str *buf = NULL;
 
    assert(num_elems >= 1);
    assert(strcmp(elem[0], "hosts") == 0);
 
    if (num_elems == 1)
       /* /hosts/ */
-      buf = html_hosts_main(query);
+      buf = html_table_main(query, "Hosts", hosts_db);
    else if (num_elems == 2)
       /* /hosts/<IP of host>/ */
       buf = html_hosts_detail(elem[1]);
@@ -910,6 +1595,124 @@ html_hosts(const char *uri, const char *query)
    other codes to be possible */
 }
 
+/* ---------------------------------------------------------------------------
+ * Web interface: /hosts/<IP of host>/graphs.xml
+ */
+struct str *
+xml_hosts(const char *uri)
+{
+   unsigned int i, num_elems;
+   char **elem = split('/', uri, &num_elems);
+   struct str *buf = NULL;
+
+   if ((num_elems == 3) && (strcmp(elem[2], "graphs.xml") == 0)) {
+      const struct bucket *h = host_search(elem[1]);
+
+      if ((h != NULL) && (h->u.host.graph != 0))
+         buf = xml_host_graphs(h->u.host.graph, h->total,
+                               h->pkts_in + h->pkts_out);
+   }
+
+   for (i=0; i<num_elems; i++)
+      free(elem[i]);
+   free(elem);
+   return (buf);
+}
+
+/* ---------------------------------------------------------------------------
+ * Web interface: the /pairs/ page.
+ */
+struct str *
+html_pairs(const char *uri, const char *query)
+{
+   struct str *buf;
+
+   if (strcmp(uri, "/pairs/") != 0)
+      return (NULL);
+   if (pairs_db != NULL)
+      return (html_table_main(query, "Conversations", pairs_db));
+
+   buf = str_make();
+   html_open(buf, "Conversations", /*path_depth=*/1, /*want_graph_js=*/0);
+   str_append(buf, "<p>Conversations between hosts aren't being tracked. "
+                   "Use the --pairs-max option to enable them.</p>\n");
+   html_close(buf);
+   return (buf);
+}
+
+/* ---------------------------------------------------------------------------
+ * Web interface: top talkers since startup, from the sketch.
+ */
+struct str *
+html_top(const char *uri)
+{
+   struct str *buf;
+   struct addr addrs[SKETCH_TOP];
+   unsigned int i, n;
+
+   if (strcmp(uri, "/top/") != 0)
+      return (NULL);
+
+   buf = str_make();
+   html_open(buf, "Top talkers", /*path_depth=*/1, /*want_graph_js=*/0);
+   if (!sketch_enabled()) {
+      str_append(buf, "<p>Top talkers aren't being tracked. "
+                      "Use the --sketch-width option to enable them.</p>\n");
+      html_close(buf);
+      return (buf);
+   }
+
+   html_prefixes(buf);
+   str_appendf(buf, "<p>All traffic since startup, including hosts that have "
+      "been dropped from the hosts table.  These are estimates: about 96%% "
+      "of them are too high by at most %'qu bytes, and none are too "
+      "low.</p>\n", (qu)sketch_error());
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>#</th>\n"
+      " <th>IP</th>\n"
+      " <th>Hostname</th>\n"
+      " <th>In</th>\n"
+      " <th>Out</th>\n"
+      " <th>Total</th>\n"
+      " <th>Packets</th>\n"
+      "</tr>\n");
+
+   n = sketch_top(addrs, SKETCH_TOP);
+   for (i = 0; i < n; i++) {
+      const struct bucket *b = host_find(&addrs[i]);
+      const char *ip = addr_to_str(&addrs[i]);
+      struct sketch_count c;
+
+      sketch_estimate(&addrs[i], &c);
+      str_appendf(buf,
+         "<tr>\n"
+         " <td class=\"num\">%u</td>\n", i + 1);
+      /* Only hosts still in the table have a page. */
+      if (b != NULL)
+         str_appendf(buf, " <td><a href=\"../hosts/%s/\">%s</a></td>\n"
+                          " <td>%s</td>\n",
+            ip, ip, (b->u.host.dns == NULL) ? "" : b->u.host.dns);
+      else
+         str_appendf(buf, " <td>%s</td>\n"
+                          " <td></td>\n", ip);
+      str_appendf(buf,
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         "</tr>\n",
+         (qu)c.in,
+         (qu)c.out,
+         (qu)(c.in + c.out),
+         (qu)(c.pkts_in + c.pkts_out));
+   }
+   str_append(buf, "</table>\n");
+   html_close(buf);
+   return (buf);
+}
+
 /* ---------------------------------------------------------------------------
  * Get an array of pointers to all the buckets in the hashtable,
  * or NULL if the hashtable is NULL or empty.
@@ -989,7 +1792,7 @@ format_table(struct str *buf, struct hashtable *ht, unsigned int start,
       end = MIN(ht->count, (uint32_t)start+MAX_ENTRIES);
 
    str_appendf(buf, "(%u-%u of %u)<br>\n", start+1, end, ht->count);
-   qsort_buckets(table, ht->count, start, end, sort);
+   sort_buckets(table, ht->count, start, end, sort);
    ht->format_cols_func(buf);
 
    for (i=start; i<end; i++) {
@@ -1001,10 +1804,109 @@ format_table(struct str *buf, struct hashtable *ht, unsigned int start,
 }
 
 /* ---------------------------------------------------------------------------
- * Web interface: sorted table of hosts.
+ * Format the busiest conversations involving the given host into HTML.
  */
+static void
+format_pairs_of_host(struct str *buf, const struct addr *const a)
+{
+   const struct bucket **table;
+   unsigned int i, n, end;
+
+   table = hashtable_list_buckets(pairs_db);
+   if (table == NULL) {
+      str_append(buf, "<p>The table is empty.</p>\n");
+      return;
+   }
+
+   /* Keep only the pairs this host is part of. */
+   for (i=0, n=0; i<pairs_db->count; i++)
+      if (addr_equal(&(table[i]->u.pair.a), a) ||
+          addr_equal(&(table[i]->u.pair.b), a))
+         table[n++] = table[i];
+   if (n == 0) {
+      free(table);
+      str_append(buf, "<p>The table is empty.</p>\n");
+      return;
+   }
+
+   end = MIN(n, MAX_ENTRIES);
+   str_appendf(buf, "(1-%u of %u)<br>\n", end, n);
+   sort_buckets(table, n, 0, end, TOTAL);
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>Peer</th>\n"
+      " <th>To peer</th>\n"
+      " <th>From peer</th>\n"
+      " <th>Total</th>\n"
+      " <th>Packets</th>\n");
+   if (opt_want_lastseen) str_append(buf,
+      " <th>Last seen</th>\n");
+   str_append(buf,
+      "</tr>\n");
+
+   for (i=0; i<end; i++) {
+      const struct bucket *b = table[i];
+      const struct pair *p = &(b->u.pair);
+      /* Our host is either a (sends "out") or b (sends "in"). */
+      int is_a = addr_equal(&(p->a), a);
+      const char *peer = addr_to_str(is_a ? &(p->b) : &(p->a));
+
+      str_appendf(buf,
+         "<tr>\n"
+         " <td><a href=\"../%s/\">%s</a></td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n"
+         " <td class=\"num\">%'qu</td>\n",
+         peer, peer,
+         (qu)(is_a ? b->out : b->in),
+         (qu)(is_a ? b->in : b->out),
+         (qu)b->total,
+         (qu)(b->pkts_in + b->pkts_out));
+      if (opt_want_lastseen)
+         format_cell_last_seen(buf, p->last_seen_mono);
+      str_append(buf, "</tr>\n");
+   }
+   free(table);
+   str_append(buf, "</table>\n");
+}
+
+/* ---------------------------------------------------------------------------
+ * Web interface: sorted table of hosts or pairs.
+ */
+static void
+html_prefixes(struct str *buf)
+{
+   if ((opt_local_prefix4 == 32) && (opt_local_prefix6 == 128) &&
+       (opt_remote_prefix4 == 32) && (opt_remote_prefix6 == 128))
+      return;
+   str_appendf(buf, "<p>Addresses are folded into prefixes: "
+      "/%u and /%u for local hosts, /%u and /%u for remote hosts.</p>\n",
+      opt_local_prefix4, opt_local_prefix6,
+      opt_remote_prefix4, opt_remote_prefix6);
+}
+
+/* Returns 0 if the "sort" parameter isn't one that ht can do. */
+static int
+parse_sort(const char *qs_sort, const struct hashtable *ht,
+   enum sort_dir *sort)
+{
+   if (qs_sort == NULL) *sort = TOTAL;
+   else if (strcmp(qs_sort, "total") == 0) *sort = TOTAL;
+   else if (strcmp(qs_sort, "in") == 0) *sort = IN;
+   else if (strcmp(qs_sort, "out") == 0) *sort = OUT;
+   else if (strcmp(qs_sort, "packets") == 0) *sort = PACKETS;
+   else if ((ht == hosts_db) && (strcmp(qs_sort, "lastseen") == 0))
+      *sort = LASTSEEN;
+   else if ((ht == hosts_db) && (strcmp(qs_sort, "rate") == 0)) *sort = RATE;
+   else
+      return 0;
+   return 1;
+}
+
 static struct str *
-html_hosts_main(const char *qs)
+html_table_main(const char *qs, const char *title, struct hashtable *ht)
 {
    struct str *buf = str_make();
    char *qs_start, *qs_sort, *qs_full, *ep;
@@ -1021,13 +1923,7 @@ html_hosts_main(const char *qs)
       free(qs_full);
    }
 
-   /* validate sort */
-   if (qs_sort == NULL) sort = TOTAL;
-   else if (strcmp(qs_sort, "total") == 0) sort = TOTAL;
-   else if (strcmp(qs_sort, "in") == 0) sort = IN;
-   else if (strcmp(qs_sort, "out") == 0) sort = OUT;
-   else if (strcmp(qs_sort, "lastseen") == 0) sort = LASTSEEN;
-   else {
+   if (!parse_sort(qs_sort, ht, &sort)) {
       str_append(buf, "Error: invalid value for \"sort\".\n");
       goto done;
    }
@@ -1042,7 +1938,7 @@ html_hosts_main(const char *qs)
          goto done;
       }
       if ((errno == ERANGE) ||
-          (start < 0) || (start >= (int)hosts_db->count)) {
+          (start < 0) || (start >= (int)ht->count)) {
          str_append(buf, "Error: \"start\" is out of bounds.\n");
          goto done;
       }
@@ -1052,8 +1948,11 @@ html_hosts_main(const char *qs)
 #define NEXT "next page &gt;&gt;&gt;"
 #define FULL "full table"
 
-   html_open(buf, "Hosts", /*path_depth=*/1, /*want_graph_js=*/0);
-   format_table(buf, hosts_db, start, sort, full);
+   html_open(buf, title, /*path_depth=*/1, /*want_graph_js=*/0);
+   html_prefixes(buf);
+   if (ht == hosts_db)
+      hashtable_foreach(hosts_db, &host_update_rate_foreach, NULL);
+   format_table(buf, ht, start, sort, full);
 
    /* <prev | full | stats | next> */
    sortstr = qs_sort;
@@ -1073,7 +1972,7 @@ html_hosts_main(const char *qs)
       str_appendf(buf, " | <a href=\"?full=yes&sort=%s\">" FULL "</a>",
          sortstr);
 
-   if (start+MAX_ENTRIES < (int)hosts_db->count)
+   if (start+MAX_ENTRIES < (int)ht->count)
       str_appendf(buf, " | <a href=\"?start=%d&sort=%s\">" NEXT "</a>",
          start+MAX_ENTRIES, sortstr);
    else
@@ -1109,7 +2008,8 @@ static struct str *html_hosts_detail(const char *ip) {
 
    /* Overview. */
    buf = str_make();
-   html_open(buf, ip, /*path_depth=*/2, /*want_graph_js=*/0);
+   html_open(buf, ip, /*path_depth=*/2,
+             /*want_graph_js=*/(h->u.host.graph != 0));
    if (strcmp(ip, canonical) != 0)
       str_appendf(buf, "(canonically <b>%s</b>)\n", canonical);
    str_appendf(buf,
@@ -1166,10 +2066,37 @@ static struct str *html_hosts_detail(const char *ip) {
       " <b>In:</b> %'qu<br>\n"
       " <b>Out:</b> %'qu<br>\n"
       " <b>Total:</b> %'qu<br>\n"
+      "</p>\n"
+      "<p>\n"
+      " <b>Packets in:</b> %'qu<br>\n"
+      " <b>Packets out:</b> %'qu<br>\n"
+      " <b>Packets total:</b> %'qu<br>\n"
       "</p>\n",
       (qu)h->in,
       (qu)h->out,
-      (qu)h->total);
+      (qu)h->total,
+      (qu)h->pkts_in,
+      (qu)h->pkts_out,
+      (qu)(h->pkts_in + h->pkts_out));
+
+   host_update_rate(h);
+   str_appendf(buf,
+      "<p>\n"
+      " <b>Rate:</b> %'qu bytes/sec, %'qu packets/sec\n"
+      "</p>\n",
+      (qu)h->u.host.rate_bytes,
+      (qu)h->u.host.rate_pkts);
+
+   str_appendf(buf,
+      "<p>\n"
+      " <b>Distinct peers:</b> about %'qu<br>\n"
+      " <b>Distinct ports sent to:</b> about %'qu<br>\n"
+      "</p>\n",
+      (qu)hll_count(&(h->u.host.peers)),
+      (qu)hll_count(&(h->u.host.ports)));
+
+   if (h->u.host.graph != 0)
+      html_host_graphs(buf);
 
    str_append(buf, "<h3>TCP ports on this host</h3>\n");
    format_table(buf, h->u.host.ports_tcp, 0,TOTAL,0);
@@ -1183,97 +2110,870 @@ static struct str *html_hosts_detail(const char *ip) {
    str_append(buf, "<h3>UDP ports on remote hosts</h3>\n");
    format_table(buf, h->u.host.ports_udp_remote, 0,TOTAL,0);
 
-   str_append(buf, "<h3>IP protocols</h3>\n");
-   format_table(buf, h->u.host.ip_protos, 0,TOTAL,0);
+   str_append(buf, "<h3>IP protocols</h3>\n");
+   format_table(buf, h->u.host.ip_protos, 0,TOTAL,0);
+
+   str_appendf(buf, "<h3>%s types</h3>\n",
+               (h->u.host.addr.family == IPv6) ? "ICMPv6" : "ICMP");
+   format_table(buf, h->u.host.icmp_types, 0,TOTAL,0);
+
+   str_append(buf, "<h3>TCP flags</h3>\n");
+   format_table(buf, h->u.host.tcp_flags, 0,TOTAL,0);
+
+   if (pairs_db != NULL) {
+      str_append(buf, "<h3>Conversations</h3>\n");
+      format_pairs_of_host(buf, &(h->u.host.addr));
+   }
+
+   str_append(buf, "<br>\n");
+   html_close(buf);
+   return buf;
+}
+
+/* ---------------------------------------------------------------------------
+ * JSON API: the /api/hosts/ space.
+ */
+
+/* A "filter" parameter: an address, or a network like 10.0.0.0/8. */
+struct host_filter {
+   struct addr net;
+   unsigned int len;
+};
+
+static int
+parse_filter(const char *qs_filter, struct host_filter *f)
+{
+   const char *slash = strchr(qs_filter, '/');
+   char *ip;
+   unsigned int max;
+   int ok;
+
+   if (slash == NULL)
+      ip = xstrdup(qs_filter);
+   else
+      ip = split_string(qs_filter, 0, (size_t)(slash - qs_filter));
+   ok = (str_to_addr(ip, &(f->net)) == 0);
+   free(ip);
+   if (!ok)
+      return 0;
+   max = (f->net.family == IPv4) ? 32 : 128;
+   f->len = max;
+   if (slash != NULL) {
+      char *ep;
+      unsigned long len;
+
+      errno = 0;
+      len = strtoul(slash + 1, &ep, 10);
+      if ((slash[1] == '\0') || (*ep != '\0') || (errno == ERANGE) ||
+          (len > max))
+         return 0;
+      f->len = (unsigned int)len;
+   }
+   addr_prefix(&(f->net), f->len);
+   return 1;
+}
+
+static int
+filter_match(const struct host_filter *f, const struct bucket *b)
+{
+   struct addr a = b->u.host.addr;
+
+   if (a.family != f->net.family)
+      return 0;
+   addr_prefix(&a, f->len);
+   return addr_equal(&a, &(f->net));
+}
+
+/* Same as format_table(), but limit is the number of rows (0 for all) and
+ * there can be a filter if ht is the hosts_db.  Returns how many rows
+ * there were before start and limit.
+ */
+static unsigned int
+json_table(struct json *j, const char *key, struct hashtable *ht,
+   unsigned int start, const unsigned int limit, const enum sort_dir sort,
+   const struct host_filter *f)
+{
+   const struct bucket **table;
+   unsigned int i, n, end;
+
+   json_array(j, key);
+   table = hashtable_list_buckets(ht);
+   if (table == NULL) {
+      json_end(j);
+      return 0;
+   }
+   n = ht->count;
+   if (f != NULL) {
+      unsigned int kept = 0;
+
+      assert(ht == hosts_db);
+      for (i=0; i<n; i++)
+         if (filter_match(f, table[i]))
+            table[kept++] = table[i];
+      n = kept;
+   }
+   start = MIN(start, n);
+   if ((limit == 0) || (limit > n - start))
+      end = n;
+   else
+      end = start + limit;
+
+   if (start < end)
+      sort_buckets(table, n, start, end, sort);
+   for (i=start; i<end; i++)
+      ht->json_row_func(j, table[i]);
+   free(table);
+   json_end(j);
+   return n;
+}
+
+static struct str *
+json_error(const char *msg)
+{
+   struct str *buf = str_make();
+   struct json j;
+
+   json_init(&j, buf);
+   json_object(&j, NULL);
+   json_str(&j, "error", msg);
+   json_end(&j);
+   return buf;
+}
+
+/* Returns 0 if it isn't a number. */
+static int
+parse_uint(const char *qs_num, unsigned int *num)
+{
+   char *ep;
+   unsigned long n;
+
+   if (qs_num == NULL)
+      return 1; /* keep the default */
+   errno = 0;
+   n = strtoul(qs_num, &ep, 10);
+   if ((*qs_num == '\0') || (*ep != '\0') || (errno == ERANGE) ||
+       (n > UINT32_MAX))
+      return 0;
+   *num = (unsigned int)n;
+   return 1;
+}
+
+static struct str *
+json_hosts_main(const char *qs, int *bad_query)
+{
+   char *qs_start, *qs_limit, *qs_sort, *qs_filter;
+   unsigned int start = 0, limit = 0, n;
+   enum sort_dir sort;
+   struct host_filter f;
+   struct str *buf = NULL;
+   struct json j;
+
+   qs_start = qs_get(qs, "start");
+   qs_limit = qs_get(qs, "limit");
+   qs_sort = qs_get(qs, "sort");
+   qs_filter = qs_get(qs, "filter");
+
+   if (!parse_sort(qs_sort, hosts_db, &sort))
+      buf = json_error("invalid value for \"sort\"");
+   else if (!parse_uint(qs_start, &start))
+      buf = json_error("\"start\" is not a number");
+   else if (!parse_uint(qs_limit, &limit))
+      buf = json_error("\"limit\" is not a number");
+   else if ((qs_filter != NULL) && !parse_filter(qs_filter, &f))
+      buf = json_error("\"filter\" is not an address or network");
+   if (buf != NULL) {
+      *bad_query = 1;
+      goto done;
+   }
+
+   hashtable_foreach(hosts_db, &host_update_rate_foreach, NULL);
+   buf = str_make();
+   json_init(&j, buf);
+   json_object(&j, NULL);
+   n = json_table(&j, "hosts", hosts_db, start, limit, sort,
+                  (qs_filter == NULL) ? NULL : &f);
+   json_uint(&j, "start", MIN(start, n));
+   json_uint(&j, "matched", n);
+   json_end(&j);
+done:
+   free(qs_start);
+   free(qs_limit);
+   free(qs_sort);
+   free(qs_filter);
+   return buf;
+}
+
+static struct str *
+json_hosts_detail(const char *ip)
+{
+   struct bucket *h;
+   struct str *buf;
+   struct json j;
+
+   h = host_search(ip);
+   if (h == NULL)
+      return (NULL); /* no such host */
+   host_update_rate(h);
+
+   buf = str_make();
+   json_init(&j, buf);
+   json_object(&j, NULL);
+   json_host_fields(&j, h);
+   json_uint(&j, "peers", hll_count(&(h->u.host.peers)));
+   json_uint(&j, "ports_sent_to", hll_count(&(h->u.host.ports)));
+   json_table(&j, "tcp_ports", h->u.host.ports_tcp, 0, 0, TOTAL, NULL);
+   json_table(&j, "tcp_remote_ports", h->u.host.ports_tcp_remote,
+              0, 0, TOTAL, NULL);
+   json_table(&j, "udp_ports", h->u.host.ports_udp, 0, 0, TOTAL, NULL);
+   json_table(&j, "udp_remote_ports", h->u.host.ports_udp_remote,
+              0, 0, TOTAL, NULL);
+   json_table(&j, "ip_protos", h->u.host.ip_protos, 0, 0, TOTAL, NULL);
+   json_table(&j, "icmp_types", h->u.host.icmp_types, 0, 0, TOTAL, NULL);
+   json_table(&j, "tcp_flags", h->u.host.tcp_flags, 0, 0, TOTAL, NULL);
+   json_end(&j);
+   return buf;
+}
+
+struct str *
+json_hosts(const char *uri, const char *query, int *bad_query)
+{
+   unsigned int i, num_elems;
+   char **elem = split('/', uri, &num_elems);
+   struct str *buf = NULL;
+
+   assert(num_elems >= 2);
+   assert(strcmp(elem[1], "hosts") == 0);
+
+   *bad_query = 0;
+   if (num_elems == 2)
+      /* /api/hosts/ */
+      buf = json_hosts_main(query, bad_query);
+   else if (num_elems == 3)
+      /* /api/hosts/<IP of host> */
+      buf = json_hosts_detail(elem[2]);
+
+   for (i=0; i<num_elems; i++)
+      free(elem[i]);
+   free(elem);
+   return (buf);
+}
+
+/* ---------------------------------------------------------------------------
+ * Database import and export code:
+ * Initially written and contributed by Ben Stewart.
+ * copyright (c) 2007-2014 Ben Stewart, Emil Mikulic.
+ */
+static int hosts_db_export_ip(const struct hashtable *h, const int fd);
+static int hosts_db_export_tcp(const char magic, const struct hashtable *h,
+                               const int fd);
+static int hosts_db_export_udp(const char magic, const struct hashtable *h,
+                               const int fd);
+static int hosts_db_export_icmp(const struct hashtable *h, const int fd);
+static int hosts_db_export_flags(const struct hashtable *h, const int fd);
+static int hosts_db_export_graphs(const struct bucket *b, const int fd);
+
+static const char
+   export_proto_ip         = 'P',
+   export_proto_tcp        = 'T',
+   export_proto_tcp_remote = 't',
+   export_proto_udp        = 'U',
+   export_proto_udp_remote = 'u',
+   export_proto_icmp       = 'I',
+   export_proto_tcp_flags  = 'F',
+   export_host_graphs      = 'G';
+
+static const unsigned char
+   export_tag_host_ver1[] = {'H', 'S', 'T', 0x01},
+   export_tag_host_ver2[] = {'H', 'S', 'T', 0x02},
+   export_tag_host_ver3[] = {'H', 'S', 'T', 0x03},
+   export_tag_host_ver4[] = {'H', 'S', 'T', 0x04},
+   export_tag_host_ver5[] = {'H', 'S', 'T', 0x05},
+   export_tag_host_ver6[] = {'H', 'S', 'T', 0x06},
+   export_tag_host_ver7[] = {'H', 'S', 'T', 0x07};
+
+/* ---------------------------------------------------------------------------
+ * Web interface: export stats in Prometheus text format on /metrics
+ *
+ * A scrape can be big, so the samples are put together with str_append()
+ * and the hand-written number and address formatters, without going
+ * through a format string for each one.
+ */
+struct metrics_filter {
+   unsigned int top;    /* busiest hosts and pairs, 0 for all */
+   int family;          /* IPv4, IPv6, or 0 for both */
+   int local_only;
+};
+
+static void
+metric_help(struct str *buf, const char *metric, const char *type,
+   const char *help)
+{
+   str_append(buf, "# HELP ");
+   str_append(buf, metric);
+   str_append(buf, " ");
+   str_append(buf, help);
+   str_append(buf, "\n# TYPE ");
+   str_append(buf, metric);
+   str_append(buf, " ");
+   str_append(buf, type);
+   str_append(buf, "\n");
+}
+
+/* Starts a sample, up to and including the interface label. */
+static void
+metric_key(struct str *buf, const char *metric)
+{
+   str_append(buf, metric);
+   str_append(buf, "{interface=\"");
+   str_append(buf, title_interfaces);
+   str_append(buf, "\"");
+}
+
+static void
+metric_label(struct str *buf, const char *name, const char *val)
+{
+   str_append(buf, ",");
+   str_append(buf, name);
+   str_append(buf, "=\"");
+   str_append(buf, val);
+   str_append(buf, "\"");
+}
+
+static void
+metric_label_addr(struct str *buf, const char *name,
+   const struct addr *const a)
+{
+   char ip[INET6_ADDRSTRLEN];
+   const size_t len = addr_fmt(a, ip);
+
+   str_append(buf, ",");
+   str_append(buf, name);
+   str_append(buf, "=\"");
+   str_appendn(buf, ip, len);
+   str_append(buf, "\"");
+}
+
+static void
+metric_label_uint(struct str *buf, const char *name, const uint64_t val)
+{
+   str_append(buf, ",");
+   str_append(buf, name);
+   str_append(buf, "=\"");
+   str_appendu(buf, val);
+   str_append(buf, "\"");
+}
+
+/* Ends a sample. */
+static void
+metric_value(struct str *buf, const uint64_t val)
+{
+   str_append(buf, "} ");
+   str_appendu(buf, val);
+   str_append(buf, "\n");
+}
+
+static void
+metric_host_key(struct str *buf, const char *metric, const struct bucket *b)
+{
+   metric_key(buf, metric);
+   metric_label_addr(buf, "ip", &(b->u.host.addr));
+   if (hosts_db_show_macs)
+      str_appendf(buf, ",mac=\"%x:%x:%x:%x:%x:%x\"",
+         b->u.host.mac_addr[0],
+         b->u.host.mac_addr[1],
+         b->u.host.mac_addr[2],
+         b->u.host.mac_addr[3],
+         b->u.host.mac_addr[4],
+         b->u.host.mac_addr[5]);
+}
+
+/* Both directions of a counter. */
+static void
+metric_host_dirs(struct str *buf, const char *metric, const struct bucket *b,
+   const uint64_t in, const uint64_t out)
+{
+   metric_host_key(buf, metric, b);
+   metric_label(buf, "dir", "in");
+   metric_value(buf, in);
+   metric_host_key(buf, metric, b);
+   metric_label(buf, "dir", "out");
+   metric_value(buf, out);
+}
+
+static int
+metrics_want(const struct metrics_filter *f, const struct addr *const a)
+{
+   if ((f->family != 0) && ((int)a->family != f->family))
+      return 0;
+   if (f->local_only && !acct_is_local(a))
+      return 0;
+   return 1;
+}
+
+/* The buckets of ht that pass the filter, busiest first if there's a top
+ * limit, otherwise in no particular order.  Returns NULL if there are
+ * none.
+ */
+static const struct bucket **
+metrics_buckets(struct hashtable *ht, const struct metrics_filter *f,
+   unsigned int *count)
+{
+   const struct bucket **table = hashtable_list_buckets(ht);
+   unsigned int i, n = 0;
+
+   *count = 0;
+   if (table == NULL)
+      return NULL;
+   for (i=0; i<ht->count; i++) {
+      const struct bucket *b = table[i];
+      int want;
+
+      if (ht == hosts_db)
+         want = metrics_want(f, &(b->u.host.addr));
+      else
+         want = (metrics_want(f, &(b->u.pair.a)) ||
+                 metrics_want(f, &(b->u.pair.b)));
+      if (want)
+         table[n++] = b;
+   }
+   if ((f->top != 0) && (f->top < n)) {
+      sort_buckets(table, n, 0, f->top, TOTAL);
+      n = f->top;
+   }
+   if (n == 0) {
+      free(table);
+      return NULL;
+   }
+   *count = n;
+   return table;
+}
+
+static void
+metrics_global(struct str *buf)
+{
+   metric_help(buf, "bytes_total", "counter",
+      "Total number of network bytes seen.");
+   metric_key(buf, "bytes_total");
+   metric_value(buf, acct_total_bytes);
+
+   metric_help(buf, "packets_total", "counter",
+      "Total number of network packets seen.");
+   metric_key(buf, "packets_total");
+   metric_value(buf, acct_total_packets);
+
+   metric_help(buf, "pcap_packets_received_total", "counter",
+      "Packets received by the capture, as reported by pcap.");
+   metric_key(buf, "pcap_packets_received_total");
+   metric_value(buf, cap_pkts_recv);
+
+   metric_help(buf, "pcap_packets_dropped_total", "counter",
+      "Packets dropped by the capture, as reported by pcap.");
+   metric_key(buf, "pcap_packets_dropped_total");
+   metric_value(buf, cap_pkts_drop);
+}
+
+static void
+metric_table(struct str *buf, const char *metric, const char *table,
+   const char *op, const uint64_t val)
+{
+   metric_key(buf, metric);
+   metric_label(buf, "table", table);
+   if (op != NULL)
+      metric_label(buf, "op", op);
+   metric_value(buf, val);
+}
+
+static void
+metrics_hashtables(struct str *buf)
+{
+   const struct {
+      const char *name;
+      const struct hashtable *ht;
+   } t[2] = { { "hosts", hosts_db }, { "pairs", pairs_db } };
+   int i;
+
+   metric_help(buf, "hashtable_entries", "gauge",
+      "Number of entries in the hosts and pairs tables.");
+   for (i=0; i<2; i++)
+      if (t[i].ht != NULL)
+         metric_table(buf, "hashtable_entries", t[i].name, NULL,
+            t[i].ht->count);
+
+   metric_help(buf, "hashtable_buckets", "gauge",
+      "Number of hash buckets in the hosts and pairs tables.");
+   for (i=0; i<2; i++)
+      if (t[i].ht != NULL)
+         metric_table(buf, "hashtable_buckets", t[i].name, NULL,
+            t[i].ht->size);
+
+   metric_help(buf, "hashtable_operations_total", "counter",
+      "Operations on the hosts and pairs tables.");
+   for (i=0; i<2; i++)
+      if (t[i].ht != NULL) {
+         static const char metric[] = "hashtable_operations_total";
+
+         metric_table(buf, metric, t[i].name, "insert",
+            t[i].ht->stats.inserts);
+         metric_table(buf, metric, t[i].name, "search",
+            t[i].ht->stats.searches);
+         metric_table(buf, metric, t[i].name, "delete",
+            t[i].ht->stats.deletions);
+         metric_table(buf, metric, t[i].name, "rehash",
+            t[i].ht->stats.rehashes);
+      }
+}
+
+/* One series of a histogram: the cumulative buckets, then the sum and the
+ * count.  The last bucket is +Inf, so it only uses num-1 bounds.
+ */
+static void
+metric_histogram(struct str *buf, const char *metric, const char *label,
+   const char *val, const uint64_t *buckets, const uint64_t *bounds,
+   const unsigned int num, const uint64_t sum)
+{
+   char name[64];
+   uint64_t count = 0;
+   unsigned int i;
+
+   snprintf(name, sizeof(name), "%s_bucket", metric);
+   for (i=0; i<num; i++) {
+      count += buckets[i];
+      metric_key(buf, name);
+      if (label != NULL)
+         metric_label(buf, label, val);
+      if (i < num - 1)
+         metric_label_uint(buf, "le", bounds[i]);
+      else
+         metric_label(buf, "le", "+Inf");
+      metric_value(buf, count);
+   }
+   snprintf(name, sizeof(name), "%s_sum", metric);
+   metric_key(buf, name);
+   if (label != NULL)
+      metric_label(buf, label, val);
+   metric_value(buf, sum);
+   snprintf(name, sizeof(name), "%s_count", metric);
+   metric_key(buf, name);
+   if (label != NULL)
+      metric_label(buf, label, val);
+   metric_value(buf, count);
+}
+
+/* darkstat's own workings, as on /debug/stats. */
+static void
+metrics_stats(struct str *buf)
+{
+   static const char latency[] = "stage_latency_nanoseconds";
+   static const char probe[] = "hashtable_probe_length";
+   const struct stats_probes *p = stats_get_probes();
+   uint64_t bounds[STATS_BUCKETS], probe_bounds[STATS_PROBES];
+   uint64_t in_use, from_os;
+   const char *name;
+   unsigned int i, recv, drop;
+
+   for (i=0; i<STATS_BUCKETS; i++)
+      bounds[i] = stats_bucket_nsec(i);
+   metric_help(buf, latency, "histogram",
+      "Time taken by each stage of darkstat's work.");
+   for (i=0; i<NUM_STATS_STAGES; i++) {
+      const struct stats_hist *h = stats_get((enum stats_stage)i);
+
+      metric_histogram(buf, latency, "stage",
+         stats_stage_name((enum stats_stage)i),
+         h->bucket, bounds, STATS_BUCKETS, h->sum_nsec);
+   }
+
+   for (i=0; i<STATS_PROBES; i++)
+      probe_bounds[i] = i;
+   metric_help(buf, probe, "histogram",
+      "Buckets compared per hashtable search.");
+   metric_histogram(buf, probe, NULL, NULL,
+      p->searches, probe_bounds, STATS_PROBES, p->sum);
+
+   if (stats_malloc(&in_use, &from_os)) {
+      metric_help(buf, "malloc_in_use_bytes", "gauge",
+         "Memory allocated by darkstat.");
+      metric_key(buf, "malloc_in_use_bytes");
+      metric_value(buf, in_use);
+
+      metric_help(buf, "malloc_system_bytes", "gauge",
+         "Memory the allocator got from the system.");
+      metric_key(buf, "malloc_system_bytes");
+      metric_value(buf, from_os);
+   }
+
+   metric_help(buf, "dns_queue_length", "gauge",
+      "DNS lookups waiting for an answer.");
+   metric_key(buf, "dns_queue_length");
+   metric_value(buf, dns_queue_len());
+
+   metric_help(buf, "pcap_device_packets_received_total", "counter",
+      "Packets received by the capture on each interface.");
+   for (i=0; cap_iface_stats(i, &name, &recv, &drop); i++) {
+      metric_key(buf, "pcap_device_packets_received_total");
+      metric_label(buf, "device", name);
+      metric_value(buf, recv);
+   }
+
+   metric_help(buf, "pcap_device_packets_dropped_total", "counter",
+      "Packets dropped by the capture on each interface.");
+   for (i=0; cap_iface_stats(i, &name, &recv, &drop); i++) {
+      metric_key(buf, "pcap_device_packets_dropped_total");
+      metric_label(buf, "device", name);
+      metric_value(buf, drop);
+   }
+}
+
+/* The hosts and pairs tables, for /debug/stats. */
+void
+html_hashtable_stats(struct str *buf)
+{
+   const struct {
+      const char *name;
+      const struct hashtable *ht;
+   } t[2] = { { "hosts", hosts_db }, { "pairs", pairs_db } };
+   int i;
+
+   str_append(buf,
+      "<h3>Hash tables</h3>\n"
+      "<table>\n"
+      "<tr>\n"
+      " <th>Table</th>\n"
+      " <th>Entries</th>\n"
+      " <th>Buckets</th>\n"
+      " <th>Inserts</th>\n"
+      " <th>Searches</th>\n"
+      " <th>Deletions</th>\n"
+      " <th>Rehashes</th>\n"
+      "</tr>\n");
+   for (i=0; i<2; i++)
+      if (t[i].ht != NULL)
+         str_appendf(buf,
+            "<tr>\n"
+            " <td>%s</td>\n"
+            " <td class=\"num\">%'u</td>\n"
+            " <td class=\"num\">%'u</td>\n"
+            " <td class=\"num\">%'qu</td>\n"
+            " <td class=\"num\">%'qu</td>\n"
+            " <td class=\"num\">%'qu</td>\n"
+            " <td class=\"num\">%'qu</td>\n"
+            "</tr>\n",
+            t[i].name, t[i].ht->count, t[i].ht->size,
+            (qu)t[i].ht->stats.inserts,
+            (qu)t[i].ht->stats.searches,
+            (qu)t[i].ht->stats.deletions,
+            (qu)t[i].ht->stats.rehashes);
+   str_append(buf, "</table>\n");
+}
+
+/* A host's table of ports or protocols, by direction. */
+enum metrics_table { METRICS_TCP, METRICS_UDP, METRICS_PROTO };
+
+static void
+metrics_host_table(struct str *buf, const char *metric,
+   const struct bucket *host, const struct hashtable *ht,
+   const enum metrics_table kind, const char *side, const int pkts)
+{
+   uint32_t i;
+
+   if (ht == NULL)
+      return;
+   for (i=0; i<ht->size; i++) {
+      const struct bucket *b;
+
+      for (b = ht->table[i]; b != NULL; b = b->next) {
+         int out;
+
+         for (out=0; out<2; out++) {
+            metric_host_key(buf, metric, host);
+            if (kind == METRICS_PROTO)
+               metric_label_uint(buf, "proto", b->u.ip_proto.proto);
+            else {
+               metric_label(buf, "proto", (kind == METRICS_TCP) ? "tcp"
+                                                                : "udp");
+               metric_label(buf, "side", side);
+               metric_label_uint(buf, "port", (kind == METRICS_TCP)
+                  ? b->u.port_tcp.port : b->u.port_udp.port);
+            }
+            metric_label(buf, "dir", out ? "out" : "in");
+            if (pkts)
+               metric_value(buf, out ? b->pkts_out : b->pkts_in);
+            else
+               metric_value(buf, out ? b->out : b->in);
+         }
+      }
+   }
+}
+
+static void
+metrics_host_ports(struct str *buf, const char *metric,
+   const struct bucket *b, const int pkts)
+{
+   const struct host *h = &(b->u.host);
 
-   str_append(buf, "<br>\n");
-   html_close(buf);
-   return buf;
+   metrics_host_table(buf, metric, b, h->ports_tcp, METRICS_TCP, "local",
+      pkts);
+   metrics_host_table(buf, metric, b, h->ports_tcp_remote, METRICS_TCP,
+      "remote", pkts);
+   metrics_host_table(buf, metric, b, h->ports_udp, METRICS_UDP, "local",
+      pkts);
+   metrics_host_table(buf, metric, b, h->ports_udp_remote, METRICS_UDP,
+      "remote", pkts);
 }
 
-/* ---------------------------------------------------------------------------
- * Database import and export code:
- * Initially written and contributed by Ben Stewart.
- * copyright (c) 2007-2014 Ben Stewart, Emil Mikulic.
+/* Every sample of a metric has to be in one group, so each of these makes
+ * its own pass over the hosts.
  */
-static int hosts_db_export_ip(const struct hashtable *h, const int fd);
-static int hosts_db_export_tcp(const char magic, const struct hashtable *h,
-                               const int fd);
-static int hosts_db_export_udp(const char magic, const struct hashtable *h,
-                               const int fd);
+static void
+metrics_hosts(struct str *buf, const struct metrics_filter *f)
+{
+   const struct bucket **table;
+   unsigned int i, n = 0;
 
-static const char
-   export_proto_ip         = 'P',
-   export_proto_tcp        = 'T',
-   export_proto_tcp_remote = 't',
-   export_proto_udp        = 'U',
-   export_proto_udp_remote = 'u';
+   table = metrics_buckets(hosts_db, f, &n);
 
-static const unsigned char
-   export_tag_host_ver1[] = {'H', 'S', 'T', 0x01},
-   export_tag_host_ver2[] = {'H', 'S', 'T', 0x02},
-   export_tag_host_ver3[] = {'H', 'S', 'T', 0x03},
-   export_tag_host_ver4[] = {'H', 'S', 'T', 0x04};
+   metric_help(buf, "host_bytes_total", "counter",
+      "Total number of network bytes by host and direction.");
+   for (i=0; i<n; i++)
+      metric_host_dirs(buf, "host_bytes_total", table[i],
+         table[i]->in, table[i]->out);
+
+   metric_help(buf, "host_packets_total", "counter",
+      "Total number of network packets by host and direction.");
+   for (i=0; i<n; i++)
+      metric_host_dirs(buf, "host_packets_total", table[i],
+         table[i]->pkts_in, table[i]->pkts_out);
+
+   metric_help(buf, "host_bytes_rate", "gauge",
+      "Recent bytes per second by host, exponentially weighted.");
+   for (i=0; i<n; i++) {
+      host_update_rate((struct bucket *)table[i]);
+      metric_host_key(buf, "host_bytes_rate", table[i]);
+      metric_value(buf, (uint64_t)table[i]->u.host.rate_bytes);
+   }
 
-static void text_metrics_counter(struct str *buf, const char *metric, const char *type, const char *help);
-static void text_metrics_format_host(const struct bucket *b, const void *user_data);
+   metric_help(buf, "host_distinct", "gauge",
+      "Estimated number of distinct peers, and of ports sent to, by host.");
+   for (i=0; i<n; i++) {
+      metric_host_key(buf, "host_distinct", table[i]);
+      metric_label(buf, "of", "peers");
+      metric_value(buf, hll_count(&(table[i]->u.host.peers)));
+      metric_host_key(buf, "host_distinct", table[i]);
+      metric_label(buf, "of", "ports");
+      metric_value(buf, hll_count(&(table[i]->u.host.ports)));
+   }
 
-/* ---------------------------------------------------------------------------
- * Web interface: export stats in Prometheus text format on /metrics
- */
-struct str *
-text_metrics()
-{
-   struct str *buf = str_make();
+   metric_help(buf, "host_port_bytes_total", "counter",
+      "Network bytes by host, TCP or UDP port, and direction.");
+   for (i=0; i<n; i++)
+      metrics_host_ports(buf, "host_port_bytes_total", table[i], 0);
 
-   text_metrics_counter(buf,
-      "host_bytes_total",
-      "counter",
-      "Total number of network bytes by host and direction.");
-   hashtable_foreach(hosts_db, &text_metrics_format_host, (void *)buf);
+   metric_help(buf, "host_port_packets_total", "counter",
+      "Network packets by host, TCP or UDP port, and direction.");
+   for (i=0; i<n; i++)
+      metrics_host_ports(buf, "host_port_packets_total", table[i], 1);
 
-   return buf;
+   metric_help(buf, "host_protocol_bytes_total", "counter",
+      "Network bytes by host, IP protocol number, and direction.");
+   for (i=0; i<n; i++)
+      metrics_host_table(buf, "host_protocol_bytes_total", table[i],
+         table[i]->u.host.ip_protos, METRICS_PROTO, NULL, 0);
+
+   metric_help(buf, "host_protocol_packets_total", "counter",
+      "Network packets by host, IP protocol number, and direction.");
+   for (i=0; i<n; i++)
+      metrics_host_table(buf, "host_protocol_packets_total", table[i],
+         table[i]->u.host.ip_protos, METRICS_PROTO, NULL, 1);
+
+   free(table);
 }
 
 static void
-text_metrics_counter(struct str *buf,
-   const char *metric,
-   const char *type,
-   const char *help)
+metric_pair(struct str *buf, const char *metric,
+   const struct addr *src, const struct addr *dst, const uint64_t val)
 {
-   str_appendf(buf, "# HELP %s %s\n", metric, help);
-   str_appendf(buf, "# TYPE %s %s\n", metric, type);
+   metric_key(buf, metric);
+   metric_label_addr(buf, "src", src);
+   metric_label_addr(buf, "dst", dst);
+   metric_value(buf, val);
 }
 
 static void
-text_metrics_format_host_key(struct str *buf, const struct bucket *b) {
-   const char *ip = addr_to_str(&(b->u.host.addr));
+metrics_pairs(struct str *buf, const struct metrics_filter *f)
+{
+   const struct bucket **table;
+   unsigned int i, n = 0;
 
-   str_appendf(buf,
-      "host_bytes_total{interface=\"%s\",ip=\"%s\"",
-      title_interfaces, ip);
+   table = metrics_buckets(pairs_db, f, &n);
 
-   if (hosts_db_show_macs)
-      str_appendf(buf, ",mac=\"%x:%x:%x:%x:%x:%x\"",
-         b->u.host.mac_addr[0],
-         b->u.host.mac_addr[1],
-         b->u.host.mac_addr[2],
-         b->u.host.mac_addr[3],
-         b->u.host.mac_addr[4],
-         b->u.host.mac_addr[5]);
+   metric_help(buf, "pair_bytes_total", "counter",
+      "Total number of network bytes between two hosts, by direction.");
+   for (i=0; i<n; i++) {
+      const struct pair *p = &(table[i]->u.pair);
+
+      metric_pair(buf, "pair_bytes_total", &(p->a), &(p->b), table[i]->out);
+      metric_pair(buf, "pair_bytes_total", &(p->b), &(p->a), table[i]->in);
+   }
+
+   metric_help(buf, "pair_packets_total", "counter",
+      "Total number of network packets between two hosts, by direction.");
+   for (i=0; i<n; i++) {
+      const struct pair *p = &(table[i]->u.pair);
+
+      metric_pair(buf, "pair_packets_total", &(p->a), &(p->b),
+         table[i]->pkts_out);
+      metric_pair(buf, "pair_packets_total", &(p->b), &(p->a),
+         table[i]->pkts_in);
+   }
+   free(table);
 }
 
-static void
-text_metrics_format_host(const struct bucket *b,
-   const void *user_data)
+/* Query string: top=<n> for the busiest hosts and pairs, family=4 or 6,
+ * local=yes for local hosts only.  Returns NULL if it's no good.
+ */
+struct str *
+text_metrics(const char *query)
 {
-   struct str *buf = (struct str *)user_data;
+   struct metrics_filter f;
+   char *qs_top, *qs_family, *qs_local;
+   struct str *buf = NULL;
+
+   qs_top = qs_get(query, "top");
+   qs_family = qs_get(query, "family");
+   qs_local = qs_get(query, "local");
 
-   text_metrics_format_host_key(buf, b);
-   str_appendf(buf, ",dir=\"in\"} %qu\n", (qu)b->in);
+   memset(&f, 0, sizeof(f));
+   if (!parse_uint(qs_top, &f.top))
+      goto done;
+   if (qs_family == NULL)
+      f.family = 0;
+   else if (strcmp(qs_family, "4") == 0)
+      f.family = IPv4;
+   else if (strcmp(qs_family, "6") == 0)
+      f.family = IPv6;
+   else
+      goto done;
+   if (qs_local == NULL)
+      f.local_only = 0;
+   else if ((strcmp(qs_local, "yes") == 0) || (strcmp(qs_local, "1") == 0))
+      f.local_only = 1;
+   else if ((strcmp(qs_local, "no") == 0) || (strcmp(qs_local, "0") == 0))
+      f.local_only = 0;
+   else
+      goto done;
 
-   text_metrics_format_host_key(buf, b);
-   str_appendf(buf, ",dir=\"out\"} %qu\n", (qu)b->out);
+   buf = str_make();
+   metrics_global(buf);
+   metrics_hashtables(buf);
+   metrics_stats(buf);
+   metrics_hosts(buf, &f);
+   if (pairs_db != NULL)
+      metrics_pairs(buf, &f);
+done:
+   free(qs_top);
+   free(qs_family);
+   free(qs_local);
+   return buf;
 }
 
 /* ---------------------------------------------------------------------------
@@ -1281,7 +2981,7 @@ text_metrics_format_host(const struct bucket *b,
  * Returns 0 on failure, 1 on success.
  */
 static int
-hosts_db_import_ip(const int fd, struct bucket *host)
+hosts_db_import_ip(const int fd, struct bucket *host, const int ver)
 {
    uint8_t count, i;
 
@@ -1291,17 +2991,23 @@ hosts_db_import_ip(const int fd, struct bucket *host)
    for (i=0; i<count; i++) {
       struct bucket *b;
       uint8_t proto;
-      uint64_t in, out;
+      uint64_t in, out, pkts_in = 0, pkts_out = 0;
 
       if (!read8(fd, &proto)) return 0;
       if (!read64(fd, &in)) return 0;
       if (!read64(fd, &out)) return 0;
+      if (ver >= 5) {
+         if (!read64(fd, &pkts_in)) return 0;
+         if (!read64(fd, &pkts_out)) return 0;
+      }
 
       /* Store data */
       b = host_get_ip_proto(host, proto);
       b->in = in;
       b->out = out;
       b->total = in + out;
+      b->pkts_in = pkts_in;
+      b->pkts_out = pkts_out;
       assert(b->u.ip_proto.proto == proto); /* should be done by make fn */
    }
    return 1;
@@ -1314,7 +3020,8 @@ hosts_db_import_ip(const int fd, struct bucket *host)
 static int hosts_db_import_tcp(const int fd, const char magic,
                                struct bucket *host,
                                struct bucket *(get_port_fn)(struct bucket *host,
-                                                            uint16_t port)) {
+                                                            uint16_t port),
+                               const int ver) {
    uint16_t count, i;
 
    if (!expect8(fd, magic)) return 0;
@@ -1323,18 +3030,24 @@ static int hosts_db_import_tcp(const int fd, const char magic,
    for (i=0; i<count; i++) {
       struct bucket *b;
       uint16_t port;
-      uint64_t in, out, syn;
+      uint64_t in, out, syn, pkts_in = 0, pkts_out = 0;
 
       if (!read16(fd, &port)) return 0;
       if (!read64(fd, &syn)) return 0;
       if (!read64(fd, &in)) return 0;
       if (!read64(fd, &out)) return 0;
+      if (ver >= 5) {
+         if (!read64(fd, &pkts_in)) return 0;
+         if (!read64(fd, &pkts_out)) return 0;
+      }
 
       /* Store data */
       b = get_port_fn(host, port);
       b->in = in;
       b->out = out;
       b->total = in + out;
+      b->pkts_in = pkts_in;
+      b->pkts_out = pkts_out;
       assert(b->u.port_tcp.port == port); /* done by make_func_port_tcp */
       b->u.port_tcp.syn = syn;
    }
@@ -1348,7 +3061,8 @@ static int hosts_db_import_tcp(const int fd, const char magic,
 static int hosts_db_import_udp(const int fd, const char magic,
                                struct bucket *host,
                                struct bucket *(get_port_fn)(struct bucket *host,
-                                                            uint16_t port)) {
+                                                            uint16_t port),
+                               const int ver) {
    uint16_t count, i;
 
    if (!expect8(fd, magic)) return 0;
@@ -1357,22 +3071,126 @@ static int hosts_db_import_udp(const int fd, const char magic,
    for (i=0; i<count; i++) {
       struct bucket *b;
       uint16_t port;
-      uint64_t in, out;
+      uint64_t in, out, pkts_in = 0, pkts_out = 0;
 
       if (!read16(fd, &port)) return 0;
       if (!read64(fd, &in)) return 0;
       if (!read64(fd, &out)) return 0;
+      if (ver >= 5) {
+         if (!read64(fd, &pkts_in)) return 0;
+         if (!read64(fd, &pkts_out)) return 0;
+      }
 
       /* Store data */
       b = get_port_fn(host, port);
       b->in = in;
       b->out = out;
       b->total = in + out;
+      b->pkts_in = pkts_in;
+      b->pkts_out = pkts_out;
       assert(b->u.port_udp.port == port); /* done by make_func */
    }
    return 1;
 }
 
+/* ---------------------------------------------------------------------------
+ * Load a host's icmp_type table from a file.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+hosts_db_import_icmp(const int fd, struct bucket *host)
+{
+   uint16_t count, i;
+
+   if (!expect8(fd, export_proto_icmp)) return 0;
+   if (!read16(fd, &count)) return 0;
+
+   for (i=0; i<count; i++) {
+      struct bucket *b;
+      uint8_t type, code;
+      uint64_t in, out, pkts_in, pkts_out;
+
+      if (!read8(fd, &type)) return 0;
+      if (!read8(fd, &code)) return 0;
+      if (!read64(fd, &in)) return 0;
+      if (!read64(fd, &out)) return 0;
+      if (!read64(fd, &pkts_in)) return 0;
+      if (!read64(fd, &pkts_out)) return 0;
+
+      /* Store data */
+      b = host_get_icmp_type(host, type, code);
+      b->in = in;
+      b->out = out;
+      b->total = in + out;
+      b->pkts_in = pkts_in;
+      b->pkts_out = pkts_out;
+   }
+   return 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Load a host's tcp_flags table from a file.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+hosts_db_import_flags(const int fd, struct bucket *host)
+{
+   uint8_t count, i;
+
+   if (!expect8(fd, export_proto_tcp_flags)) return 0;
+   if (!read8(fd, &count)) return 0;
+
+   for (i=0; i<count; i++) {
+      struct bucket *b;
+      uint8_t flags;
+      uint64_t in, out, pkts_in, pkts_out;
+
+      if (!read8(fd, &flags)) return 0;
+      if (!read64(fd, &in)) return 0;
+      if (!read64(fd, &out)) return 0;
+      if (!read64(fd, &pkts_in)) return 0;
+      if (!read64(fd, &pkts_out)) return 0;
+
+      if (flags & ~(TH_FIN|TH_SYN|TH_RST|TH_PUSH|TH_ACK|TH_URG)) {
+         warnx("bad TCP flags in host import: %02x", flags);
+         return 0;
+      }
+
+      /* Store data */
+      b = host_get_tcp_flags(host, flags);
+      b->in = in;
+      b->out = out;
+      b->total = in + out;
+      b->pkts_in = pkts_in;
+      b->pkts_out = pkts_out;
+   }
+   return 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Load a host's graphs from a file.  They're skipped if we have nowhere to
+ * put them.
+ * Returns 0 on failure, 1 on success.
+ */
+static int
+hosts_db_import_graphs(const int fd, struct bucket *host)
+{
+   uint8_t present;
+
+   if (!expect8(fd, export_host_graphs)) return 0;
+   if (!read8(fd, &present)) return 0;
+   if (present == 0)
+      return 1;
+   if (present != 1) {
+      warnx("bad graphs flag in host import: %02x", present);
+      return 0;
+   }
+   if ((graph_owners == NULL) ||
+       ((host->u.host.graph == 0) && !host_claim_graph(host)))
+      return graph_host_import(fd, 0);
+   return graph_host_import(fd, host->u.host.graph);
+}
+
 /* ---------------------------------------------------------------------------
  * Load all hosts from a file.
  * Returns 0 on failure, 1 on success.
@@ -1389,7 +3207,13 @@ hosts_db_import_host(const int fd)
    int ver = 0;
 
    if (!readn(fd, hdr, sizeof(hdr))) return 0;
-   if (memcmp(hdr, export_tag_host_ver4, sizeof(hdr)) == 0)
+   if (memcmp(hdr, export_tag_host_ver7, sizeof(hdr)) == 0)
+      ver = 7;
+   else if (memcmp(hdr, export_tag_host_ver6, sizeof(hdr)) == 0)
+      ver = 6;
+   else if (memcmp(hdr, export_tag_host_ver5, sizeof(hdr)) == 0)
+      ver = 5;
+   else if (memcmp(hdr, export_tag_host_ver4, sizeof(hdr)) == 0)
       ver = 4;
    else if (memcmp(hdr, export_tag_host_ver3, sizeof(hdr)) == 0)
       ver = 3;
@@ -1448,21 +3272,47 @@ hosts_db_import_host(const int fd)
    host->out = out;
    host->total = in + out;
 
+   if (ver >= 5) {
+      if (!read64(fd, &host->pkts_in)) return 0;
+      if (!read64(fd, &host->pkts_out)) return 0;
+   }
+
+   /* So it isn't forgotten if the host is dropped later. */
+   if (sketch_enabled()) {
+      struct sketch_count c;
+
+      c.in = host->in;
+      c.out = host->out;
+      c.pkts_in = host->pkts_in;
+      c.pkts_out = host->pkts_out;
+      sketch_add(&(host->u.host.addr), &c);
+   }
+
    /* Host's port and proto subtables: */
-   if (!hosts_db_import_ip(fd, host)) return 0;
-   if (!hosts_db_import_tcp(fd, export_proto_tcp, host, host_get_port_tcp))
+   if (!hosts_db_import_ip(fd, host, ver)) return 0;
+   if (!hosts_db_import_tcp(fd, export_proto_tcp, host, host_get_port_tcp,
+                            ver))
       return 0;
-   if (!hosts_db_import_udp(fd, export_proto_udp, host, host_get_port_udp))
+   if (!hosts_db_import_udp(fd, export_proto_udp, host, host_get_port_udp,
+                            ver))
       return 0;
 
-   if (ver == 4) {
+   if (ver >= 4) {
       if (!hosts_db_import_tcp(fd, export_proto_tcp_remote, host,
-                               host_get_port_tcp_remote))
+                               host_get_port_tcp_remote, ver))
          return 0;
       if (!hosts_db_import_udp(fd, export_proto_udp_remote, host,
-                               host_get_port_udp_remote))
+                               host_get_port_udp_remote, ver))
          return 0;
    }
+
+   if (ver >= 6) {
+      if (!hosts_db_import_icmp(fd, host)) return 0;
+      if (!hosts_db_import_flags(fd, host)) return 0;
+   }
+
+   if (ver >= 7)
+      if (!hosts_db_import_graphs(fd, host)) return 0;
    return 1;
 }
 
@@ -1499,7 +3349,7 @@ int hosts_db_export(const int fd)
    for (i = 0; i<hosts_db->size; i++)
    for (b = hosts_db->table[i]; b != NULL; b = b->next) {
       /* For each host: */
-      if (!writen(fd, export_tag_host_ver4, sizeof(export_tag_host_ver4)))
+      if (!writen(fd, export_tag_host_ver7, sizeof(export_tag_host_ver7)))
          return 0;
 
       if (!writeaddr(fd, &(b->u.host.addr)))
@@ -1531,6 +3381,8 @@ int hosts_db_export(const int fd)
 
       if (!write64(fd, b->in)) return 0;
       if (!write64(fd, b->out)) return 0;
+      if (!write64(fd, b->pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out)) return 0;
 
       if (!hosts_db_export_ip(b->u.host.ip_protos, fd)) return 0;
       if (!hosts_db_export_tcp(export_proto_tcp, b->u.host.ports_tcp, fd))
@@ -1543,10 +3395,139 @@ int hosts_db_export(const int fd)
       if (!hosts_db_export_udp(export_proto_udp_remote,
                                b->u.host.ports_udp_remote, fd))
          return 0;
+      if (!hosts_db_export_icmp(b->u.host.icmp_types, fd)) return 0;
+      if (!hosts_db_export_flags(b->u.host.tcp_flags, fd)) return 0;
+      if (!hosts_db_export_graphs(b, fd)) return 0;
    }
    return 1;
 }
 
+/* ---------------------------------------------------------------------------
+ * Journal: the hosts whose counters changed since the last entry, with how
+ * much they changed by.  The count is written again at the end, so that
+ * an entry cut short by a crash can be told apart from a whole one.
+ */
+static int
+host_changed(const struct bucket *b)
+{
+   return (b->in != b->u.host.journal_in ||
+           b->out != b->u.host.journal_out ||
+           b->pkts_in != b->u.host.journal_pkts_in ||
+           b->pkts_out != b->u.host.journal_pkts_out);
+}
+
+void
+host_journal_mark(struct bucket *b)
+{
+   b->u.host.journal_in = b->in;
+   b->u.host.journal_out = b->out;
+   b->u.host.journal_pkts_in = b->pkts_in;
+   b->u.host.journal_pkts_out = b->pkts_out;
+}
+
+void hosts_db_journal_mark(void)
+{
+   uint32_t i;
+   struct bucket *b;
+
+   for (i = 0; i<hosts_db->size; i++)
+   for (b = hosts_db->table[i]; b != NULL; b = b->next)
+      host_journal_mark(b);
+}
+
+uint32_t hosts_db_journal_count(void)
+{
+   uint32_t i, count = 0;
+   struct bucket *b;
+
+   for (i = 0; i<hosts_db->size; i++)
+   for (b = hosts_db->table[i]; b != NULL; b = b->next)
+      if (host_changed(b))
+         count++;
+   return count;
+}
+
+int hosts_db_journal(const int fd, const uint32_t count)
+{
+   uint32_t i;
+   struct bucket *b;
+
+   if (!write32(fd, count)) return 0;
+
+   for (i = 0; i<hosts_db->size; i++)
+   for (b = hosts_db->table[i]; b != NULL; b = b->next) {
+      if (!host_changed(b))
+         continue;
+      if (!writeaddr(fd, &(b->u.host.addr))) return 0;
+      if (!write64(fd, (uint64_t)mono_to_real(b->u.host.last_seen_mono)))
+         return 0;
+      if (!write64(fd, b->in - b->u.host.journal_in)) return 0;
+      if (!write64(fd, b->out - b->u.host.journal_out)) return 0;
+      if (!write64(fd, b->pkts_in - b->u.host.journal_pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out - b->u.host.journal_pkts_out)) return 0;
+      host_journal_mark(b);
+   }
+   return write32(fd, count);
+}
+
+struct journal_delta {
+   struct addr addr;
+   uint64_t last_seen, in, out, pkts_in, pkts_out;
+};
+
+/* Reads a whole entry before applying any of it. */
+int hosts_db_replay(const int fd)
+{
+   struct journal_delta *d = NULL;
+   uint32_t count, check, i, got = 0, alloc = 0;
+   int ok = 0;
+
+   if (!read32(fd, &count)) return 0;
+   for (i = 0; i<count; i++) {
+      struct journal_delta *r;
+
+      if (got == alloc) {
+         alloc = (alloc == 0) ? 64 : alloc * 2;
+         d = xrealloc(d, alloc * sizeof(*d));
+      }
+      r = &d[got];
+      if (!readaddr(fd, &(r->addr))) goto done;
+      if (!read64(fd, &(r->last_seen))) goto done;
+      if (!read64(fd, &(r->in))) goto done;
+      if (!read64(fd, &(r->out))) goto done;
+      if (!read64(fd, &(r->pkts_in))) goto done;
+      if (!read64(fd, &(r->pkts_out))) goto done;
+      got++;
+   }
+   if (!read32(fd, &check) || check != count) goto done;
+
+   for (i = 0; i<got; i++) {
+      struct bucket *host = host_get(&(d[i].addr));
+      const int64_t seen = real_to_mono((time_t)d[i].last_seen);
+
+      host->in += d[i].in;
+      host->out += d[i].out;
+      host->total += d[i].in + d[i].out;
+      host->pkts_in += d[i].pkts_in;
+      host->pkts_out += d[i].pkts_out;
+      if (seen > host->u.host.last_seen_mono)
+         host->u.host.last_seen_mono = seen;
+      if (sketch_enabled()) {
+         struct sketch_count c;
+
+         c.in = d[i].in;
+         c.out = d[i].out;
+         c.pkts_in = d[i].pkts_in;
+         c.pkts_out = d[i].pkts_out;
+         sketch_add(&(d[i].addr), &c);
+      }
+   }
+   ok = 1;
+done:
+   free(d);
+   return ok;
+}
+
 /* ---------------------------------------------------------------------------
  * Dump the ip_proto table of a host.
  */
@@ -1575,6 +3556,8 @@ hosts_db_export_ip(const struct hashtable *h, const int fd)
       if (!write8(fd, b->u.ip_proto.proto)) return 0;
       if (!write64(fd, b->in)) return 0;
       if (!write64(fd, b->out)) return 0;
+      if (!write64(fd, b->pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out)) return 0;
       written++;
    }
    assert(written == h->count);
@@ -1608,6 +3591,8 @@ hosts_db_export_tcp(const char magic, const struct hashtable *h, const int fd)
       if (!write64(fd, b->u.port_tcp.syn)) return 0;
       if (!write64(fd, b->in)) return 0;
       if (!write64(fd, b->out)) return 0;
+      if (!write64(fd, b->pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out)) return 0;
       written++;
    }
    assert(written == h->count);
@@ -1640,10 +3625,94 @@ hosts_db_export_udp(const char magic, const struct hashtable *h, const int fd)
       if (!write16(fd, b->u.port_udp.port)) return 0;
       if (!write64(fd, b->in)) return 0;
       if (!write64(fd, b->out)) return 0;
+      if (!write64(fd, b->pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out)) return 0;
+      written++;
+   }
+   assert(written == h->count);
+   return 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Dump the icmp_type table of a host.
+ */
+static int
+hosts_db_export_icmp(const struct hashtable *h, const int fd)
+{
+   struct bucket *b;
+   uint32_t i, written = 0;
+
+   /* ICMP DATA */
+   if (!write8(fd, export_proto_icmp)) return 0;
+
+   /* If no data, write a count of 0 and we're done. */
+   if (h == NULL) {
+      if (!write16(fd, 0)) return 0;
+      return 1;
+   }
+
+   assert(h->count < 65536);
+   if (!write16(fd, (uint16_t)h->count)) return 0;
+
+   for (i = 0; i<h->size; i++)
+   for (b = h->table[i]; b != NULL; b = b->next) {
+      if (!write8(fd, (uint8_t)(b->u.icmp_type.type_code >> 8))) return 0;
+      if (!write8(fd, (uint8_t)(b->u.icmp_type.type_code & 0xFF))) return 0;
+      if (!write64(fd, b->in)) return 0;
+      if (!write64(fd, b->out)) return 0;
+      if (!write64(fd, b->pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out)) return 0;
+      written++;
+   }
+   assert(written == h->count);
+   return 1;
+}
+
+/* ---------------------------------------------------------------------------
+ * Dump the tcp_flags table of a host.
+ */
+static int
+hosts_db_export_flags(const struct hashtable *h, const int fd)
+{
+   struct bucket *b;
+   uint32_t i, written = 0;
+
+   /* TCP FLAGS DATA */
+   if (!write8(fd, export_proto_tcp_flags)) return 0;
+
+   /* If no data, write a count of 0 and we're done. */
+   if (h == NULL) {
+      if (!write8(fd, 0)) return 0;
+      return 1;
+   }
+
+   assert(h->count < 256);
+   if (!write8(fd, (uint8_t)h->count)) return 0;
+
+   for (i = 0; i<h->size; i++)
+   for (b = h->table[i]; b != NULL; b = b->next) {
+      if (!write8(fd, b->u.tcp_flags.flags)) return 0;
+      if (!write64(fd, b->in)) return 0;
+      if (!write64(fd, b->out)) return 0;
+      if (!write64(fd, b->pkts_in)) return 0;
+      if (!write64(fd, b->pkts_out)) return 0;
       written++;
    }
    assert(written == h->count);
    return 1;
 }
 
+/* ---------------------------------------------------------------------------
+ * Dump a host's graphs, if it has them.
+ */
+static int
+hosts_db_export_graphs(const struct bucket *b, const int fd)
+{
+   if (!write8(fd, export_host_graphs)) return 0;
+   if (b->u.host.graph == 0)
+      return write8(fd, 0);
+   if (!write8(fd, 1)) return 0;
+   return graph_host_export(fd, b->u.host.graph);
+}
+
 /* vim:set ts=3 sw=3 tw=80 expandtab: */
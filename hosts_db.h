@@ -12,6 +12,7 @@
 #include <sys/types.h> /* for uint64_t */
 
 #include "addr.h"
+#include "hll.h"
 
 struct hashtable;
 
@@ -23,11 +24,28 @@ struct host {
     * It can be negative (due to machine reboots).
     */
    int64_t last_seen_mono;
+   /* Exponentially weighted rates (per second) of traffic in and out.
+    * Traffic is summed over the current second (rate_mono) and folded in
+    * when the second changes, see host_update_rate().
+    */
+   double rate_bytes, rate_pkts;
+   uint64_t rate_cur_bytes, rate_cur_pkts;
+   int64_t rate_mono;
+   /* Estimated numbers of distinct peers, and of distinct TCP and UDP
+    * ports this host sent to.  Unlike the tables below, these aren't
+    * truncated, so they can spot a scan.
+    */
+   struct hll peers, ports;
+   unsigned int graph; /* slot for graph_host_*(), 0 if none */
+   /* Counters as of the last --journal entry, see hosts_db_journal(). */
+   uint64_t journal_in, journal_out, journal_pkts_in, journal_pkts_out;
    struct hashtable *ports_tcp;
    struct hashtable *ports_tcp_remote;
    struct hashtable *ports_udp;
    struct hashtable *ports_udp_remote;
    struct hashtable *ip_protos;
+   struct hashtable *icmp_types;
+   struct hashtable *tcp_flags;
 };
 
 struct port_tcp {
@@ -43,28 +61,60 @@ struct ip_proto {
    uint8_t proto;
 };
 
+/* ICMP for IPv4 hosts, ICMPv6 for IPv6 hosts. */
+struct icmp_type {
+   uint16_t type_code; /* type << 8 | code */
+   uint8_t v6;
+};
+
+/* A combination of TCP flags, e.g. TH_SYN|TH_ACK. */
+struct tcp_flags {
+   uint8_t flags;
+};
+
+/* A conversation between two hosts.  The addresses are ordered so that
+ * a < b (see addr_cmp), "out" counts traffic from a to b and "in" counts
+ * traffic from b to a.
+ */
+struct pair {
+   struct addr a, b;
+   int64_t last_seen_mono;
+};
+
 struct bucket {
    struct bucket *next;
    uint64_t in, out, total;
+   uint64_t pkts_in, pkts_out;
    union {
       struct host host;
       struct port_tcp port_tcp;
       struct port_udp port_udp;
       struct ip_proto ip_proto;
+      struct icmp_type icmp_type;
+      struct tcp_flags tcp_flags;
+      struct pair pair;
    } u;
 };
 
-enum sort_dir { IN, OUT, TOTAL, LASTSEEN };
+enum sort_dir { IN, OUT, TOTAL, LASTSEEN, PACKETS, RATE };
 
 extern int hosts_db_show_macs;
 
 void hosts_db_init(void);
 void hosts_db_reduce(void);
+void pairs_db_reduce(void);
 void hosts_db_reset(void);
 void hosts_db_free(void);
 int hosts_db_import(const int fd);
 int hosts_db_export(const int fd);
 
+/* The --journal: what changed since the last entry, and replaying it. */
+uint32_t hosts_db_journal_count(void); /* hosts that changed */
+int hosts_db_journal(const int fd, const uint32_t count);
+int hosts_db_replay(const int fd);
+void hosts_db_journal_mark(void);
+void host_journal_mark(struct bucket *host); /* nothing new to journal */
+
 struct bucket *host_find(const struct addr *const a); /* can return NULL */
 struct bucket *host_get(const struct addr *const a);
 struct bucket *host_get_port_tcp(struct bucket *host, const uint16_t port);
@@ -74,14 +124,34 @@ struct bucket *host_get_port_udp(struct bucket *host, const uint16_t port);
 struct bucket *host_get_port_udp_remote(struct bucket *host,
                                         const uint16_t port);
 struct bucket *host_get_ip_proto(struct bucket *host, const uint8_t proto);
+struct bucket *host_get_icmp_type(struct bucket *host, const uint8_t type,
+                                  const uint8_t code);
+struct bucket *host_get_tcp_flags(struct bucket *host, const uint8_t flags);
+void host_acct_rate(struct bucket *host, const uint64_t bytes,
+   const uint64_t pkts);
+void host_update_rate(struct bucket *host);
+void host_acct_graph(struct bucket *host, const uint64_t in,
+   const uint64_t out);
+struct bucket *pair_get(const struct addr *const a,
+                        const struct addr *const b);
 
 /* Web pages. */
 struct str *html_hosts(const char *uri, const char *query);
-struct str *text_metrics();
+struct str *html_pairs(const char *uri, const char *query);
+struct str *html_top(const char *uri);
+struct str *xml_hosts(const char *uri);
+/* Sets *bad_query if the reply is an error about the query. */
+struct str *json_hosts(const char *uri, const char *query, int *bad_query);
+struct str *text_metrics(const char *query); /* NULL if query is bad */
+void html_hashtable_stats(struct str *buf); /* for /debug/stats */
 
 /* From hosts_sort */
 void qsort_buckets(const struct bucket **a, size_t n,
    size_t left, size_t right, const enum sort_dir d);
+void radix_sort_buckets(const struct bucket **a, const size_t n,
+   const enum sort_dir d);
+void sort_buckets(const struct bucket **a, const size_t n,
+   const size_t left, const size_t right, const enum sort_dir d);
 
 #endif /* __DARKSTAT_HOSTS_DB_H */
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
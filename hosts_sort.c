@@ -1,16 +1,19 @@
 /* darkstat 3
  * copyright (c) 2001-2012 Emil Mikulic.
  *
- * hosts_sort.c: quicksort a table of buckets.
+ * hosts_sort.c: sort a table of buckets.
  *
  * You may use, modify and redistribute this file under the terms of the
  * GNU General Public License version 2. (see COPYING.GPL)
  */
 
 #include "cdefs.h"
+#include "conv.h"
 #include "err.h"
 #include "hosts_db.h"
 
+#include <stdlib.h> /* for free() */
+
 static int cmp_u64(const uint64_t a, const uint64_t b) {
    if (a < b) return (1);
    if (a > b) return (-1);
@@ -36,6 +39,12 @@ static int cmp(const struct bucket * const *x, const struct bucket * const *y,
       case LASTSEEN:
          return cmp_i64((*x)->u.host.last_seen_mono,
                         (*y)->u.host.last_seen_mono);
+      case PACKETS:
+         return cmp_u64((*x)->pkts_in + (*x)->pkts_out,
+                        (*y)->pkts_in + (*y)->pkts_out);
+      case RATE:
+         return cmp_u64((uint64_t)(*x)->u.host.rate_bytes,
+                        (uint64_t)(*y)->u.host.rate_bytes);
       default:
          errx(1, "cmp: unknown direction: %d", dir);
    }
@@ -198,4 +207,115 @@ loop:
 /*		qsort(pn - r, r, cmp);*/
 }
 
+/*
+ * LSD radix sort for sorting an entire table.
+ *
+ * The sort key is extracted once per bucket into a contiguous array of
+ * (key, pointer) pairs, so the passes never touch the buckets themselves and
+ * never switch on the sort direction.  Keys are transformed so that sorting
+ * them in ascending order gives the descending order that cmp() gives.
+ */
+struct sort_pair {
+   uint64_t key;
+   const struct bucket *b;
+};
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+static uint64_t sort_key(const struct bucket *b, const enum sort_dir dir) {
+   switch (dir) {
+      case IN:
+         return ~b->in;
+      case OUT:
+         return ~b->out;
+      case TOTAL:
+         return ~b->total;
+      case LASTSEEN:
+         /* Flip the sign bit to order signed values as unsigned. */
+         return ~((uint64_t)b->u.host.last_seen_mono ^ ((uint64_t)1 << 63));
+      case PACKETS:
+         return ~(b->pkts_in + b->pkts_out);
+      case RATE:
+         return ~(uint64_t)b->u.host.rate_bytes;
+      default:
+         errx(1, "sort_key: unknown direction: %d", dir);
+   }
+}
+
+void
+radix_sort_buckets(const struct bucket **a, const size_t n,
+   const enum sort_dir dir)
+{
+   struct sort_pair *pairs, *src, *dst, *tmp;
+   size_t (*counts)[RADIX_SIZE];
+   size_t i;
+   unsigned int pass;
+
+   if (n < 2)
+      return;
+
+   pairs = xmalloc(2 * n * sizeof(*pairs));
+   src = pairs;
+   dst = pairs + n;
+   counts = xcalloc(RADIX_PASSES, sizeof(*counts));
+
+   /* Extract keys and build every pass's histogram in one go. */
+   for (i=0; i<n; i++) {
+      const uint64_t key = sort_key(a[i], dir);
+
+      src[i].key = key;
+      src[i].b = a[i];
+      for (pass=0; pass<RADIX_PASSES; pass++)
+         counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+   }
+
+   for (pass=0; pass<RADIX_PASSES; pass++) {
+      const unsigned int shift = pass * RADIX_BITS;
+      size_t *count = counts[pass], sum = 0;
+      unsigned int d;
+
+      /* Skip passes where every key has the same digit, which is the
+       * common case for the high bytes of byte counters.
+       */
+      if (count[(src[0].key >> shift) & (RADIX_SIZE - 1)] == n)
+         continue;
+
+      for (d=0; d<RADIX_SIZE; d++) {
+         const size_t c = count[d];
+         count[d] = sum;
+         sum += c;
+      }
+      for (i=0; i<n; i++)
+         dst[ count[(src[i].key >> shift) & (RADIX_SIZE - 1)]++ ] = src[i];
+
+      tmp = src;
+      src = dst;
+      dst = tmp;
+   }
+
+   for (i=0; i<n; i++)
+      a[i] = src[i].b;
+
+   free(counts);
+   free(pairs);
+}
+
+/* Below this many elements, the partial quicksort wins. */
+#define RADIX_MIN_ELEMS 256
+
+/* Sort the range [left:right] of the table, picking whichever of the
+ * partial quicksort and the radix sort is cheaper for the job.
+ */
+void
+sort_buckets(const struct bucket **a, const size_t n,
+   const size_t left, const size_t right, const enum sort_dir dir)
+{
+   if ((n >= RADIX_MIN_ELEMS) && (right - left >= RADIX_MIN_ELEMS))
+      radix_sort_buckets(a, n, dir);
+   else
+      qsort_buckets(a, n, left, right, dir);
+}
+
 /* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -0,0 +1,173 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * hosts_sort_test.c: tests for hosts_sort.c
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Usage:
+ *  ./hosts_sort_test           check radix sort against quicksort
+ *  ./hosts_sort_test bench [n] time both sorts, up to n entries
+ */
+
+#include "conv.h"
+#include "hosts_db.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const enum sort_dir dirs[] = { IN, OUT, TOTAL, LASTSEEN, PACKETS, RATE };
+static const char *dir_names[] =
+  { "IN", "OUT", "TOTAL", "LASTSEEN", "PACKETS", "RATE" };
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t rng(void) {
+  /* xorshift64 */
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/* Byte counters are skewed: mostly small, a few huge. */
+static uint64_t rand_bytes(void) {
+  return rng() >> (rng() % 64);
+}
+
+static struct bucket *make_buckets(size_t n) {
+  struct bucket *b = xcalloc(n + 1, sizeof(*b));
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    b[i].in = rand_bytes();
+    b[i].out = (i % 7 == 0) ? b[i].in : rand_bytes(); /* force some ties */
+    b[i].total = b[i].in + b[i].out;
+    b[i].pkts_in = b[i].in >> 6;
+    b[i].pkts_out = rng() % 1000;
+    b[i].u.host.rate_bytes = (double)(b[i].in >> (rng() % 20));
+    b[i].u.host.last_seen_mono = (int64_t)(rng() % 200000) - 100000;
+  }
+  return b;
+}
+
+static const struct bucket **make_table(struct bucket *b, size_t n) {
+  const struct bucket **t = xmalloc((n + 1) * sizeof(*t));
+  size_t i;
+
+  for (i = 0; i < n; i++) t[i] = &b[i];
+  return t;
+}
+
+/* The key the bucket sorts on, for all but LASTSEEN. */
+static uint64_t value(const struct bucket *b, enum sort_dir dir) {
+  switch (dir) {
+    case IN: return b->in;
+    case OUT: return b->out;
+    case TOTAL: return b->total;
+    case PACKETS: return b->pkts_in + b->pkts_out;
+    case RATE: return (uint64_t)b->u.host.rate_bytes;
+    default: return 0;
+  }
+}
+
+/* Compares keys: -1, 0 or 1.  LASTSEEN is the only signed one. */
+static int cmp(const struct bucket *x, const struct bucket *y,
+               enum sort_dir dir) {
+  if (dir == LASTSEEN) {
+    int64_t a = x->u.host.last_seen_mono, b = y->u.host.last_seen_mono;
+    return (a > b) - (a < b);
+  } else {
+    uint64_t a = value(x, dir), b = value(y, dir);
+    return (a > b) - (a < b);
+  }
+}
+
+static void test_sort(size_t n, enum sort_dir dir, const char *name) {
+  struct bucket *b = make_buckets(n);
+  const struct bucket **q = make_table(b, n), **r = make_table(b, n);
+  size_t i;
+  int ok = 1;
+  char what[64];
+
+  qsort_buckets(q, n, 0, n, dir);
+  radix_sort_buckets(r, n, dir);
+  for (i = 0; i < n; i++) {
+    /* Ties can come out in either order, so compare values. */
+    if (cmp(q[i], r[i], dir) != 0) ok = 0;
+    if ((i > 0) && (cmp(r[i-1], r[i], dir) < 0)) ok = 0;
+  }
+  snprintf(what, sizeof(what), "radix_sort_buckets(%zu, %s)", n, name);
+  check(ok, what);
+  free(q);
+  free(r);
+  free(b);
+}
+
+static double elapsed(const struct timespec *t0) {
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (double)(t1.tv_sec - t0->tv_sec) +
+         (double)(t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void bench(size_t max_n) {
+  size_t n;
+  unsigned int d;
+
+  printf("%10s %-9s %12s %12s\n", "entries", "dir", "qsort ms", "radix ms");
+  for (n = 10000; n <= max_n; n *= 10) {
+    struct bucket *b = make_buckets(n);
+    for (d = 0; d < sizeof(dirs) / sizeof(*dirs); d++) {
+      const struct bucket **t = make_table(b, n);
+      struct timespec t0;
+      double tq, tr;
+
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      qsort_buckets(t, n, 0, n, dirs[d]);
+      tq = elapsed(&t0);
+
+      free(t);
+      t = make_table(b, n); /* same input order as qsort got */
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      radix_sort_buckets(t, n, dirs[d]);
+      tr = elapsed(&t0);
+
+      printf("%10zu %-9s %12.2f %12.2f\n",
+          n, dir_names[d], tq * 1000, tr * 1000);
+      free(t);
+    }
+    free(b);
+  }
+}
+
+int main(int argc, char **argv) {
+  static const size_t sizes[] = { 0, 1, 2, 7, 41, 255, 256, 1000, 100000 };
+  unsigned int i, d;
+
+  if ((argc >= 2) && (strcmp(argv[1], "bench") == 0)) {
+    bench((argc >= 3) ? (size_t)strtoull(argv[2], NULL, 10) : 1000000);
+    return 0;
+  }
+
+  for (i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+    for (d = 0; d < sizeof(dirs) / sizeof(*dirs); d++)
+      test_sort(sizes[i], dirs[d], dir_names[d]);
+  return test_retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
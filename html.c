@@ -12,6 +12,7 @@
 #include "str.h"
 #include "html.h"
 #include "opt.h"
+#include "sketch.h"
 
 #include <assert.h>
 
@@ -53,12 +54,20 @@ void html_open(struct str *buf, const char *title,
          "<li class=\"label\">" PACKAGE_STRING "</li>"
          "<li><a href=\"%s/\">graphs</a></li>"
          "<li><a href=\"%s/hosts/\">hosts</a></li>"
+        , root, root);
+    if (opt_pairs_max != 0)
+        str_appendf(buf, "<li><a href=\"%s/pairs/\">pairs</a></li>", root);
+    if (sketch_enabled())
+        str_appendf(buf, "<li><a href=\"%s/top/\">top</a></li>", root);
+    if (opt_want_vlans)
+        str_appendf(buf, "<li><a href=\"%s/vlans/\">vlans</a></li>", root);
+    str_appendf(buf,
          "<li><a href=\"" PACKAGE_URL "\">homepage</a></li>"
         "</ul>\n"
         "</div>\n"
         "<div class=\"content\">\n"
          "<h2 class=\"pageheader\">%s</h2>\n"
-        , root, root, title);
+        , title);
 }
 
 void html_close(struct str *buf)
@@ -17,6 +17,7 @@
 #include "http.h"
 #include "now.h"
 #include "queue.h"
+#include "stats.h"
 #include "str.h"
 
 #include <sys/uio.h>
@@ -43,6 +44,7 @@ static int http_base_len = 0;
 static const char mime_type_xml[] = "text/xml";
 static const char mime_type_html[] = "text/html; charset=us-ascii";
 static const char mime_type_text_prometheus[] = "text/plain; version=0.0.4";
+static const char mime_type_json[] = "application/json";
 static const char mime_type_css[] = "text/css";
 static const char mime_type_js[] = "text/javascript";
 static const char mime_type_png[] = "image/png";
@@ -587,9 +589,11 @@ process_gzip(struct connection *conn)
     char *buf;
     size_t len;
     z_stream zs;
+    struct timespec t;
 
     if (!conn->accept_gzip)
         return;
+    timer_start(&t);
 
     buf = xmalloc(conn->reply_length);
     len = conn->reply_length;
@@ -630,6 +634,7 @@ process_gzip(struct connection *conn)
     conn->reply_length -= zs.avail_out;
     conn->encoding = encoding_gzip;
     deflateEnd(&zs);
+    stats_time(STATS_GZIP, &t);
 }
 
 /* ---------------------------------------------------------------------------
@@ -638,9 +643,12 @@ process_gzip(struct connection *conn)
 static void process_get(struct connection *conn)
 {
     char *safe_url;
+    struct timespec t;
+    int bad_query = 0;
 
     verbosef("http: %s \"%s\" %s", conn->method, conn->uri,
         (conn->query == NULL)?"":conn->query);
+    timer_start(&t);
 
     {
         /* Decode the URL being requested. */
@@ -672,7 +680,35 @@ static void process_get(struct connection *conn)
     }
     else if (str_starts_with(safe_url, "/hosts/")) {
         /* FIXME here - make this saner */
-        struct str *buf = html_hosts(safe_url, conn->query);
+        int want_xml = (strstr(safe_url, "/graphs.xml") != NULL);
+        struct str *buf = want_xml ? xml_hosts(safe_url)
+                                   : html_hosts(safe_url, conn->query);
+        if (buf == NULL) {
+            default_reply(conn, 404, "Not Found",
+                "The page you requested could not be found.");
+            free(safe_url);
+            return;
+        }
+        str_extract(buf, &(conn->reply_length), &(conn->reply));
+        if (want_xml) {
+            conn->mime_type = mime_type_xml;
+            conn->header_extra = "Pragma: no-cache\r\n";
+        } else
+            conn->mime_type = mime_type_html;
+    }
+    else if (str_starts_with(safe_url, "/pairs/")) {
+        struct str *buf = html_pairs(safe_url, conn->query);
+        if (buf == NULL) {
+            default_reply(conn, 404, "Not Found",
+                "The page you requested could not be found.");
+            free(safe_url);
+            return;
+        }
+        str_extract(buf, &(conn->reply_length), &(conn->reply));
+        conn->mime_type = mime_type_html;
+    }
+    else if (str_starts_with(safe_url, "/top/")) {
+        struct str *buf = html_top(safe_url);
         if (buf == NULL) {
             default_reply(conn, 404, "Not Found",
                 "The page you requested could not be found.");
@@ -682,6 +718,23 @@ static void process_get(struct connection *conn)
         str_extract(buf, &(conn->reply_length), &(conn->reply));
         conn->mime_type = mime_type_html;
     }
+    else if (str_starts_with(safe_url, "/vlans/")) {
+        int want_xml = (strstr(safe_url, "/graphs.xml") != NULL);
+        struct str *buf = want_xml ? xml_vlan_graphs(safe_url)
+                                   : html_vlans(safe_url);
+        if (buf == NULL) {
+            default_reply(conn, 404, "Not Found",
+                "The page you requested could not be found.");
+            free(safe_url);
+            return;
+        }
+        str_extract(buf, &(conn->reply_length), &(conn->reply));
+        if (want_xml) {
+            conn->mime_type = mime_type_xml;
+            conn->header_extra = "Pragma: no-cache\r\n";
+        } else
+            conn->mime_type = mime_type_html;
+    }
     else if (str_starts_with(safe_url, "/graphs.xml")) {
         struct str *buf = xml_graphs();
         str_extract(buf, &(conn->reply_length), &(conn->reply));
@@ -689,11 +742,40 @@ static void process_get(struct connection *conn)
         /* hack around Opera caching the XML */
         conn->header_extra = "Pragma: no-cache\r\n";
     }
+    else if (str_starts_with(safe_url, "/api/")) {
+        struct str *buf = NULL;
+
+        if ((strcmp(safe_url, "/api/hosts") == 0) ||
+            str_starts_with(safe_url, "/api/hosts/"))
+            buf = json_hosts(safe_url, conn->query, &bad_query);
+        else if (strcmp(safe_url, "/api/graphs") == 0)
+            buf = json_graphs();
+        if (buf == NULL) {
+            default_reply(conn, 404, "Not Found",
+                "The page you requested could not be found.");
+            free(safe_url);
+            return;
+        }
+        str_extract(buf, &(conn->reply_length), &(conn->reply));
+        conn->mime_type = mime_type_json;
+        conn->header_extra = "Pragma: no-cache\r\n";
+    }
     else if (str_starts_with(safe_url, "/metrics")) {
-        struct str *buf = text_metrics();
+        struct str *buf = text_metrics(conn->query);
+        if (buf == NULL) {
+            default_reply(conn, 400, "Bad Request",
+                "Use top=<number>, family=4 or 6, and local=yes or no.");
+            free(safe_url);
+            return;
+        }
         str_extract(buf, &(conn->reply_length), &(conn->reply));
         conn->mime_type = mime_type_text_prometheus;
     }
+    else if (strcmp(safe_url, "/debug/stats") == 0) {
+        struct str *buf = html_stats();
+        str_extract(buf, &(conn->reply_length), &(conn->reply));
+        conn->mime_type = mime_type_html;
+    }
     else if (strcmp(safe_url, "/style.css") == 0)
         static_style_css(conn);
     else if (strcmp(safe_url, "/graph.js") == 0)
@@ -708,10 +790,14 @@ static void process_get(struct connection *conn)
         return;
     }
     free(safe_url);
+    stats_time(STATS_RENDER, &t);
 
     process_gzip(conn);
     assert(conn->mime_type != NULL);
-    generate_header(conn, 200, "OK");
+    if (bad_query)
+        generate_header(conn, 400, "Bad Request"); /* with a JSON error */
+    else
+        generate_header(conn, 200, "OK");
 }
 
 
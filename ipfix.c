@@ -0,0 +1,409 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * ipfix.c: export flows to a collector as IPFIX (RFC 7011) or NetFlow v9
+ * (RFC 3954) over UDP.
+ *
+ * Records are batched into datagrams of at most IPFIX_MTU bytes.  The
+ * templates, and an options record carrying the sampling interval, go out
+ * in the first datagram and again every IPFIX_TEMPLATE_REFRESH seconds,
+ * since a UDP collector may have missed them or restarted.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#include "conv.h"
+#include "err.h"
+#include "flow.h"
+#include "ipfix.h"
+#include "now.h"
+#include "str.h"
+
+#include <sys/socket.h>
+#include <assert.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IPFIX_MTU 1400 /* bytes, to stay clear of fragmentation */
+#define IPFIX_TEMPLATE_REFRESH 60 /* secs */
+
+/* Template IDs; data sets use the ID of their template. */
+#define TEMPLATE_V4 256
+#define TEMPLATE_V6 257
+#define TEMPLATE_OPTIONS 258
+
+/* Information element IDs.  NetFlow v9 field types 1-127 are the same. */
+#define IE_OCTETS 1
+#define IE_PACKETS 2
+#define IE_PROTOCOL 4
+#define IE_TCP_FLAGS 6
+#define IE_SRC_PORT 7
+#define IE_SRC_IPV4 8
+#define IE_DST_PORT 11
+#define IE_DST_IPV4 12
+#define IE_LAST_SWITCHED 21 /* v9: sysUptime in msec */
+#define IE_FIRST_SWITCHED 22
+#define IE_SRC_IPV6 27
+#define IE_DST_IPV6 28
+#define IE_SAMPLING_INTERVAL 34
+#define IE_SAMPLING_ALGORITHM 35
+#define IE_OBSERVATION_DOMAIN 149
+#define IE_FLOW_START_SECS 150 /* IPFIX: seconds since the epoch */
+#define IE_FLOW_END_SECS 151
+
+#define V9_SCOPE_SYSTEM 1
+#define SAMPLING_DETERMINISTIC 1
+
+static int ipfix_fd = -1;
+static int ipfix_version;
+static uint32_t ipfix_sampling;
+static time_t ipfix_last_template;
+static int ipfix_templates_sent;
+
+/* The datagram being built. */
+static unsigned char dgram[IPFIX_MTU];
+static size_t dgram_len;  /* 0 if no datagram started */
+static size_t set_start;  /* offset of the open set's header, 0 if none */
+static uint16_t set_id;
+static uint16_t dgram_records; /* all records, for the v9 header */
+static uint32_t dgram_data_records;
+
+/* v9 counts datagrams, IPFIX counts data records before this datagram. */
+static uint32_t ipfix_sequence;
+
+static uint64_t ipfix_stat_sent, ipfix_stat_records, ipfix_stat_errors;
+
+static void put8(const uint8_t v) {
+   dgram[dgram_len++] = v;
+}
+
+static void put16(const uint16_t v) {
+   put8((uint8_t)(v >> 8));
+   put8((uint8_t)v);
+}
+
+static void put32(const uint32_t v) {
+   put16((uint16_t)(v >> 16));
+   put16((uint16_t)v);
+}
+
+static void put64(const uint64_t v) {
+   put32((uint32_t)(v >> 32));
+   put32((uint32_t)v);
+}
+
+static void put_bytes(const void *p, const size_t len) {
+   memcpy(dgram + dgram_len, p, len);
+   dgram_len += len;
+}
+
+static void poke16(const size_t at, const uint16_t v) {
+   dgram[at] = (uint8_t)(v >> 8);
+   dgram[at + 1] = (uint8_t)v;
+}
+
+static void poke32(const size_t at, const uint32_t v) {
+   poke16(at, (uint16_t)(v >> 16));
+   poke16(at + 2, (uint16_t)v);
+}
+
+static size_t header_len(void) {
+   return (ipfix_version == 9) ? 20 : 16;
+}
+
+/* v9 sysUptime in msec, for a real time.  The monotonic clock counts from
+ * boot, which is what sysUptime means.  It wraps after 49 days, as it does
+ * on routers. */
+static uint32_t uptime_ms(const time_t t) {
+   int64_t mono = real_to_mono(t);
+
+   if (mono < 0)
+      return 0;
+   return (uint32_t)((uint64_t)mono * 1000);
+}
+
+/* ---------------------------------------------------------------------------
+ * Sets.  A set is a 4 byte header (ID, length) followed by records, padded
+ * to a multiple of four bytes.
+ */
+static void set_end(void) {
+   if (set_start == 0)
+      return;
+   while ((dgram_len - set_start) % 4 != 0)
+      put8(0);
+   poke16(set_start + 2, (uint16_t)(dgram_len - set_start));
+   set_start = 0;
+}
+
+static void set_begin(const uint16_t id) {
+   if ((set_start != 0) && (set_id == id))
+      return;
+   set_end();
+   set_start = dgram_len;
+   set_id = id;
+   put16(id);
+   put16(0); /* length, filled in by set_end() */
+}
+
+/* Bytes needed to append a record of len bytes to set id, worst case. */
+static size_t set_need(const uint16_t id, const size_t len) {
+   size_t need = len + 3; /* padding */
+
+   if ((set_start == 0) || (set_id != id))
+      need += 4;
+   return need;
+}
+
+/* ---------------------------------------------------------------------------
+ * Datagrams.
+ */
+static void send_datagram(void) {
+   ssize_t wr;
+
+   if (dgram_len == 0)
+      return;
+   set_end();
+   if (ipfix_version == 9) {
+      poke16(0, 9);
+      poke16(2, dgram_records);
+      poke32(4, uptime_ms(now_real()));
+      poke32(8, (uint32_t)now_real());
+      poke32(12, ipfix_sequence++);
+      poke32(16, 0); /* source ID */
+   } else {
+      poke16(0, 10);
+      poke16(2, (uint16_t)dgram_len);
+      poke32(4, (uint32_t)now_real());
+      poke32(8, ipfix_sequence);
+      poke32(12, 0); /* observation domain ID */
+      ipfix_sequence += dgram_data_records;
+   }
+   wr = send(ipfix_fd, dgram, dgram_len, 0);
+   if (wr == -1) {
+      /* Don't flood the log if the collector is down. */
+      if (ipfix_stat_errors++ == 0)
+         warn("flow export: send() failed");
+   } else
+      ipfix_stat_sent++;
+   dgram_len = 0;
+   dgram_records = 0;
+   dgram_data_records = 0;
+}
+
+/* Make sure there are at least need bytes free, starting a datagram if
+ * there isn't one. */
+static void reserve(const size_t need) {
+   assert(header_len() + need <= IPFIX_MTU);
+   if ((dgram_len != 0) && (dgram_len + need > IPFIX_MTU))
+      send_datagram();
+   if (dgram_len == 0) {
+      memset(dgram, 0, header_len());
+      dgram_len = header_len();
+      set_start = 0;
+   }
+}
+
+/* ---------------------------------------------------------------------------
+ * Templates.
+ */
+struct field {
+   uint16_t id, len;
+};
+
+static const struct field fields_v4[] = {
+   { IE_SRC_IPV4, 4 }, { IE_DST_IPV4, 4 },
+   { IE_SRC_PORT, 2 }, { IE_DST_PORT, 2 },
+   { IE_PROTOCOL, 1 }, { IE_TCP_FLAGS, 1 },
+   { IE_OCTETS, 8 }, { IE_PACKETS, 8 },
+   { 0, 4 }, { 0, 4 } /* start and end time, depend on the version */
+};
+
+static const struct field fields_v6[] = {
+   { IE_SRC_IPV6, 16 }, { IE_DST_IPV6, 16 },
+   { IE_SRC_PORT, 2 }, { IE_DST_PORT, 2 },
+   { IE_PROTOCOL, 1 }, { IE_TCP_FLAGS, 1 },
+   { IE_OCTETS, 8 }, { IE_PACKETS, 8 },
+   { 0, 4 }, { 0, 4 }
+};
+
+#define NUM_FIELDS (sizeof(fields_v4) / sizeof(*fields_v4))
+
+static size_t record_len(const struct field *f) {
+   size_t i, len = 0;
+
+   for (i = 0; i < NUM_FIELDS; i++)
+      len += f[i].len;
+   return len;
+}
+
+static void put_template(const uint16_t id, const struct field *f) {
+   size_t i;
+
+   put16(id);
+   put16((uint16_t)NUM_FIELDS);
+   for (i = 0; i < NUM_FIELDS - 2; i++) {
+      put16(f[i].id);
+      put16(f[i].len);
+   }
+   put16((ipfix_version == 9) ? IE_FIRST_SWITCHED : IE_FLOW_START_SECS);
+   put16(4);
+   put16((ipfix_version == 9) ? IE_LAST_SWITCHED : IE_FLOW_END_SECS);
+   put16(4);
+   dgram_records++;
+}
+
+/* The options template says the sampling applies to the whole exporter. */
+static void put_options_template(void) {
+   put16(TEMPLATE_OPTIONS);
+   if (ipfix_version == 9) {
+      put16(4); /* scope length in bytes */
+      put16(8); /* options length in bytes */
+      put16(V9_SCOPE_SYSTEM); put16(4);
+   } else {
+      put16(3); /* field count */
+      put16(1); /* scope field count */
+      put16(IE_OBSERVATION_DOMAIN); put16(4);
+   }
+   put16(IE_SAMPLING_INTERVAL); put16(4);
+   put16(IE_SAMPLING_ALGORITHM); put16(1);
+   dgram_records++;
+}
+
+static void send_templates(void) {
+   const size_t tmpl_len = 4 + 4 * NUM_FIELDS, opts_len = 4 + 4 * 4;
+
+   reserve(4 + 2 * tmpl_len + 3 + 4 + opts_len + 3 + 4 + 9 + 3);
+   set_begin((ipfix_version == 9) ? 0 : 2);
+   put_template(TEMPLATE_V4, fields_v4);
+   put_template(TEMPLATE_V6, fields_v6);
+   set_begin((ipfix_version == 9) ? 1 : 3);
+   put_options_template();
+   set_begin(TEMPLATE_OPTIONS);
+   put32(0); /* scope: system / observation domain 0 */
+   put32(ipfix_sampling);
+   put8(SAMPLING_DETERMINISTIC);
+   dgram_records++;
+
+   ipfix_templates_sent = 1;
+   ipfix_last_template = now_mono();
+}
+
+/* ---------------------------------------------------------------------------
+ * Public interface.
+ */
+void ipfix_init(const char *dest, const int version,
+   const unsigned int sampling)
+{
+   struct addrinfo hints, *ai, *res;
+   char *host, *port;
+   int ret;
+
+   assert((version == 9) || (version == 10));
+   host = xstrdup(dest);
+   port = strrchr(host, ':');
+   if (port == NULL)
+      errx(1, "flow export: \"%s\" should be host:port", dest);
+   *port++ = '\0';
+   if ((host[0] == '[') && (port - host >= 3) && (port[-2] == ']')) {
+      port[-2] = '\0';
+      memmove(host, host + 1, strlen(host + 1) + 1);
+   }
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_DGRAM;
+   if ((ret = getaddrinfo(host, port, &hints, &res)) != 0)
+      errx(1, "flow export: can't resolve \"%s\": %s",
+         dest, gai_strerror(ret));
+   for (ai = res; ai != NULL; ai = ai->ai_next) {
+      ipfix_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (ipfix_fd == -1)
+         continue;
+      if (connect(ipfix_fd, ai->ai_addr, ai->ai_addrlen) == 0)
+         break;
+      close(ipfix_fd);
+      ipfix_fd = -1;
+   }
+   freeaddrinfo(res);
+   if (ipfix_fd == -1)
+      err(1, "flow export: can't connect to \"%s\"", dest);
+   free(host);
+
+   ipfix_version = version;
+   ipfix_sampling = (sampling > 0) ? sampling : 1;
+   ipfix_templates_sent = 0;
+   ipfix_sequence = 0;
+   dgram_len = 0;
+   verbosef("flow export: %s to %s, sampling 1 in %u",
+      (version == 9) ? "NetFlow v9" : "IPFIX", dest,
+      (unsigned int)ipfix_sampling);
+}
+
+void ipfix_free(void) {
+   if (ipfix_fd == -1)
+      return;
+   ipfix_flush();
+   close(ipfix_fd);
+   ipfix_fd = -1;
+   verbosef("flow export: sent %llu records in %llu datagrams, "
+      "%llu errors", (llu)ipfix_stat_records, (llu)ipfix_stat_sent,
+      (llu)ipfix_stat_errors);
+}
+
+void ipfix_add(const struct flow_rec * const r) {
+   const struct field *f;
+   uint16_t id;
+   size_t len;
+
+   if (ipfix_fd == -1)
+      return;
+   if (!ipfix_templates_sent ||
+       (now_mono() - ipfix_last_template >= IPFIX_TEMPLATE_REFRESH))
+      send_templates();
+
+   if (r->key.src.family == IPv4) {
+      f = fields_v4;
+      id = TEMPLATE_V4;
+   } else {
+      assert(r->key.src.family == IPv6);
+      f = fields_v6;
+      id = TEMPLATE_V6;
+   }
+   len = record_len(f);
+   reserve(set_need(id, len));
+   set_begin(id);
+
+   if (id == TEMPLATE_V4) {
+      put_bytes(&(r->key.src.ip.v4), 4);
+      put_bytes(&(r->key.dst.ip.v4), 4);
+   } else {
+      put_bytes(&(r->key.src.ip.v6), 16);
+      put_bytes(&(r->key.dst.ip.v6), 16);
+   }
+   put16(r->key.src_port);
+   put16(r->key.dst_port);
+   put8(r->key.proto);
+   put8(r->tcp_flags);
+   put64(r->bytes);
+   put64(r->pkts);
+   if (ipfix_version == 9) {
+      put32(uptime_ms(r->first));
+      put32(uptime_ms(r->last));
+   } else {
+      put32((uint32_t)r->first);
+      put32((uint32_t)r->last);
+   }
+   dgram_records++;
+   dgram_data_records++;
+   ipfix_stat_records++;
+}
+
+void ipfix_flush(void) {
+   if (ipfix_fd != -1)
+      send_datagram();
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
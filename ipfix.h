@@ -0,0 +1,28 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * ipfix.h: export flows to a collector as IPFIX or NetFlow v9
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_IPFIX_H
+#define __DARKSTAT_IPFIX_H
+
+struct flow_rec;
+
+/* dest is "host:port" or "[v6addr]:port", version is 9 or 10 (IPFIX).
+ * sampling is the 1-in-N packet sampling interval of the flow cache.
+ * Call it before chroot, for the name lookup. */
+void ipfix_init(const char *dest, const int version,
+   const unsigned int sampling);
+void ipfix_free(void);
+
+/* Queue a flow record, sending a datagram if it fills up. */
+void ipfix_add(const struct flow_rec * const r);
+
+/* Send whatever is queued. */
+void ipfix_flush(void);
+
+#endif /* __DARKSTAT_IPFIX_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
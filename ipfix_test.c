@@ -0,0 +1,223 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * ipfix_test.c: tests for ipfix.c, against a UDP sink on localhost
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "err.h"
+#include "flow.h"
+#include "ipfix.h"
+#include "now.h"
+#include "test_util.h"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static time_t fake_real = 1700000000, fake_mono = 1000;
+time_t now_real(void) { return fake_real; }
+time_t now_mono(void) { return fake_mono; }
+int64_t real_to_mono(const time_t t) { return t - fake_real + fake_mono; }
+
+/* ------------------------------------------------------------------------ */
+
+static int sink;
+static char sink_addr[32];
+
+static void sink_open(void) {
+  struct sockaddr_in sin;
+  socklen_t len = sizeof(sin);
+  struct timeval tv = { 2, 0 };
+
+  sink = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((sink == -1) ||
+      (bind(sink, (struct sockaddr *)&sin, sizeof(sin)) == -1) ||
+      (getsockname(sink, (struct sockaddr *)&sin, &len) == -1) ||
+      (setsockopt(sink, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1))
+    err(1, "can't set up UDP sink");
+  snprintf(sink_addr, sizeof(sink_addr), "127.0.0.1:%u",
+      (unsigned)ntohs(sin.sin_port));
+}
+
+static unsigned get16(const unsigned char *p) {
+  return ((unsigned)p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const unsigned char *p) {
+  return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static uint64_t get64(const unsigned char *p) {
+  return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+/* What we found in one datagram. */
+struct msg {
+  size_t len;
+  unsigned version, count;
+  uint32_t sequence;
+  int templates, options_templates, v4_records, v6_records;
+  uint32_t sampling;
+  unsigned first_time_field;
+  unsigned char v4[38]; /* the first IPv4 record */
+};
+
+static int receive(struct msg *m, int version) {
+  unsigned char buf[2048];
+  size_t pos;
+  ssize_t len;
+  const size_t hdr = (version == 9) ? 20 : 16;
+  const unsigned tmpl = (version == 9) ? 0 : 2;
+  const unsigned opts = (version == 9) ? 1 : 3;
+
+  memset(m, 0, sizeof(*m));
+  if ((len = recv(sink, buf, sizeof(buf), 0)) < (ssize_t)hdr) return 0;
+  m->len = (size_t)len;
+  m->version = get16(buf);
+  m->count = get16(buf + 2);
+  m->sequence = get32(buf + ((version == 9) ? 12 : 8));
+
+  for (pos = hdr; pos + 4 <= m->len; ) {
+    unsigned id = get16(buf + pos), slen = get16(buf + pos + 2);
+    const unsigned char *p = buf + pos + 4;
+
+    if ((slen < 4) || (slen % 4 != 0) || (pos + slen > m->len)) return 0;
+    if (id == tmpl) {
+      m->templates += 2;
+      m->first_time_field = get16(p + 4 + 8 * 4);
+    } else if (id == opts) {
+      m->options_templates++;
+    } else if (id == 258) {
+      m->sampling = get32(p + 4);
+    } else if (id == 256) {
+      if (m->v4_records == 0) memcpy(m->v4, p, sizeof(m->v4));
+      m->v4_records += (slen - 4) / 38;
+    } else if (id == 257) {
+      m->v6_records += (slen - 4) / 62;
+    } else {
+      return 0;
+    }
+    pos += slen;
+  }
+  return pos == m->len;
+}
+
+static void make_rec(struct flow_rec *r, int family, unsigned i) {
+  memset(r, 0, sizeof(*r));
+  if (family == 4) {
+    r->key.src.family = r->key.dst.family = IPv4;
+    r->key.src.ip.v4 = htonl(0x0a000001);
+    r->key.dst.ip.v4 = htonl(0xc0a80100 + (i & 0xff));
+  } else {
+    r->key.src.family = r->key.dst.family = IPv6;
+    inet_pton(AF_INET6, "2001:db8::1", &r->key.src.ip.v6);
+    inet_pton(AF_INET6, "2001:db8::2", &r->key.dst.ip.v6);
+  }
+  r->key.src_port = 40000;
+  r->key.dst_port = 443;
+  r->key.proto = 6;
+  r->first = fake_real - 10;
+  r->last = fake_real;
+  r->bytes = 123456789012ULL + i;
+  r->pkts = 1000 + i;
+  r->tcp_flags = 0x1b;
+}
+
+static void test_version(int version) {
+  struct flow_rec r;
+  struct msg m;
+  unsigned i, got, datagrams, ok_len, ok_seq;
+  uint32_t seq;
+  char what[64];
+
+  ipfix_init(sink_addr, version, 100);
+
+  /* First datagram carries the templates. */
+  make_rec(&r, 4, 0);
+  ipfix_add(&r);
+  make_rec(&r, 6, 0);
+  ipfix_add(&r);
+  ipfix_flush();
+  snprintf(what, sizeof(what), "v%d first datagram parses", version);
+  check(receive(&m, version), what);
+  check(m.version == (unsigned)version, "version");
+  check((m.templates == 2) && (m.options_templates == 1),
+      "templates in first datagram");
+  check(m.first_time_field == ((version == 9) ? 22 : 150),
+      "time field for version");
+  check(m.sampling == 100, "sampling interval in options record");
+  check((m.v4_records == 1) && (m.v6_records == 1), "one record each");
+  if (version == 9)
+    check(m.count == 6, "v9 count covers templates and records");
+  else
+    check(m.count == m.len, "IPFIX length");
+  check(m.sequence == 0, "first sequence number");
+  check((get32(m.v4) == 0x0a000001) && (get32(m.v4 + 4) == 0xc0a80100) &&
+      (get16(m.v4 + 8) == 40000) && (get16(m.v4 + 10) == 443) &&
+      (m.v4[12] == 6) && (m.v4[13] == 0x1b) &&
+      (get64(m.v4 + 14) == 123456789012ULL) && (get64(m.v4 + 22) == 1000),
+      "IPv4 record fields");
+  if (version == 10)
+    check((get32(m.v4 + 30) == fake_real - 10) &&
+        (get32(m.v4 + 34) == fake_real), "IPFIX start and end seconds");
+
+  /* Lots of records are split into datagrams which fit the MTU. */
+  for (i = 0; i < 200; i++) {
+    make_rec(&r, 4, i);
+    ipfix_add(&r);
+  }
+  ipfix_flush();
+  got = datagrams = 0;
+  ok_len = ok_seq = 1;
+  seq = (version == 9) ? 1 : 2;
+  while (got < 200 && receive(&m, version)) {
+    if (m.len > 1400) ok_len = 0;
+    if (m.templates != 0) ok_len = 0;
+    if (m.sequence != seq) ok_seq = 0;
+    seq += (version == 9) ? 1 : (uint32_t)m.v4_records;
+    got += (unsigned)m.v4_records;
+    datagrams++;
+  }
+  check(got == 200, "all records arrive");
+  check(datagrams > 1, "records are split across datagrams");
+  check(ok_len, "datagrams fit, no templates before refresh");
+  check(ok_seq, "sequence numbers");
+
+  /* Templates are resent after the refresh interval. */
+  fake_mono += 60;
+  make_rec(&r, 4, 0);
+  ipfix_add(&r);
+  ipfix_flush();
+  check(receive(&m, version) && (m.templates == 2), "template refresh");
+
+  ipfix_free();
+}
+
+int main(void) {
+  sink_open();
+  test_version(10);
+  test_version(9);
+  close(sink);
+  return test_retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
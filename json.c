@@ -0,0 +1,123 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * json.c: streaming JSON writer
+ *
+ * There's no tree of values: everything goes straight into the str, so a
+ * big table costs no more memory than its text.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#include "json.h"
+#include "str.h"
+
+#include <assert.h>
+
+void json_init(struct json *j, struct str *buf) {
+   j->buf = buf;
+   j->depth = 0;
+   j->more = 0;
+   j->arrays = 0;
+}
+
+/* Strings are escaped so the output is plain ASCII, whatever the input.
+ * Bytes above 0x7F are taken to be Latin-1.
+ */
+static void json_escape(struct str *buf, const char *s) {
+   static const char hex[] = "0123456789abcdef";
+   const char *run = s;
+
+   str_append(buf, "\"");
+   for (; *s != '\0'; s++) {
+      const unsigned char c = (unsigned char)*s;
+      char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+
+      if ((c >= 0x20) && (c < 0x7F) && (c != '"') && (c != '\\'))
+         continue;
+      str_appendn(buf, run, (size_t)(s - run));
+      run = s + 1;
+      if ((c == '"') || (c == '\\')) {
+         esc[1] = (char)c;
+         str_appendn(buf, esc, 2);
+      } else {
+         esc[4] = hex[c >> 4];
+         esc[5] = hex[c & 0xF];
+         str_appendn(buf, esc, sizeof(esc));
+      }
+   }
+   str_appendn(buf, run, (size_t)(s - run));
+   str_append(buf, "\"");
+}
+
+/* The comma and key in front of a member. */
+static void json_member(struct json *j, const char *key) {
+   const uint32_t bit = 1U << j->depth;
+
+   assert((key != NULL) == ((j->depth > 0) && !(j->arrays & bit)));
+   if (j->more & bit)
+      str_append(j->buf, ",");
+   j->more |= bit;
+   if (key != NULL) {
+      json_escape(j->buf, key);
+      str_append(j->buf, ":");
+   }
+}
+
+static void json_open(struct json *j, const char *key, const int array) {
+   uint32_t bit;
+
+   json_member(j, key);
+   assert(j->depth + 1 < JSON_MAX_DEPTH);
+   j->depth++;
+   bit = 1U << j->depth;
+   j->more &= ~bit;
+   if (array)
+      j->arrays |= bit;
+   else
+      j->arrays &= ~bit;
+   str_append(j->buf, array ? "[" : "{");
+}
+
+void json_object(struct json *j, const char *key) {
+   json_open(j, key, 0);
+}
+
+void json_array(struct json *j, const char *key) {
+   json_open(j, key, 1);
+}
+
+void json_end(struct json *j) {
+   assert(j->depth > 0);
+   str_append(j->buf, (j->arrays & (1U << j->depth)) ? "]" : "}");
+   j->depth--;
+   if (j->depth == 0)
+      str_append(j->buf, "\n");
+}
+
+void json_str(struct json *j, const char *key, const char *val) {
+   if (val == NULL) {
+      json_null(j, key);
+      return;
+   }
+   json_member(j, key);
+   json_escape(j->buf, val);
+}
+
+void json_uint(struct json *j, const char *key, const uint64_t val) {
+   json_member(j, key);
+   str_appendf(j->buf, "%qu", (qu)val);
+}
+
+void json_int(struct json *j, const char *key, const int64_t val) {
+   json_member(j, key);
+   str_appendf(j->buf, "%qd", (qd)val);
+}
+
+void json_null(struct json *j, const char *key) {
+   json_member(j, key);
+   str_append(j->buf, "null");
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
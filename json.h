@@ -0,0 +1,40 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * json.h: streaming JSON writer
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_JSON_H
+#define __DARKSTAT_JSON_H
+
+#include <stdint.h>
+
+struct str;
+
+#define JSON_MAX_DEPTH 32
+
+/* Appends JSON to buf as it goes, keeping track of nothing but the commas.
+ * Every call takes the key of the member it adds, which must be NULL at the
+ * top level and inside an array, and non-NULL inside an object.
+ */
+struct json {
+   struct str *buf;
+   unsigned int depth;
+   uint32_t more;   /* bit n: depth n already has a member */
+   uint32_t arrays; /* bit n: depth n is an array */
+};
+
+void json_init(struct json *j, struct str *buf);
+void json_object(struct json *j, const char *key);
+void json_array(struct json *j, const char *key);
+void json_end(struct json *j); /* of the innermost object or array */
+
+void json_str(struct json *j, const char *key, const char *val); /* or NULL */
+void json_uint(struct json *j, const char *key, const uint64_t val);
+void json_int(struct json *j, const char *key, const int64_t val);
+void json_null(struct json *j, const char *key);
+
+#endif /* __DARKSTAT_JSON_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
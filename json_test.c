@@ -0,0 +1,115 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * json_test.c: tests for json.c
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "json.h"
+#include "str.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Checks that buf holds exactly want, and frees it. */
+static void check_json(struct str *buf, const char *want, const char *what) {
+  char *got;
+  size_t len;
+  int ok;
+
+  str_extract(buf, &len, &got);
+  ok = (len == strlen(want)) && (memcmp(got, want, len) == 0);
+  check(ok, what);
+  if (!ok)
+    printf("  got:  %.*s\n  want: %s\n", (int)len, got, want);
+  free(got);
+}
+
+static void test_empty(void) {
+  struct str *buf = str_make();
+  struct json j;
+
+  json_init(&j, buf);
+  json_object(&j, NULL);
+  json_array(&j, "a");
+  json_end(&j);
+  json_object(&j, "o");
+  json_end(&j);
+  json_end(&j);
+  check_json(buf, "{\"a\":[],\"o\":{}}\n", "empty object and array");
+}
+
+static void test_values(void) {
+  struct str *buf = str_make();
+  struct json j;
+
+  json_init(&j, buf);
+  json_object(&j, NULL);
+  json_uint(&j, "u", 18446744073709551615ULL);
+  json_int(&j, "i", -42);
+  json_str(&j, "s", "hi");
+  json_str(&j, "n", NULL);
+  json_null(&j, "z");
+  json_end(&j);
+  check_json(buf, "{\"u\":18446744073709551615,\"i\":-42,\"s\":\"hi\","
+        "\"n\":null,\"z\":null}\n", "values");
+}
+
+static void test_nesting(void) {
+  struct str *buf = str_make();
+  struct json j;
+  int i;
+
+  json_init(&j, buf);
+  json_array(&j, NULL);
+  for (i = 0; i < 3; i++) {
+    json_object(&j, NULL);
+    json_int(&j, "i", i);
+    json_array(&j, "x");
+    json_uint(&j, NULL, 1);
+    json_uint(&j, NULL, 2);
+    json_end(&j);
+    json_end(&j);
+  }
+  json_end(&j);
+  check_json(buf, "[{\"i\":0,\"x\":[1,2]},{\"i\":1,\"x\":[1,2]},"
+        "{\"i\":2,\"x\":[1,2]}]\n", "commas in nested arrays");
+}
+
+static void test_escape(void) {
+  struct str *buf = str_make();
+  struct json j;
+
+  json_init(&j, buf);
+  json_array(&j, NULL);
+  json_str(&j, NULL, "a\"b\\c");
+  json_str(&j, NULL, "tab\there\nnl");
+  json_str(&j, NULL, "caf\xe9");
+  json_str(&j, NULL, "");
+  json_end(&j);
+  check_json(buf, "[\"a\\\"b\\\\c\",\"tab\\u0009here\\u000anl\","
+        "\"caf\\u00e9\",\"\"]\n", "escaping");
+}
+
+int main(void) {
+  test_empty();
+  test_values();
+  test_nesting();
+  test_escape();
+  return test_retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
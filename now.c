@@ -140,16 +140,16 @@ static int64_t ts_diff(const struct timespec * const a,
           a->tv_nsec - b->tv_nsec;
 }
 
-void timer_stop(const struct timespec * const t0,
-                const int64_t nsec,
-                const char *warning) {
+int64_t timer_stop(const struct timespec * const t0,
+                   const int64_t nsec,
+                   const char *warning) {
    struct timespec t1;
    int64_t diff;
 
    clock_gettime(CLOCK_MONOTONIC, &t1);
    if (before(&t1, t0)) {
       warn_backwards("monotonic timer", t0, &t1);
-      return;
+      return 0;
    }
    diff = ts_diff(&t1, t0);
    if (diff > nsec) {
@@ -158,6 +158,7 @@ void timer_stop(const struct timespec * const t0,
             (lld)diff,
             (lld)nsec);
    }
+   return diff;
 }
 
 /* vim:set ts=3 sw=3 tw=80 et: */
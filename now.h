@@ -28,11 +28,12 @@ time_t now_mono(void);
 time_t mono_to_real(const int64_t t);
 int64_t real_to_mono(const time_t t);
 
-/* Emits warnings if a call is too slow. */
+/* Emits warnings if a call is too slow.  timer_stop() returns how long it
+ * took, in nsec. */
 struct timespec;
 void timer_start(struct timespec *t);
-void timer_stop(const struct timespec * const t,
-                const int64_t nsec,
-                const char *warning);
+int64_t timer_stop(const struct timespec * const t,
+                   const int64_t nsec,
+                   const char *warning);
 
 /* vim:set ts=3 sw=3 tw=80 et: */
@@ -8,8 +8,12 @@
 extern int opt_want_pppoe;
 extern int opt_want_macs;
 extern int opt_want_hexdump;
+extern int opt_want_decap; /* account for the packet inside a tunnel */
+extern int opt_len_from; /* enum len_from, in decode.h */
 extern int opt_want_snaplen;
 extern int opt_wait_secs;
+extern unsigned int opt_sample; /* account for 1 in N packets, scaled by N */
+extern int opt_want_sample_random;
 
 /* Error/logging options. */
 extern int opt_want_verbose;
@@ -18,6 +22,13 @@ extern int opt_want_syslog;
 /* Accounting options. */
 extern unsigned int opt_highest_port;
 extern int opt_want_local_only;
+extern int opt_want_vlans;
+
+/* Hosts are folded into prefixes of these lengths, by default 32 and 128
+ * which is no folding at all.
+ */
+extern unsigned int opt_local_prefix4, opt_local_prefix6;
+extern unsigned int opt_remote_prefix4, opt_remote_prefix6;
 
 /* Hosts table reduction - when the number of entries is about to exceed
  * <max>, we reduce the table to the top <keep> entries.
@@ -26,6 +37,17 @@ extern unsigned int opt_hosts_max;
 extern unsigned int opt_hosts_keep;
 extern unsigned int opt_ports_max;
 extern unsigned int opt_ports_keep;
+extern unsigned int opt_pairs_max; /* zero disables the pairs table */
+extern unsigned int opt_pairs_keep;
+extern unsigned int opt_sketch_width; /* zero disables the sketch */
+extern unsigned int opt_host_graphs;  /* zero disables per-host graphs */
+extern const char *opt_graph_store;   /* NULL keeps graphs in memory */
+
+/* Flow cache, disabled if opt_flows_max is zero.  Timeouts are in seconds. */
+extern unsigned int opt_flows_max;
+extern unsigned int opt_flow_idle;
+extern unsigned int opt_flow_active;
+extern unsigned int opt_flow_sample; /* 1-in-N, 0 or 1 for all packets */
 
 /* Hosts output options. */
 extern int opt_want_lastseen;
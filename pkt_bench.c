@@ -0,0 +1,419 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * pkt_bench.c: throughput of decode and acct on synthetic traffic
+ *
+ * Builds Ethernet frames in memory from a seeded generator, so runs can be
+ * compared between builds, then times decode_packet() alone, acct_for()
+ * alone on the decoded packets, and the two together like cap.c does.
+ * Hosts and pairs are picked with a Zipf distribution, so a few hosts send
+ * most of the traffic, the way they do on real networks.
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "acct.h"
+#include "daylog.h"
+#include "decode.h"
+#include "graph_db.h"
+#include "hosts_db.h"
+#include "localip.h"
+#include "now.h"
+#include "sketch.h"
+
+#include <netinet/in.h>
+#include <pcap.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The rest of darkstat needs these, and darkstat.o has its own main().
+ * The defaults are the same as darkstat's.
+ */
+int opt_want_pppoe = 0;
+int opt_want_macs = 1;
+int opt_want_hexdump = 0;
+int opt_want_decap = 0;
+int opt_len_from = LEN_FROM_IP;
+int opt_want_snaplen = -1;
+int opt_wait_secs = -1;
+unsigned int opt_sample = 1;
+int opt_want_sample_random = 0;
+int opt_want_verbose = 0;
+int opt_want_syslog = 0;
+unsigned int opt_highest_port = 65535;
+int opt_want_local_only = 0;
+int opt_want_vlans = 0;
+unsigned int opt_local_prefix4 = 32, opt_local_prefix6 = 128;
+unsigned int opt_remote_prefix4 = 32, opt_remote_prefix6 = 128;
+unsigned int opt_hosts_max = 1000;
+unsigned int opt_hosts_keep = 500;
+unsigned int opt_ports_max = 60;
+unsigned int opt_ports_keep = 30;
+unsigned int opt_pairs_max = 0;
+unsigned int opt_pairs_keep = 0;
+unsigned int opt_sketch_width = 0;
+unsigned int opt_host_graphs = 0;
+const char *opt_graph_store = NULL;
+unsigned int opt_flows_max = 0;
+unsigned int opt_flow_idle = 15;
+unsigned int opt_flow_active = 1800;
+unsigned int opt_flow_sample = 1;
+int opt_want_lastseen = 1;
+
+/* Frames are generated once into a pool, which is replayed for as many
+ * packets as we want, so the generator isn't part of what's timed.
+ */
+#define POOL_MAX 65536
+#define FRAME_LEN (14 + 40 + 20) /* Ethernet, IPv6, TCP */
+
+struct frame {
+  struct pcap_pkthdr hdr;
+  u_char data[FRAME_LEN];
+};
+
+struct bench_opts {
+  unsigned long packets;
+  unsigned int hosts;
+  unsigned int pct_v6;
+  unsigned int ports;
+  double skew;
+  uint64_t seed;
+};
+
+static uint64_t rng;
+
+/* xorshift64*, as good as we need and the same everywhere. */
+static uint64_t rand64(void) {
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* [0, 1) */
+static double rand_unit(void) {
+  return (double)(rand64() >> 11) / 9007199254740992.0;
+}
+
+static unsigned int rand_below(const unsigned int n) {
+  return (unsigned int)(rand64() % n);
+}
+
+/* Cumulative weights of ranks 1..n, where rank k has weight 1/k^s.  With
+ * s = 0 it's uniform.
+ */
+struct zipf {
+  double *cdf;
+  unsigned int n;
+};
+
+static void zipf_init(struct zipf *z, const unsigned int n, const double s) {
+  double sum = 0;
+  unsigned int k;
+
+  z->n = n;
+  z->cdf = malloc(n * sizeof(*z->cdf));
+  if (z->cdf == NULL) {
+    fprintf(stderr, "malloc(): out of memory\n");
+    exit(1);
+  }
+  for (k = 0; k < n; k++) {
+    sum += 1.0 / pow((double)(k + 1), s);
+    z->cdf[k] = sum;
+  }
+}
+
+/* Returns a rank from 0 to n-1. */
+static unsigned int zipf_pick(const struct zipf *z) {
+  const double u = rand_unit() * z->cdf[z->n - 1];
+  unsigned int lo = 0, hi = z->n - 1;
+
+  while (lo < hi) {
+    const unsigned int mid = lo + (hi - lo) / 2;
+    if (z->cdf[mid] <= u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void put16(u_char *p, const unsigned int v) {
+  p[0] = (u_char)(v >> 8);
+  p[1] = (u_char)v;
+}
+
+/* Host n of a family.  Even IPv4 hosts are inside the local network
+ * (10/8), odd ones are in the benchmarking range (198.18/15).  IPv6 hosts
+ * are in the documentation range.
+ */
+static void put_host(u_char *p, const int v6, const unsigned int n) {
+  if (v6) {
+    memset(p, 0, 16);
+    put16(p, 0x2001);
+    put16(p + 2, 0x0db8);
+    put16(p + 12, n >> 16);
+    put16(p + 14, n);
+  } else if (n % 2 == 0) {
+    p[0] = 10;
+    p[1] = (u_char)(n >> 17);
+    p[2] = (u_char)(n >> 9);
+    p[3] = (u_char)(n >> 1);
+  } else {
+    p[0] = 198;
+    p[1] = (u_char)(18 + ((n >> 17) & 1));
+    p[2] = (u_char)(n >> 9);
+    p[3] = (u_char)(n >> 1);
+  }
+}
+
+static void put_mac(u_char *p, const unsigned int n) {
+  p[0] = 0x02; /* locally administered */
+  p[1] = 0;
+  p[2] = (u_char)(n >> 24);
+  p[3] = (u_char)(n >> 16);
+  p[4] = (u_char)(n >> 8);
+  p[5] = (u_char)n;
+}
+
+/* One TCP or UDP packet between two hosts of the same family.  The server
+ * port is one of the first o->ports, and the client's is ephemeral.  A
+ * fifth of the packets are UDP, and a sixteenth of TCP ones are SYNs.
+ */
+static void make_frame(struct frame *f, const struct bench_opts *o,
+                       const struct zipf *z4, const struct zipf *z6) {
+  const int v6 = (rand_below(100) < o->pct_v6);
+  const struct zipf *z = v6 ? z6 : z4;
+  const unsigned int src = zipf_pick(z), dst = zipf_pick(z);
+  const int udp = (rand_below(5) == 0);
+  const unsigned int wire_len = 64 + rand_below(1500 - 64 + 1);
+  const unsigned int iphl = v6 ? 40 : 20, l4hl = udp ? 8 : 20;
+  unsigned int server = 1 + rand_below(o->ports),
+               client = 32768 + rand_below(32768);
+  u_char *p = f->data;
+
+  if (rand_below(2)) {
+    const unsigned int t = server;
+    server = client;
+    client = t;
+  }
+
+  memset(f, 0, sizeof(*f));
+  put_mac(p, dst);
+  put_mac(p + 6, src + 0x10000);
+  put16(p + 12, v6 ? 0x86DD : 0x0800);
+  p += 14;
+  if (v6) {
+    p[0] = 0x60;
+    put16(p + 4, wire_len - 14 - iphl);
+    p[6] = udp ? IPPROTO_UDP : IPPROTO_TCP;
+    p[7] = 64;
+    put_host(p + 8, 1, src);
+    put_host(p + 24, 1, dst);
+  } else {
+    p[0] = 0x45;
+    put16(p + 2, wire_len - 14);
+    put16(p + 6, 0x4000); /* don't fragment */
+    p[8] = 64;
+    p[9] = udp ? IPPROTO_UDP : IPPROTO_TCP;
+    put_host(p + 12, 0, src);
+    put_host(p + 16, 0, dst);
+  }
+  p += iphl;
+  put16(p, client);
+  put16(p + 2, server);
+  if (udp)
+    put16(p + 4, wire_len - 14 - iphl);
+  else {
+    p[12] = 0x50;
+    p[13] = (rand_below(16) == 0) ? 0x02 : 0x10; /* SYN or ACK */
+  }
+  f->hdr.caplen = 14 + iphl + l4hl;
+  f->hdr.len = wire_len;
+}
+
+static double elapsed(const struct timespec *t0) {
+  struct timespec t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (double)(t1.tv_sec - t0->tv_sec) +
+         (double)(t1.tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+static void report(const char *what, const unsigned long packets,
+                   const double secs) {
+  printf("%-12s %10lu pkts %10.3f s %10.1f ns/pkt %12.0f pkts/s\n",
+         what, packets, secs, secs * 1e9 / (double)packets,
+         (double)packets / secs);
+}
+
+/* Empties the tables between runs, so each one starts the same. */
+static void reset(void) {
+  hosts_db_reset();
+  graph_reset();
+  sketch_reset();
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+    "usage: %s [-n packets] [-H hosts] [-6 percent] [-p ports]\n"
+    "          [-z skew] [-s seed] [-m hosts-max] [-P pairs-max]\n"
+    "\n"
+    "  -n  packets to time in each run (default 1000000)\n"
+    "  -H  distinct hosts (default 10000)\n"
+    "  -6  percentage of IPv6 packets (default 0)\n"
+    "  -p  distinct server ports (default 1024)\n"
+    "  -z  Zipf exponent for picking hosts, 0 is uniform (default 1.0)\n"
+    "  -s  random seed (default 1)\n"
+    "  -m  --hosts-max (default 1000)\n"
+    "  -P  --pairs-max (default 0, no pairs table)\n",
+    argv0);
+  exit(1);
+}
+
+static unsigned long parse_num(const char *s, const char *argv0) {
+  char *end;
+  const unsigned long n = strtoul(s, &end, 10);
+
+  if (*s == '\0' || *end != '\0')
+    usage(argv0);
+  return n;
+}
+
+int main(int argc, char **argv) {
+  struct bench_opts o;
+  struct zipf z4, z6;
+  struct frame *pool;
+  struct pktsummary *sms;
+  const struct linkhdr *lh;
+  struct local_ips local_ips;
+  struct timespec t;
+  unsigned long i, decoded = 0;
+  unsigned int pool_size, hosts6;
+  int c;
+
+  o.packets = 1000000;
+  o.hosts = 10000;
+  o.pct_v6 = 0;
+  o.ports = 1024;
+  o.skew = 1.0;
+  o.seed = 1;
+  while ((c = getopt(argc, argv, "n:H:6:p:z:s:m:P:")) != -1) {
+    switch (c) {
+      case 'n': o.packets = parse_num(optarg, argv[0]); break;
+      case 'H': o.hosts = (unsigned int)parse_num(optarg, argv[0]); break;
+      case '6': o.pct_v6 = (unsigned int)parse_num(optarg, argv[0]); break;
+      case 'p': o.ports = (unsigned int)parse_num(optarg, argv[0]); break;
+      case 'z': o.skew = atof(optarg); break;
+      case 's': o.seed = parse_num(optarg, argv[0]); break;
+      case 'm':
+        opt_hosts_max = (unsigned int)parse_num(optarg, argv[0]);
+        opt_hosts_keep = opt_hosts_max / 2;
+        break;
+      case 'P':
+        opt_pairs_max = (unsigned int)parse_num(optarg, argv[0]);
+        opt_pairs_keep = opt_pairs_max / 2;
+        break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || o.packets == 0 || o.hosts < 2 || o.pct_v6 > 100 ||
+      o.ports == 0 || o.ports > 32767 || o.skew < 0)
+    usage(argv[0]);
+
+  printf("%lu packets, %u hosts, %u%% IPv6, %u ports, Zipf %.2f, seed %lu\n",
+         o.packets, o.hosts, o.pct_v6, o.ports, o.skew,
+         (unsigned long)o.seed);
+
+  /* Generate. */
+  rng = o.seed * 0x9E3779B97F4A7C15ULL + 1;
+  /* Hosts are split between the families like the packets are, with at
+   * least one each if the family is used at all.
+   */
+  hosts6 = o.hosts * o.pct_v6 / 100;
+  if (o.pct_v6 > 0 && hosts6 == 0) hosts6 = 1;
+  if (o.pct_v6 < 100 && hosts6 == o.hosts) hosts6 = o.hosts - 1;
+  zipf_init(&z4, (hosts6 == o.hosts) ? 1 : o.hosts - hosts6, o.skew);
+  zipf_init(&z6, (hosts6 == 0) ? 1 : hosts6, o.skew);
+  pool_size = (o.packets < POOL_MAX) ? (unsigned int)o.packets : POOL_MAX;
+  pool = calloc(pool_size, sizeof(*pool));
+  sms = calloc(pool_size, sizeof(*sms));
+  if (pool == NULL || sms == NULL) {
+    fprintf(stderr, "calloc(): out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < pool_size; i++)
+    make_frame(&pool[i], &o, &z4, &z6);
+
+  now_init();
+  daylog_init(NULL, NULL, NULL);
+  graph_init();
+  hosts_db_init();
+  sketch_init(opt_sketch_width);
+  acct_init_localnet("10.0.0.0/8");
+  localip_init(&local_ips);
+  lh = getlinkhdr(DLT_EN10MB);
+
+  /* Decode only. */
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  for (i = 0; i < o.packets; i++) {
+    const struct frame *f = &pool[i % pool_size];
+    struct pktsummary *sm = &sms[i % pool_size];
+
+    memset(sm, 0, sizeof(*sm));
+    sm->pkts = 1;
+    decoded += (unsigned long)decode_packet(lh, &f->hdr, f->data, sm);
+  }
+  report("decode", o.packets, elapsed(&t));
+  if (decoded != o.packets) {
+    fprintf(stderr, "only %lu of %lu packets decoded\n", decoded, o.packets);
+    return 1;
+  }
+
+  /* Acct only, on what was just decoded. */
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  for (i = 0; i < o.packets; i++)
+    acct_for(&sms[i % pool_size], &local_ips);
+  report("acct", o.packets, elapsed(&t));
+  reset();
+
+  /* Both, the way cap.c's callback does it. */
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  for (i = 0; i < o.packets; i++) {
+    const struct frame *f = &pool[i % pool_size];
+    struct pktsummary sm;
+
+    memset(&sm, 0, sizeof(sm));
+    sm.pkts = 1;
+    if (decode_packet(lh, &f->hdr, f->data, &sm))
+      acct_for(&sm, &local_ips);
+  }
+  report("end-to-end", o.packets, elapsed(&t));
+
+  localip_free(&local_ips);
+  sketch_free();
+  hosts_db_free();
+  graph_free();
+  daylog_free();
+  free(sms);
+  free(pool);
+  free(z4.cdf);
+  free(z6.cdf);
+  return 0;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
@@ -0,0 +1,200 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * sketch.c: Count-Min sketch of traffic per host, and the top talkers
+ *
+ * See Cormode and Muthukrishnan, "An Improved Data Stream Summary: The
+ * Count-Min Sketch and its Applications" (2005).  Every row hashes the
+ * address to one cell, and the estimate is the smallest of those cells, so
+ * it can be too high (when another address shares all of them) but never
+ * too low.  We use the "conservative update": cells are only raised as far
+ * as the new estimate, which keeps collisions from piling up as much.
+ *
+ * Unlike hosts_db, nothing is ever dropped, so this remembers everything
+ * since startup (or the last reset) in fixed memory.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#include "conv.h"
+#include "hll.h"  /* for hll_hash */
+#include "sketch.h"
+
+#include <stdlib.h> /* for qsort */
+#include <string.h>
+
+#define EULER 2.718281828459045
+
+static struct sketch_count *cells = NULL; /* SKETCH_DEPTH rows of width */
+static unsigned int width = 0;
+static uint64_t sum_bytes = 0;
+
+/* Top talkers, by the estimate of in + out bytes at the time they were
+ * last seen.  Once it's full, an address only gets in by beating the
+ * smallest.
+ */
+struct top_entry {
+   struct addr addr;
+   uint64_t total;
+};
+static struct top_entry top[SKETCH_TOP];
+static unsigned int top_count = 0, top_min = 0;
+
+void sketch_init(const unsigned int w) {
+   width = w;
+   if (width == 0)
+      return;
+   cells = xcalloc((size_t)SKETCH_DEPTH * width, sizeof(*cells));
+   sketch_reset();
+}
+
+void sketch_reset(void) {
+   if (cells == NULL)
+      return;
+   memset(cells, 0, (size_t)SKETCH_DEPTH * width * sizeof(*cells));
+   sum_bytes = 0;
+   top_count = top_min = 0;
+}
+
+void sketch_free(void) {
+   free(cells);
+   cells = NULL;
+   width = 0;
+}
+
+int sketch_enabled(void) {
+   return (cells != NULL);
+}
+
+/* Each row gets its own index, by remixing the address's hash with
+ * SplitMix64.  (Double hashing, h1 + i*h2, is cheaper, but with a
+ * power-of-two width it only has 2 * log2(width) bits to go on, and busy
+ * hosts end up sharing every cell.)
+ */
+static void cell_pos(const struct addr * const a,
+                     unsigned int pos[SKETCH_DEPTH]) {
+   uint64_t h;
+   unsigned int i;
+
+   if (a->family == IPv4)
+      h = hll_hash(&(a->ip.v4), sizeof(a->ip.v4));
+   else
+      h = hll_hash(&(a->ip.v6), sizeof(a->ip.v6));
+   for (i = 0; i < SKETCH_DEPTH; i++) {
+      uint64_t z = h + (i + 1) * 0x9e3779b97f4a7c15ULL;
+
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      z ^= z >> 31;
+      pos[i] = i * width + (unsigned int)(z % width);
+   }
+}
+
+static void estimate_at(const unsigned int pos[SKETCH_DEPTH],
+                        struct sketch_count *c) {
+   unsigned int i;
+
+   *c = cells[pos[0]];
+   for (i = 1; i < SKETCH_DEPTH; i++) {
+      const struct sketch_count *cell = &cells[pos[i]];
+
+      if (cell->in < c->in) c->in = cell->in;
+      if (cell->out < c->out) c->out = cell->out;
+      if (cell->pkts_in < c->pkts_in) c->pkts_in = cell->pkts_in;
+      if (cell->pkts_out < c->pkts_out) c->pkts_out = cell->pkts_out;
+   }
+}
+
+void sketch_estimate(const struct addr * const a, struct sketch_count *c) {
+   unsigned int pos[SKETCH_DEPTH];
+
+   if (cells == NULL) {
+      memset(c, 0, sizeof(*c));
+      return;
+   }
+   cell_pos(a, pos);
+   estimate_at(pos, c);
+}
+
+static void find_top_min(void) {
+   unsigned int i;
+
+   top_min = 0;
+   for (i = 1; i < top_count; i++)
+      if (top[i].total < top[top_min].total)
+         top_min = i;
+}
+
+static void top_update(const struct addr * const a, const uint64_t total) {
+   unsigned int i;
+
+   if ((top_count == SKETCH_TOP) && (total <= top[top_min].total))
+      return;
+   for (i = 0; i < top_count; i++)
+      if (addr_equal(&(top[i].addr), a)) {
+         top[i].total = total;
+         if (i == top_min)
+            find_top_min();
+         return;
+      }
+   if (top_count < SKETCH_TOP)
+      i = top_count++;
+   else
+      i = top_min;
+   top[i].addr = *a;
+   top[i].total = total;
+   find_top_min();
+}
+
+/* Raise the cells to at least est + add. */
+#define CONSERVATIVE_ADD(field) do { \
+   const uint64_t want = est.field + c->field; \
+   for (i = 0; i < SKETCH_DEPTH; i++) \
+      if (cells[pos[i]].field < want) \
+         cells[pos[i]].field = want; \
+   est.field = want; \
+} while (0)
+
+void sketch_add(const struct addr * const a, const struct sketch_count *c) {
+   unsigned int pos[SKETCH_DEPTH], i;
+   struct sketch_count est;
+
+   if (cells == NULL)
+      return;
+   cell_pos(a, pos);
+   estimate_at(pos, &est);
+   CONSERVATIVE_ADD(in);
+   CONSERVATIVE_ADD(out);
+   CONSERVATIVE_ADD(pkts_in);
+   CONSERVATIVE_ADD(pkts_out);
+   sum_bytes += c->in + c->out;
+   top_update(a, est.in + est.out);
+}
+
+uint64_t sketch_error(void) {
+   if (width == 0)
+      return 0;
+   return (uint64_t)(EULER * (double)sum_bytes / width);
+}
+
+static int cmp_top(const void *va, const void *vb) {
+   const struct top_entry *a = va, *b = vb;
+
+   if (a->total > b->total) return -1;
+   if (a->total < b->total) return 1;
+   return addr_cmp(&(a->addr), &(b->addr));
+}
+
+unsigned int sketch_top(struct addr *addrs, const unsigned int max) {
+   struct top_entry sorted[SKETCH_TOP];
+   unsigned int i, n = (top_count < max) ? top_count : max;
+
+   memcpy(sorted, top, top_count * sizeof(*top));
+   qsort(sorted, top_count, sizeof(*sorted), cmp_top);
+   for (i = 0; i < n; i++)
+      addrs[i] = sorted[i].addr;
+   return n;
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
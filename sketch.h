@@ -0,0 +1,47 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * sketch.h: Count-Min sketch of traffic per host, and the top talkers
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_SKETCH_H
+#define __DARKSTAT_SKETCH_H
+
+#include "addr.h"
+
+#include <stdint.h>
+
+#define SKETCH_DEPTH 4 /* rows, each with its own hash */
+#define SKETCH_TOP 64  /* candidates for the top talkers */
+
+struct sketch_count {
+   uint64_t in, out, pkts_in, pkts_out;
+};
+
+/* The sketch takes SKETCH_DEPTH * width * sizeof(struct sketch_count) bytes,
+ * and is disabled if width is zero.
+ */
+void sketch_init(const unsigned int width);
+void sketch_reset(void);
+void sketch_free(void);
+int sketch_enabled(void);
+
+void sketch_add(const struct addr * const a, const struct sketch_count *c);
+
+/* The estimate is never lower than the traffic added for the address. */
+void sketch_estimate(const struct addr * const a, struct sketch_count *c);
+
+/* With probability at least 1 - 2e^-SKETCH_DEPTH, or about 96%, an estimate
+ * of in + out bytes is too high by no more than this.
+ */
+uint64_t sketch_error(void);
+
+/* Copies up to max of the top talkers, biggest first, into addrs.  Returns
+ * how many there were.
+ */
+unsigned int sketch_top(struct addr *addrs, const unsigned int max);
+
+#endif /* __DARKSTAT_SKETCH_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
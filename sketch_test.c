@@ -0,0 +1,120 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * sketch_test.c: tests for sketch.c
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "sketch.h"
+#include "test_util.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct addr ip4(uint32_t n) {
+  struct addr a;
+  memset(&a, 0, sizeof(a));
+  a.family = IPv4;
+  a.ip.v4 = htonl(n);
+  return a;
+}
+
+/* Host n sends n bytes in one packet, n times over. */
+static void add_hosts(uint32_t count) {
+  uint32_t n, j;
+  for (n = 1; n <= count; n++) {
+    struct addr a = ip4(0x0a000000 + n);
+    struct sketch_count c;
+    c.in = 0;
+    c.out = n;
+    c.pkts_in = 0;
+    c.pkts_out = 1;
+    for (j = 0; j < n; j++)
+      sketch_add(&a, &c);
+  }
+}
+
+/* With plenty of cells, every estimate is exact. */
+static void test_exact(void) {
+  struct addr a = ip4(0x0a000005);
+  struct sketch_count c;
+
+  sketch_init(4096);
+  add_hosts(10);
+  sketch_estimate(&a, &c);
+  check(c.out == 25 && c.pkts_out == 5 && c.in == 0 && c.pkts_in == 0,
+        "exact estimate");
+  a = ip4(0x0a0000ff);
+  sketch_estimate(&a, &c);
+  check(c.out == 0 && c.pkts_out == 0, "unseen host is zero");
+  sketch_reset();
+  a = ip4(0x0a000005);
+  sketch_estimate(&a, &c);
+  check(c.out == 0 && sketch_error() == 0, "reset");
+  sketch_free();
+}
+
+/* With too few cells, estimates are never low, and within the bound. */
+static void test_bound(void) {
+  uint32_t n, bad = 0, low = 0;
+  const uint32_t count = 2000;
+
+  sketch_init(256);
+  add_hosts(count);
+  for (n = 1; n <= count; n++) {
+    struct addr a = ip4(0x0a000000 + n);
+    struct sketch_count c;
+    sketch_estimate(&a, &c);
+    if (c.out < (uint64_t)n * n || c.pkts_out < n) low++;
+    if (c.out + c.in > (uint64_t)n * n + sketch_error()) bad++;
+  }
+  check(low == 0, "never underestimates");
+  check(bad < count / 20, "error bound");
+  sketch_free();
+}
+
+/* The biggest hosts are on top, in order. */
+static void test_top(void) {
+  struct addr top[SKETCH_TOP];
+  unsigned int n, i, ok = 1;
+
+  sketch_init(16384);
+  add_hosts(500);
+  n = sketch_top(top, SKETCH_TOP);
+  check(n == SKETCH_TOP, "top is full");
+  for (i = 0; i < n; i++) {
+    struct addr want = ip4(0x0a000000 + 500 - i);
+    if (!addr_equal(&top[i], &want)) ok = 0;
+  }
+  check(ok, "top order");
+  n = sketch_top(top, 3);
+  check(n == 3, "top limit");
+  sketch_free();
+}
+
+int main(void) {
+  struct addr a = ip4(1);
+  struct sketch_count c;
+
+  check(!sketch_enabled(), "disabled by default");
+  sketch_estimate(&a, &c);
+  check(c.in == 0 && c.out == 0, "disabled estimate is zero");
+  test_exact();
+  test_bound();
+  test_top();
+  return test_retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
@@ -156,9 +156,13 @@ function poll() {
   document.getElementById("graph_reload").innerHTML = "reload graphs";
   killChildren(graphs.msg);
   head = xh.responseXML.childNodes[0];
-  for (var n in {"tb":0, "tp":0, "pc":0, "pd":0})
-   document.getElementById(n).innerHTML = thousands(head.getAttribute(n));
-  document.getElementById("rf").innerHTML = head.getAttribute("rf");
+  for (var n in {"tb":0, "tp":0, "pc":0, "pd":0, "rf":0})
+  {
+   var e = document.getElementById(n);
+   if (!e) continue; /* not every page shows every counter */
+   e.innerHTML = (n == "rf") ? head.getAttribute(n)
+                             : thousands(head.getAttribute(n));
+  }
  }
 }
 
@@ -0,0 +1,256 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * stats.c: where darkstat's own time goes
+ *
+ * Each stage of the work keeps a histogram of how long it took, with
+ * buckets that double in size, so the percentiles are only good to within
+ * a factor of two, but recording a time is a handful of instructions.
+ * Stages that run once per packet are only timed on one in STATS_SAMPLE,
+ * because reading the clock costs about as much as decoding.
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+
+#include "config.h"
+#include "cap.h"
+#include "dns.h"
+#include "hosts_db.h"
+#include "html.h"
+#include "stats.h"
+#include "str.h"
+
+#include <time.h>
+#ifdef HAVE_MALLOC_H
+# include <malloc.h>
+#endif
+
+static struct stats_hist stages[NUM_STATS_STAGES];
+static struct stats_probes probes;
+
+static const char * const stage_names[NUM_STATS_STAGES] = {
+   "loop", "dispatch", "decode", "acct", "reduce", "rotate", "render", "gzip"
+};
+
+const char *stats_stage_name(const enum stats_stage stage) {
+   return stage_names[stage];
+}
+
+uint64_t stats_bucket_nsec(const unsigned int i) {
+   return (uint64_t)STATS_MIN_NSEC << i;
+}
+
+/* The upper bound of the bucket that the pct'th percentile falls in, or
+ * the maximum if that's smaller.  Zero if nothing was recorded.
+ */
+uint64_t stats_percentile(const struct stats_hist *h,
+                          const unsigned int pct) {
+   uint64_t sum = 0;
+   unsigned int i;
+
+   if (h->count == 0)
+      return 0;
+   for (i = 0; i < STATS_BUCKETS - 1; i++) {
+      sum += h->bucket[i];
+      if (sum * 100 >= h->count * pct)
+         break;
+   }
+   if ((i == STATS_BUCKETS - 1) || (stats_bucket_nsec(i) > h->max_nsec))
+      return h->max_nsec;
+   return stats_bucket_nsec(i);
+}
+
+int stats_sample(void) {
+   static unsigned int n = 0;
+
+   return ((++n & (STATS_SAMPLE - 1)) == 0);
+}
+
+void stats_record(const enum stats_stage stage, const int64_t nsec) {
+   struct stats_hist *h = &stages[stage];
+   const uint64_t t = (nsec < 0) ? 0 : (uint64_t)nsec;
+   unsigned int i = 0;
+
+   while ((i < STATS_BUCKETS - 1) && (t >= stats_bucket_nsec(i)))
+      i++;
+   h->bucket[i]++;
+   h->count++;
+   h->sum_nsec += t;
+   if (t > h->max_nsec)
+      h->max_nsec = t;
+}
+
+void stats_time(const enum stats_stage stage, struct timespec *t) {
+   struct timespec t1;
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   stats_record(stage, (int64_t)(t1.tv_sec - t->tv_sec) * 1000000000 +
+                       t1.tv_nsec - t->tv_nsec);
+   *t = t1;
+}
+
+void stats_probe(const unsigned int len) {
+   probes.searches[(len < STATS_PROBES - 1) ? len : STATS_PROBES - 1]++;
+   probes.sum += len;
+}
+
+const struct stats_hist *stats_get(const enum stats_stage stage) {
+   return &stages[stage];
+}
+
+const struct stats_probes *stats_get_probes(void) {
+   return &probes;
+}
+
+int stats_malloc(uint64_t *in_use, uint64_t *from_os) {
+#ifdef HAVE_MALLINFO2
+   const struct mallinfo2 mi = mallinfo2();
+
+   *in_use = mi.uordblks + mi.hblkhd;
+   *from_os = mi.arena + mi.hblkhd;
+   return 1;
+#else
+   *in_use = *from_os = 0;
+   return 0;
+#endif
+}
+
+/* ---------------------------------------------------------------------------
+ * Web interface: /debug/stats
+ */
+static void stats_append_nsec(struct str *buf, const uint64_t nsec) {
+   if (nsec < 10000)
+      str_appendf(buf, "%'qu ns", (qu)nsec);
+   else if (nsec < 10000000)
+      str_appendf(buf, "%'qu &micro;s", (qu)(nsec / 1000));
+   else
+      str_appendf(buf, "%'qu ms", (qu)(nsec / 1000000));
+}
+
+static void stats_cell_nsec(struct str *buf, const uint64_t nsec,
+                            const char *prefix) {
+   str_appendf(buf, " <td class=\"num\">%s", prefix);
+   stats_append_nsec(buf, nsec);
+   str_append(buf, "</td>\n");
+}
+
+static void html_stages(struct str *buf) {
+   unsigned int i;
+
+   str_appendf(buf,
+      "<h3>Stages</h3>\n"
+      "<p>Percentiles are rounded up to a power of two.  Decode and acct "
+      "are timed on one packet in %u.</p>\n"
+      "<table>\n"
+      "<tr>\n"
+      " <th>Stage</th>\n"
+      " <th>Count</th>\n"
+      " <th>Mean</th>\n"
+      " <th>50%%</th>\n"
+      " <th>90%%</th>\n"
+      " <th>99%%</th>\n"
+      " <th>Max</th>\n"
+      "</tr>\n", STATS_SAMPLE);
+   for (i = 0; i < NUM_STATS_STAGES; i++) {
+      const struct stats_hist *h = &stages[i];
+
+      str_appendf(buf,
+         "<tr>\n"
+         " <td>%s</td>\n"
+         " <td class=\"num\">%'qu</td>\n",
+         stage_names[i], (qu)h->count);
+      if (h->count == 0) {
+         str_append(buf, " <td></td>\n <td></td>\n <td></td>\n"
+                         " <td></td>\n <td></td>\n</tr>\n");
+         continue;
+      }
+      stats_cell_nsec(buf, h->sum_nsec / h->count, "");
+      stats_cell_nsec(buf, stats_percentile(h, 50), "&le; ");
+      stats_cell_nsec(buf, stats_percentile(h, 90), "&le; ");
+      stats_cell_nsec(buf, stats_percentile(h, 99), "&le; ");
+      stats_cell_nsec(buf, h->max_nsec, "");
+      str_append(buf, "</tr>\n");
+   }
+   str_append(buf, "</table>\n");
+}
+
+static void html_probes(struct str *buf) {
+   uint64_t total = 0;
+   unsigned int i;
+
+   for (i = 0; i < STATS_PROBES; i++)
+      total += probes.searches[i];
+   str_append(buf,
+      "<h3>Hash table probe lengths</h3>\n"
+      "<p>Buckets compared per search, over every table.</p>\n"
+      "<table>\n"
+      "<tr>\n"
+      " <th>Length</th>\n"
+      " <th>Searches</th>\n"
+      "</tr>\n");
+   for (i = 0; i < STATS_PROBES; i++)
+      if (probes.searches[i] > 0)
+         str_appendf(buf,
+            "<tr>\n"
+            " <td class=\"num\">%u%s</td>\n"
+            " <td class=\"num\">%'qu</td>\n"
+            "</tr>\n",
+            i, (i == STATS_PROBES - 1) ? "+" : "",
+            (qu)probes.searches[i]);
+   str_append(buf, "</table>\n");
+   if (total > 0) {
+      const uint64_t hundredths = probes.sum * 100 / total;
+
+      str_appendf(buf, "<p>Mean: %qu.%s%qu</p>\n",
+         (qu)(hundredths / 100), (hundredths % 100 < 10) ? "0" : "",
+         (qu)(hundredths % 100));
+   }
+}
+
+static void html_resources(struct str *buf) {
+   uint64_t in_use, from_os;
+   const char *name;
+   unsigned int i, recv, drop;
+
+   str_append(buf, "<h3>Resources</h3>\n<p>\n");
+   if (stats_malloc(&in_use, &from_os))
+      str_appendf(buf, "<b>Memory in use:</b> %'qu bytes, "
+         "<b>from the system:</b> %'qu bytes<br>\n",
+         (qu)in_use, (qu)from_os);
+   else
+      str_append(buf, "<b>Memory:</b> not available<br>\n");
+   str_appendf(buf, "<b>DNS queue:</b> %'u lookups\n</p>\n",
+      dns_queue_len());
+
+   str_append(buf,
+      "<table>\n"
+      "<tr>\n"
+      " <th>Interface</th>\n"
+      " <th>Received</th>\n"
+      " <th>Dropped</th>\n"
+      "</tr>\n");
+   for (i = 0; cap_iface_stats(i, &name, &recv, &drop); i++)
+      str_appendf(buf,
+         "<tr>\n"
+         " <td>%s</td>\n"
+         " <td class=\"num\">%'u</td>\n"
+         " <td class=\"num\">%'u</td>\n"
+         "</tr>\n",
+         name, recv, drop);
+   str_append(buf, "</table>\n");
+}
+
+struct str *html_stats(void) {
+   struct str *buf = str_make();
+
+   html_open(buf, "Debug stats", /*path_depth=*/1, /*want_graph_js=*/0);
+   html_stages(buf);
+   html_hashtable_stats(buf);
+   html_probes(buf);
+   html_resources(buf);
+   html_close(buf);
+   return buf;
+}
+
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -0,0 +1,74 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * stats.h: where darkstat's own time goes
+ *
+ * You may use, modify and redistribute this file under the terms of the
+ * GNU General Public License version 2. (see COPYING.GPL)
+ */
+#ifndef __DARKSTAT_STATS_H
+#define __DARKSTAT_STATS_H
+
+#include <stdint.h>
+
+struct str;
+struct timespec;
+
+enum stats_stage {
+   STATS_LOOP,     /* one pass of the event loop */
+   STATS_DISPATCH, /* pcap_dispatch(), which includes decode and acct */
+   STATS_DECODE,   /* decoding one packet, sampled */
+   STATS_ACCT,     /* accounting for one packet, sampled */
+   STATS_REDUCE,   /* shrinking the hosts table */
+   STATS_ROTATE,   /* moving the graphs and logs along */
+   STATS_RENDER,   /* building an HTTP reply */
+   STATS_GZIP,     /* compressing it */
+   NUM_STATS_STAGES
+};
+
+/* Bucket i of a histogram counts times under STATS_MIN_NSEC << i, except
+ * for the last one, which counts the rest.
+ */
+#define STATS_BUCKETS 24
+#define STATS_MIN_NSEC 256
+
+struct stats_hist {
+   uint64_t count, sum_nsec, max_nsec;
+   uint64_t bucket[STATS_BUCKETS];
+};
+
+/* Per-packet stages time one packet in this many (a power of two). */
+#define STATS_SAMPLE 64
+
+/* Buckets looked at by hashtable searches: 0 to STATS_PROBES-2, and the
+ * last one counts the rest.
+ */
+#define STATS_PROBES 16
+
+struct stats_probes {
+   uint64_t searches[STATS_PROBES];
+   uint64_t sum;
+};
+
+const char *stats_stage_name(const enum stats_stage stage);
+uint64_t stats_bucket_nsec(const unsigned int i); /* upper bound */
+uint64_t stats_percentile(const struct stats_hist *h, const unsigned int pct);
+
+int stats_sample(void); /* true once every STATS_SAMPLE calls */
+void stats_record(const enum stats_stage stage, const int64_t nsec);
+
+/* Records the time since *t, and restarts *t so stages can be chained. */
+void stats_time(const enum stats_stage stage, struct timespec *t);
+
+void stats_probe(const unsigned int len);
+
+const struct stats_hist *stats_get(const enum stats_stage stage);
+const struct stats_probes *stats_get_probes(void);
+
+/* Returns 0 if the allocator doesn't tell us. */
+int stats_malloc(uint64_t *in_use, uint64_t *from_os);
+
+struct str *html_stats(void);
+
+#endif /* __DARKSTAT_STATS_H */
+/* vim:set ts=3 sw=3 tw=78 expandtab: */
@@ -0,0 +1,125 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * stats_test.c: tests for stats.c
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "stats.h"
+#include "str.h"
+#include "test_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* stats.o needs these, and the real ones would drag in the rest of
+ * darkstat.
+ */
+void html_open(struct str *buf, const char *title,
+               const unsigned int path_depth, const int want_graph_js) {
+  (void)path_depth;
+  (void)want_graph_js;
+  str_appendf(buf, "<%s>\n", title);
+}
+
+void html_close(struct str *buf) { str_append(buf, "</>\n"); }
+
+void html_hashtable_stats(struct str *buf) { (void)buf; }
+
+unsigned int dns_queue_len(void) { return 7; }
+
+int cap_iface_stats(const unsigned int n, const char **name,
+                    unsigned int *recv, unsigned int *drop) {
+  if (n > 0) return 0;
+  *name = "em0";
+  *recv = 1000;
+  *drop = 3;
+  return 1;
+}
+
+static void test_buckets(void) {
+  const struct stats_hist *h = stats_get(STATS_DECODE);
+
+  stats_record(STATS_DECODE, 0);
+  stats_record(STATS_DECODE, STATS_MIN_NSEC - 1);
+  stats_record(STATS_DECODE, STATS_MIN_NSEC);
+  stats_record(STATS_DECODE, -5); /* clock went backwards */
+  stats_record(STATS_DECODE, 1000000000000LL);
+  check(h->count == 5, "count");
+  check(h->bucket[0] == 3, "small times go in the first bucket");
+  check(h->bucket[1] == 1, "bounds are exclusive");
+  check(h->bucket[STATS_BUCKETS - 1] == 1, "huge times go in the last");
+  check(h->max_nsec == 1000000000000ULL, "max");
+  check(h->sum_nsec == 1000000000000ULL + 2 * STATS_MIN_NSEC - 1, "sum");
+}
+
+static void test_percentile(void) {
+  const struct stats_hist *h = stats_get(STATS_RENDER);
+  int i;
+
+  check(stats_percentile(h, 50) == 0, "empty percentile");
+  /* 90 fast ones in [1024, 2048), and 10 slow ones of 100us. */
+  for (i = 0; i < 90; i++)
+    stats_record(STATS_RENDER, 1500);
+  for (i = 0; i < 10; i++)
+    stats_record(STATS_RENDER, 100000);
+  check(stats_percentile(h, 50) == 2048, "p50");
+  check(stats_percentile(h, 90) == 2048, "p90 on the edge");
+  check(stats_percentile(h, 99) == 100000, "p99 is capped at the max");
+  check(stats_percentile(h, 100) == 100000, "p100 is the max");
+}
+
+static void test_sample(void) {
+  int i, n = 0;
+
+  for (i = 0; i < STATS_SAMPLE * 10; i++)
+    n += stats_sample();
+  check(n == 10, "sampling rate");
+}
+
+static void test_probes(void) {
+  const struct stats_probes *p = stats_get_probes();
+
+  stats_probe(0);
+  stats_probe(1);
+  stats_probe(1);
+  stats_probe(STATS_PROBES + 100);
+  check(p->searches[0] == 1 && p->searches[1] == 2, "probe lengths");
+  check(p->searches[STATS_PROBES - 1] == 1, "long probes go in the last");
+  check(p->sum == STATS_PROBES + 102, "probe sum");
+}
+
+static void test_html(void) {
+  struct str *buf = html_stats();
+  size_t len;
+  char *s;
+
+  str_appendn(buf, "", 1);
+  str_extract(buf, &len, &s);
+  check(strstr(s, "<td>decode</td>") != NULL, "html has stages");
+  check(strstr(s, "<td>em0</td>") != NULL, "html has interfaces");
+  check(strstr(s, "7 lookups") != NULL, "html has the DNS queue");
+  free(s);
+}
+
+int main(void) {
+  test_buckets();
+  test_percentile();
+  test_sample();
+  test_probes();
+  test_html();
+  return test_retcode;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
@@ -211,6 +211,12 @@ str_append_i64(struct str *s, int64_t i, const int mod_sep)
    str_append_u64(s, (uint64_t)i, mod_sep);
 }
 
+void
+str_appendu(struct str *s, const uint64_t u)
+{
+   str_append_u64(s, u, 0);
+}
+
 static void
 str_append_hex8(struct str *s, const uint8_t b)
 {
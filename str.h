@@ -60,6 +60,7 @@ size_t xasprintf(char **result, const char *format, ...) _printflike_(2, 3);
 void str_vappendf(struct str *s, const char *format, va_list va)
    _printflike_(2, 0);
 void str_appendf(struct str *s, const char *format, ...) _printflike_(2, 3);
+void str_appendu(struct str *s, const uint64_t u); /* like "%qu" */
 
 struct str *length_of_time(const time_t t);
 ssize_t str_write(const struct str * const buf, const int fd);
@@ -0,0 +1,99 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * test_util.c: shared by the *_test.c programs
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "conv.h"
+#include "err.h"
+#include "test_util.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int test_retcode = 0;
+
+void check(const int ok, const char *what) {
+  printf("%s: %s\n", ok ? "PASS" : "FAIL", what);
+  if (!ok) test_retcode = 1;
+}
+
+void err(const int code, const char *format, ...) {
+  va_list va;
+  int saved = errno;
+  va_start(va, format);
+  vfprintf(stderr, format, va);
+  va_end(va);
+  fprintf(stderr, ": %s\n", strerror(saved));
+  exit(code);
+}
+
+void errx(const int code, const char *format, ...) {
+  va_list va;
+  va_start(va, format);
+  vfprintf(stderr, format, va);
+  va_end(va);
+  fprintf(stderr, "\n");
+  exit(code);
+}
+
+void warn(const char *format, ...) {
+  va_list va;
+  int saved = errno;
+  va_start(va, format);
+  vfprintf(stderr, format, va);
+  va_end(va);
+  fprintf(stderr, ": %s\n", strerror(saved));
+}
+
+void warnx(const char *format, ...) {
+  va_list va;
+  va_start(va, format);
+  vfprintf(stderr, format, va);
+  va_end(va);
+  fprintf(stderr, "\n");
+}
+
+/* Tests are quiet unless something goes wrong. */
+void verbosef(const char *format, ...) { (void)format; }
+
+void *xmalloc(const size_t size) {
+  void *ptr = malloc(size);
+  if (ptr == NULL) errx(1, "malloc(): out of memory");
+  return ptr;
+}
+
+void *xcalloc(const size_t num, const size_t size) {
+  void *ptr = calloc(num, size);
+  if (ptr == NULL) errx(1, "calloc(): out of memory");
+  return ptr;
+}
+
+void *xrealloc(void *original, const size_t size) {
+  void *ptr = realloc(original, size);
+  if (ptr == NULL) errx(1, "realloc(): out of memory");
+  return ptr;
+}
+
+char *xstrdup(const char *s) {
+  char *tmp = strdup(s);
+  if (tmp == NULL) errx(1, "strdup(): out of memory");
+  return tmp;
+}
+
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */
@@ -0,0 +1,32 @@
+/* darkstat 3
+ * copyright (c) 2026 Emil Mikulic.
+ *
+ * test_util.h: shared by the *_test.c programs
+ *
+ * test_util.o stands in for err.o and conv.o, which would drag in the rest
+ * of darkstat, so the tests get err(), xmalloc() and friends from err.h and
+ * conv.h as usual.
+ *
+ * Permission to use, copy, modify, and distribute this file for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef __DARKSTAT_TEST_UTIL_H
+#define __DARKSTAT_TEST_UTIL_H
+
+/* What main() should return: 1 once any check has failed. */
+extern int test_retcode;
+
+/* Prints PASS or FAIL and the description. */
+void check(const int ok, const char *what);
+
+#endif /* __DARKSTAT_TEST_UTIL_H */
+/* vim:set ts=2 sts=2 sw=2 tw=80 et: */